@@ -2,35 +2,108 @@
 #include <string>
 #include <ctime>
 #include <cassert>
+#include <functional>
+#include <utility>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string_view>
+#include <charconv>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <memory>
+#include <shared_mutex>
+#include <mutex>
+#include <memory_resource>
+#include <thread>
+#include <condition_variable>
+#include <deque>
+#include <cerrno>
+#include <sstream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SMS_X86_SIMD
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
 
 using namespace std;
 
+//Every SmarterArray allocates from a memory resource: the default resource unless one is given to the constructor.
+//Moving an array (construction or assignment) carries its resource along with its memory; copying gives the copy the
+//default resource, and assigning a copy keeps the resource of the left hand side.
 template <class T>
 class SmarterArray
 {
 private:
 	T* A;
 	int size;
+	int capacity; //The number of elements A can hold before it must grow (capacity >= size at any time)
+	pmr::memory_resource* resource; //Where A is allocated from. Not owned.
+
+	void grow(const int&); //Reallocate A so that it can hold at least the given number of elements
+	T* allocate(const int&) const; //Allocate and default construct the given number of elements, like new T[n]
+	void deallocate(T*, const int&) const; //Destroy and free elements returned by allocate, like delete[]
 
 public:
 	//Constructors
 	SmarterArray();
+	explicit SmarterArray(pmr::memory_resource*); //An empty array that allocates from the given resource
 	SmarterArray(const T*, const int&); //Non-default constructor: Deep copy of the argument
 	SmarterArray(const SmarterArray<T>&); //Copy constructor: Deep copy of the argument
+	SmarterArray(SmarterArray<T>&&) noexcept; //Move constructor: Take over the memory of the argument and leave it empty
 
-	//Assignment operator
+	//Assignment operators
 	SmarterArray<T>& operator = (const SmarterArray<T>&); //Assignment operator. Memory clean up and deep copy of the argument
+	SmarterArray<T>& operator = (SmarterArray<T>&&) noexcept; //Move assignment operator. Memory clean up and take over the argument's memory
 
 	//Destructor
 	~SmarterArray(); //Destructor. Memory clean up
 
 	//Getters, Setters, operators and other functions
 	int getSize() const; //Return the size of the calling object
+	int getCapacity() const; //Return the number of elements the calling object can hold without reallocating
+	pmr::memory_resource* getResource() const; //Return the resource the calling object allocates from
 	T& operator[](const int&) const; //Assert index is valid and then return the element at the given index
 	int find(const T&) const; //Return the index of the element that is == to the argument. Return -1 if not found.
-	void append(const T&); //Append the argument to the calling object.
+	void append(const T&); //Append the argument to the calling object. Amortized O(1): the capacity grows geometrically.
+	void append(T&&); //Move the argument to the end of the calling object. Amortized O(1).
+	template <class... Args>
+	T& emplace_back(Args&&...); //Construct an element from the arguments at the end of the calling object and return it
+	void reserve(const int&); //Make sure the calling object can hold at least the given number of elements without reallocating
+	void shrink_to_fit(); //Reduce the capacity of the calling object to its size
 	bool remove(const int&); //If the index argument is a valid index, then remove the element at the index argument
-							//from the calling object and return true. Otherwise return false. 
+							//from the calling object and return true. Otherwise return false. The elements after the
+							//index are moved one position to the left in place.
+	bool swapRemove(const int&); //Like remove, but move the last element into the index instead of shifting. O(1).
 	bool operator == (const SmarterArray<T>&) const; //return true if sizes are equal and elements at same indexes are ==
 
 	template <class T>
@@ -42,34 +115,64 @@ SmarterArray<T>::SmarterArray()
 {
 	this->A = nullptr;
 	this->size = 0;
+	this->capacity = 0;
+	this->resource = pmr::get_default_resource();
+}
+
+template <class T>
+SmarterArray<T>::SmarterArray(pmr::memory_resource* resource)
+{
+	this->A = nullptr;
+	this->size = 0;
+	this->capacity = 0;
+	this->resource = resource;
 }
 
 template <class T>
 SmarterArray<T>::SmarterArray(const T* arr, const int& size)
 {
+	this->A = nullptr;
 	this->size = size;
+	this->capacity = size;
+	this->resource = pmr::get_default_resource();
 
 	if (this->size > 0)
 	{
-		this->A = new T[this->size];
+		this->A = allocate(this->size);
 		for (int i = 0; i < size; i++)
-			this->A[i] = A[i];
+			this->A[i] = arr[i];
 	}
 }
 
 template <class T>
 SmarterArray<T>::SmarterArray(const SmarterArray<T>& L)
 {
+	A = nullptr;
 	size = L.size;
+	capacity = L.size;
+	resource = pmr::get_default_resource();
 
 	if (size > 0)
 	{
-		A = new T[size];
+		A = allocate(size);
 		for (int i = 0; i < size; i++)
 			A[i] = L[i];
 	}
 }
 
+template <class T>
+SmarterArray<T>::SmarterArray(SmarterArray<T>&& L) noexcept
+{
+	A = L.A;
+	size = L.size;
+	capacity = L.capacity;
+	resource = L.resource;
+
+	L.A = nullptr;
+	L.size = 0;
+	L.capacity = 0;
+}
+
 template <class T>
 SmarterArray<T>& SmarterArray<T>::operator=(const SmarterArray<T>& L)
 {
@@ -77,28 +180,97 @@ SmarterArray<T>& SmarterArray<T>::operator=(const SmarterArray<T>& L)
 	if (this == &L)
 		return *this;
 
-	// Delete the left hand side object's memory
-	this->~SmarterArray();
-
-	size = L.size;
-	if (size > 0)
+	// Reuse the left hand side object's memory if it is large enough, otherwise delete it
+	if (capacity < L.size)
 	{
-		A = new T[size];
-		for (int i = 0; i < size; i++)
-			A[i] = L[i];
+		deallocate(A, capacity);
+		A = nullptr;
+		capacity = 0;
+		if (L.size > 0)
+		{
+			A = allocate(L.size);
+			capacity = L.size;
+		}
 	}
 
+	// Release whatever the slots past the new size still hold
+	for (int i = L.size; i < size; i++)
+		A[i] = T();
+
+	size = L.size;
+	for (int i = 0; i < size; i++)
+		A[i] = L[i];
+
+	return *this;
+}
+
+template <class T>
+SmarterArray<T>& SmarterArray<T>::operator=(SmarterArray<T>&& L) noexcept
+{
+	// Check for self assignment, for example s2 = move(s2)
+	if (this == &L)
+		return *this;
+
+	deallocate(A, capacity);
+
+	A = L.A;
+	size = L.size;
+	capacity = L.capacity;
+	resource = L.resource;
+
+	L.A = nullptr;
+	L.size = 0;
+	L.capacity = 0;
+
 	return *this;
 }
 
 template <class T>
 SmarterArray<T>::~SmarterArray()
 {
-	if (size > 0)
-	{
-		delete[] A;
-		size = 0;
-	}
+	deallocate(A, capacity);
+	A = nullptr;
+	size = 0;
+	capacity = 0;
+}
+
+template <class T>
+void SmarterArray<T>::grow(const int& minCapacity)
+{
+	int newCapacity = capacity > 0 ? capacity * 2 : 4;
+	if (newCapacity < minCapacity)
+		newCapacity = minCapacity;
+
+	T* temp = allocate(newCapacity);
+
+	for (int i = 0; i < size; i++)
+		temp[i] = std::move(A[i]);
+
+	deallocate(A, capacity);
+
+	A = temp;
+	capacity = newCapacity;
+}
+
+template <class T>
+T* SmarterArray<T>::allocate(const int& n) const
+{
+	T* p = static_cast<T*>(resource->allocate(sizeof(T) * size_t(n), alignof(T)));
+	for (int i = 0; i < n; i++)
+		new (p + i) T();
+
+	return p;
+}
+
+template <class T>
+void SmarterArray<T>::deallocate(T* p, const int& n) const
+{
+	if (p == nullptr)
+		return;
+
+	for (int i = 0; i < n; i++)
+		p[i].~T();
+	resource->deallocate(p, sizeof(T) * size_t(n), alignof(T));
 }
 
 template <class T>
@@ -107,6 +279,18 @@ int SmarterArray<T>::getSize() const
 	return size;
 }
 
+template <class T>
+int SmarterArray<T>::getCapacity() const
+{
+	return capacity;
+}
+
+template <class T>
+pmr::memory_resource* SmarterArray<T>::getResource() const
+{
+	return resource;
+}
+
 template <class T>
 T& SmarterArray<T>::operator[](const int& index) const
 {
@@ -130,18 +314,83 @@ int SmarterArray<T>::find(const T& arg) const
 template <class T>
 void SmarterArray<T>::append(const T& e)
 {
-	T* temp = new T[size + 1];
+	if (size == capacity)
+	{
+		// e may refer to an element of the calling object, so copy it before the old memory is released
+		T copy = e;
+		grow(size + 1);
+		A[size] = std::move(copy);
+	}
+	else
+		A[size] = e;
+
+	size++;
+}
+
+template <class T>
+void SmarterArray<T>::append(T&& e)
+{
+	if (size == capacity)
+	{
+		T temp = std::move(e);
+		grow(size + 1);
+		A[size] = std::move(temp);
+	}
+	else
+		A[size] = std::move(e);
+
+	size++;
+}
+
+template <class T>
+template <class... Args>
+T& SmarterArray<T>::emplace_back(Args&&... args)
+{
+	T e(std::forward<Args>(args)...);
+
+	if (size == capacity)
+		grow(size + 1);
+
+	A[size] = std::move(e);
+
+	return A[size++];
+}
+
+template <class T>
+void SmarterArray<T>::reserve(const int& newCapacity)
+{
+	if (newCapacity <= capacity)
+		return;
+
+	T* temp = allocate(newCapacity);
 
 	for (int i = 0; i < size; i++)
-		temp[i] = A[i];
+		temp[i] = std::move(A[i]);
 
-	temp[size] = e;
+	deallocate(A, capacity);
 
+	A = temp;
+	capacity = newCapacity;
+}
+
+template <class T>
+void SmarterArray<T>::shrink_to_fit()
+{
+	if (size == capacity)
+		return;
+
+	T* temp = nullptr;
 	if (size > 0)
-		delete[] A;
+	{
+		temp = allocate(size);
+		for (int i = 0; i < size; i++)
+			temp[i] = std::move(A[i]);
+	}
+
+	deallocate(A, capacity);
 
 	A = temp;
-	size++;
+	capacity = size;
 }
 
 template <class T>
@@ -149,18 +398,28 @@ bool SmarterArray<T>::remove(const int& index)
 {
 	if (index >= 0 && index < size)
 	{
-		T* temp = new T[size - 1];
+		for (int i = index; i < size - 1; i++)
+			A[i] = std::move(A[i + 1]);
+
+		// Release whatever the vacated last slot still holds
+		A[size - 1] = T();
+		size = size - 1;
 
-		int i = 0;
-		for (; i < index; i++)
-			temp[i] = A[i];
+		return true;
+	}
 
-		for (int j = index + 1; j < size; j++, i++)
-			temp[i] = A[j];
+	return false;
+}
 
-		delete[] A;
+template <class T>
+bool SmarterArray<T>::swapRemove(const int& index)
+{
+	if (index >= 0 && index < size)
+	{
+		if (index != size - 1)
+			A[index] = std::move(A[size - 1]);
 
-		A = temp;
+		A[size - 1] = T();
 		size = size - 1;
 
 		return true;
@@ -194,777 +453,9706 @@ ostream& operator << (ostream& out, const SmarterArray<T>& L)
 	else
 	{
 		for (int i = 0; i < L.getSize() - 1; i++)
-			out << L[i] << endl;
-		out << L[L.getSize() - 1] << endl;
+			out << L[i] << '\n';
+		out << L[L.getSize() - 1] << '\n';
 	}
 	return out;
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-template <class K, class V>
-class Map
+//An open addressing (linear probing) hash table of positions into some other array. The table does not own
+//the keys: callers hash the key themselves and pass a predicate that checks whether the record at a position
+//has the key being looked for. Deletion shifts the following entries back so no tombstones are left behind.
+class HashIndex
 {
 private:
-	K* A1; //The keys of the map
-	V* A2; //The values of the map
-	int size; //The size of the map (Both A1 and A2 have the same size at any time by design)
-
-public:
-	//Constructors
-	Map();
-	Map(const Map<K, V>&); //Copy constructor. Deep copy.
-
-	//Assignment operator
-	Map<K, V>& operator = (const Map<K, V>&); //Assignment operator. Memory clean up and deep copy.
+	struct Slot
+	{
+		uint32_t hash; //The low 32 bits of the hash, which is all a table of int positions can use
+		int position; //-1 marks an empty slot
+	};
 
-	//Destructor
-	~Map(); //Destructor.
+	SmarterArray<Slot> slots; //The table. Its size is always zero or a power of two.
+	int count; //The number of occupied slots
 
-	//Getters, Setters, operators and other functions
-	int getSize() const; //Return the common size of the map.
-	int find(const K&) const; //Return the index of the first element of the Keys array == the argument. Return -1 if not found.
-	int find(const V&) const; //Return the index of the first element of the Values array == the argument. Return -1 if not found.
-	K& operator[](const V&) const; //Assert the argument is found in the Values array and then return the key with the given value 
-	V& operator[](const K&) const; //Assert the argument is found in the Keys array and then return the value with the given key
-	K& keyAtIndex(const int&) const; //Assert the index argument and then return the key at the given index
-	V& valueAtIndex(const int&) const; //Assert the index argument and then return the value at the given index
-	void append(const K&, const V&); //Append the key-value pair to the calling object
-	bool remove(const int&); //If the index argument is a valid index, then remove the key-value pair at the index argument
-							//from the calling object and return true. Otherwise return false. 
+	void rehash(const int&); //Rebuild the table with the given number of slots
 
-	template <class K, class V>
-	friend ostream& operator << (ostream&, const Map<K, V>&);
+public:
+	HashIndex();
+	explicit HashIndex(pmr::memory_resource*); //An empty index whose table is allocated from the given resource
+	HashIndex(const HashIndex&) = default;
+	HashIndex(HashIndex&&) noexcept; //Take over the argument's table and leave it empty
+	HashIndex& operator = (const HashIndex&) = default;
+	HashIndex& operator = (HashIndex&&) noexcept;
+
+	int getSize() const; //Return the number of positions stored in the index
+	template <class Equals>
+	int find(const size_t& hash, const Equals& equals) const; //Return the first stored position with the given hash
+															//for which equals(position) is true. Return -1 if none.
+	void insert(const size_t& hash, const int& position); //Store the position under the given hash
+	bool erase(const size_t& hash, const int& position); //Remove the given position stored under the given hash.
+														//Return false if it is not in the index.
+	void shiftPositionsAfter(const int& position); //Decrement every stored position greater than the argument
+	void replacePosition(const size_t& hash, const int& oldPosition, const int& newPosition); //Assert the old position is stored
+																						//under the hash and then replace it
+	void reserve(const int&); //Make room for the given number of positions without rehashing
+	void clear(); //Remove every position
+	size_t getMemoryUsage() const; //Return the number of bytes allocated for the table
 };
 
-template <class K, class V>
-Map<K, V>::Map()
+HashIndex::HashIndex()
 {
-	A1 = nullptr;
-	A2 = nullptr;
-	size = 0;
+	count = 0;
 }
 
-template <class K, class V>
-Map<K, V>::Map(const Map<K, V>& x)
+HashIndex::HashIndex(pmr::memory_resource* resource) : slots(resource)
 {
-	size = x.size;
-
-	if (size > 0)
-	{
-		A1 = new K[size];
-		for (int i = 0; i < size; i++)
-			A1[i] = x.A1[i];
+	count = 0;
+}
 
-		A2 = new V[size];
-		for (int i = 0; i < size; i++)
-			A2[i] = x.A2[i];
-	}
+HashIndex::HashIndex(HashIndex&& x) noexcept : slots(std::move(x.slots)), count(x.count)
+{
+	x.count = 0;
 }
 
-template <class K, class V>
-Map<K, V>& Map<K, V>::operator = (const Map<K, V>& x)
+HashIndex& HashIndex::operator = (HashIndex&& x) noexcept
 {
-	// Check for self assignment, for example map1 = map1
 	if (this == &x)
 		return *this;
 
-	// Delete the left hand side object's memory
-	this->~Map();
-
-	size = x.size;
-
-	if (size > 0)
-	{
-		A1 = new K[size];
-		for (int i = 0; i < size; i++)
-			A1[i] = x.A1[i];
-
-		A2 = new V[size];
-		for (int i = 0; i < size; i++)
-			A2[i] = x.A2[i];
-	}
+	slots = std::move(x.slots);
+	count = x.count;
+	x.count = 0;
 
 	return *this;
 }
 
-template <class K, class V>
-Map<K, V>::~Map()
+void HashIndex::rehash(const int& slotCount)
 {
-	if (size > 0)
+	SmarterArray<Slot> old = std::move(slots);
+
+	slots = SmarterArray<Slot>(old.getResource());
+	slots.reserve(slotCount);
+	for (int i = 0; i < slotCount; i++)
+		slots.append(Slot{ 0, -1 });
+
+	size_t mask = slotCount - 1;
+	for (int i = 0; i < old.getSize(); i++)
 	{
-		delete[] A1;
-		delete[] A2;
-		size = 0;
+		if (old[i].position == -1)
+			continue;
+
+		size_t j = old[i].hash & mask;
+		while (slots[int(j)].position != -1)
+			j = (j + 1) & mask;
+		slots[int(j)] = old[i];
 	}
 }
 
-template <class K, class V>
-int Map<K, V>::getSize() const
+int HashIndex::getSize() const
 {
-	return size;
+	return count;
 }
 
-template <class K, class V>
-int Map<K, V>::find(const K& key) const
+template <class Equals>
+int HashIndex::find(const size_t& hash, const Equals& equals) const
 {
-	for (int i = 0; i < size; i++)
+	if (count == 0)
+		return -1;
+
+	size_t mask = slots.getSize() - 1;
+	for (size_t j = hash & mask; slots[int(j)].position != -1; j = (j + 1) & mask)
 	{
-		if (A1[i] == key)
-			return i;
+		if (slots[int(j)].hash == uint32_t(hash) && equals(slots[int(j)].position))
+			return slots[int(j)].position;
 	}
 
 	return -1;
 }
 
-template <class K, class V>
-int Map<K, V>::find(const V& value) const
+void HashIndex::insert(const size_t& hash, const int& position)
 {
-	for (int i = 0; i < size; i++)
+	//Keep the load factor at or below one half so probe sequences stay short
+	if (2 * (count + 1) > slots.getSize())
+		rehash(slots.getSize() > 0 ? slots.getSize() * 2 : 16);
+
+	size_t mask = slots.getSize() - 1;
+	size_t j = hash & mask;
+	while (slots[int(j)].position != -1)
+		j = (j + 1) & mask;
+
+	slots[int(j)] = Slot{ uint32_t(hash), position };
+	count++;
+}
+
+bool HashIndex::erase(const size_t& hash, const int& position)
+{
+	if (count == 0)
+		return false;
+
+	size_t mask = slots.getSize() - 1;
+	size_t i = hash & mask;
+	while (slots[int(i)].position != position)
 	{
-		if (A2[i] == value)
-			return i;
+		if (slots[int(i)].position == -1)
+			return false;
+		i = (i + 1) & mask;
 	}
 
-	return -1;
+	//Shift back every following entry of the cluster that would otherwise become unreachable
+	for (size_t j = (i + 1) & mask; slots[int(j)].position != -1; j = (j + 1) & mask)
+	{
+		size_t home = slots[int(j)].hash & mask;
+		bool reachable = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+		if (!reachable)
+		{
+			slots[int(i)] = slots[int(j)];
+			i = j;
+		}
+	}
+
+	slots[int(i)].position = -1;
+	count--;
+
+	return true;
 }
 
-template <class K, class V>
-K& Map<K, V>::operator[](const V& value) const //Assert the argument is found in the Values array and then return the key with the given value 
+void HashIndex::shiftPositionsAfter(const int& position)
 {
-	for (int i = 0; i < size; i++)
+	for (int i = 0; i < slots.getSize(); i++)
 	{
-		if (A2[i] == value)
-			return A1[i];
+		if (slots[i].position > position)
+			slots[i].position--;
 	}
-
-	assert(false);
 }
 
-template <class K, class V>
-V& Map<K, V>::operator[](const K& key) const //Assert the argument is found in the Keys array and then return the value with the given key
+void HashIndex::replacePosition(const size_t& hash, const int& oldPosition, const int& newPosition)
 {
-	for (int i = 0; i < size; i++)
+	assert(count > 0);
+
+	size_t mask = slots.getSize() - 1;
+	size_t j = hash & mask;
+	while (slots[int(j)].position != oldPosition)
 	{
-		if (A1[i] == key)
-			return A2[i];
+		assert(slots[int(j)].position != -1);
+		j = (j + 1) & mask;
 	}
 
-	assert(false);
+	slots[int(j)].position = newPosition;
 }
 
-template <class K, class V>
-K& Map<K, V>::keyAtIndex(const int& index) const
+void HashIndex::reserve(const int& positions)
 {
-	assert(index >= 0 && index < size);
+	int slotCount = slots.getSize() > 0 ? slots.getSize() : 16;
+	while (slotCount < 2 * positions)
+		slotCount *= 2;
 
-	return A1[index];
+	if (slotCount > slots.getSize())
+		rehash(slotCount);
 }
 
-template <class K, class V>
-V& Map<K, V>::valueAtIndex(const int& index) const
+void HashIndex::clear()
 {
-	assert(index >= 0 && index < size);
+	slots = SmarterArray<Slot>(slots.getResource());
+	count = 0;
+}
 
-	return A2[index];
+size_t HashIndex::getMemoryUsage() const
+{
+	return size_t(slots.getCapacity()) * sizeof(Slot);
 }
 
-template <class K, class V>
-void Map<K, V>::append(const K& key, const V& value)
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//A table of stable 32-bit handles for records kept densely at changing positions in other arrays. A handle packs
+//the number of the slot that tracks the record's position (low 24 bits) with the slot's generation (high 8 bits).
+//Freeing a slot bumps its generation, so a handle to a removed record stops resolving instead of silently
+//resolving to whichever record reuses the slot. A slot whose generation would wrap is retired for good instead of
+//being reused, so no handle ever comes back to life.
+class SlotMap
 {
-	K* temp1 = new K[size + 1];
-	V* temp2 = new V[size + 1];
+private:
+	SmarterArray<int> positionOfSlot; //The position each slot points at, -1 if the slot is free
+	SmarterArray<unsigned int> generationOfSlot;
+	SmarterArray<int> slotOfPosition; //The slot of the record at each position
+	SmarterArray<int> freeSlots;
 
-	for (int i = 0; i < size; i++)
+	static const int slotBits = 24;
+	static const unsigned int retiredGeneration = 1u << (32 - slotBits); //Matches no handle; the slot is never reused
+
+public:
+	SlotMap();
+
+	int getSize() const; //Return the number of live handles (the number of positions)
+	unsigned int insert(); //Issue a handle for a new record at the next position and return it
+	unsigned int getId(const int& position) const; //Assert the position is valid and then return the handle of its record
+	int find(const unsigned int& id) const; //Return the position of the record with the given handle, or -1 if it was removed
+	void swapRemove(const int& position); //Free the handle of the record at the position and move the handle of the last
+										//record into the position, mirroring SmarterArray::swapRemove
+	int getSlotCount() const; //Return the number of slots ever used, live or free
+	unsigned int getGeneration(const int& slot) const; //Assert the slot is valid and then return its generation
+													//(retiredGeneration once the slot has been used up)
+	bool restore(const unsigned int* generations, const int& slotCount, const unsigned int* ids, const int& count);
+						//Rebuild the table from saved slot generations and the handles of the records at positions 0..count-1.
+						//Return false (leaving the table empty) if the handles do not fit the generations.
+};
+
+SlotMap::SlotMap()
+{}
+
+int SlotMap::getSize() const
+{
+	return slotOfPosition.getSize();
+}
+
+unsigned int SlotMap::insert()
+{
+	int slot;
+	if (freeSlots.getSize() > 0)
 	{
-		temp1[i] = this->A1[i];
-		temp2[i] = this->A2[i];
+		slot = freeSlots[freeSlots.getSize() - 1];
+		freeSlots.remove(freeSlots.getSize() - 1);
 	}
-	temp1[size] = key;
-	temp2[size] = value;
-
-	if (size > 0)
+	else
 	{
-		delete[] this->A1;
-		delete[] this->A2;
+		slot = positionOfSlot.getSize();
+		assert(slot < (1 << slotBits));
+		positionOfSlot.append(-1);
+		generationOfSlot.append(0);
 	}
 
-	this->A1 = temp1;
-	this->A2 = temp2;
+	positionOfSlot[slot] = slotOfPosition.getSize();
+	slotOfPosition.append(slot);
 
-	size = size + 1;
+	return (generationOfSlot[slot] << slotBits) | unsigned(slot);
 }
 
-template <class K, class V>
-bool Map<K, V>::remove(const int& index)
+unsigned int SlotMap::getId(const int& position) const
 {
-	if (index >= 0 && index < size)
-	{
-		K* temp1 = new K[size - 1];
-		V* temp2 = new V[size - 1];
-
-		int i = 0;
-		for (; i < index; i++)
-		{
-			temp1[i] = A1[i];
-			temp2[i] = A2[i];
-		}
+	assert(position >= 0 && position < slotOfPosition.getSize());
 
-		for (int j = index + 1; j < size; j++, i++)
-		{
-			temp1[i] = A1[j];
-			temp2[i] = A2[j];
-		}
+	int slot = slotOfPosition[position];
+	return (generationOfSlot[slot] << slotBits) | unsigned(slot);
+}
 
-		delete[] A1;
-		delete[] A2;
+int SlotMap::find(const unsigned int& id) const
+{
+	int slot = int(id & ((1u << slotBits) - 1));
+	if (slot >= positionOfSlot.getSize() || generationOfSlot[slot] != (id >> slotBits))
+		return -1;
 
-		A1 = temp1;
-		A2 = temp2;
+	return positionOfSlot[slot];
+}
 
-		size = size - 1;
+void SlotMap::swapRemove(const int& position)
+{
+	assert(position >= 0 && position < slotOfPosition.getSize());
 
-		return true;
-	}
+	int slot = slotOfPosition[position];
+	positionOfSlot[slot] = -1;
+	generationOfSlot[slot]++;
+	if (generationOfSlot[slot] < retiredGeneration)
+		freeSlots.append(slot);
 
-	return false;
+	slotOfPosition.swapRemove(position);
+	if (position < slotOfPosition.getSize())
+		positionOfSlot[slotOfPosition[position]] = position;
 }
 
-template <class K, class V>
-ostream& operator << (ostream& out, const Map<K, V>& m)
+int SlotMap::getSlotCount() const
 {
-	if (m.size == 0)
-		out << "[Empty Map]" << endl;
+	return positionOfSlot.getSize();
+}
+
+unsigned int SlotMap::getGeneration(const int& slot) const
+{
+	assert(slot >= 0 && slot < positionOfSlot.getSize());
+
+	return generationOfSlot[slot];
+}
+
+bool SlotMap::restore(const unsigned int* generations, const int& slotCount, const unsigned int* ids, const int& count)
+{
+	*this = SlotMap();
+	if (slotCount < count || slotCount > (1 << slotBits))
+		return false;
+
+	positionOfSlot.reserve(slotCount);
+	generationOfSlot.reserve(slotCount);
+	for (int slot = 0; slot < slotCount; slot++)
+	{
+		positionOfSlot.append(-1);
+		if (generations[slot] > retiredGeneration)
+		{
+			*this = SlotMap();
+			return false;
+		}
+		generationOfSlot.append(generations[slot]);
+	}
+
+	slotOfPosition.reserve(count);
+	for (int position = 0; position < count; position++)
+	{
+		int slot = int(ids[position] & ((1u << slotBits) - 1));
+		if (slot >= slotCount || positionOfSlot[slot] != -1 || generationOfSlot[slot] != (ids[position] >> slotBits))
+		{
+			*this = SlotMap();
+			return false;
+		}
+
+		positionOfSlot[slot] = position;
+		slotOfPosition.append(slot);
+	}
+
+	for (int slot = slotCount - 1; slot >= 0; slot--)
+	{
+		if (positionOfSlot[slot] == -1 && generationOfSlot[slot] < retiredGeneration)
+			freeSlots.append(slot);
+	}
+
+	return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <class K, class V>
+class Map
+{
+private:
+	SmarterArray<K> A1; //The keys of the map, in insertion order
+	SmarterArray<V> A2; //The values of the map (Both A1 and A2 have the same size at any time by design)
+	HashIndex index; //Positions in A1 hashed by key. Small maps are scanned linearly, so the index is only
+					//populated while the map holds more than indexThreshold pairs.
+
+	static const int indexThreshold = 8;
+
+	static size_t hashKey(const K&);
+	void buildIndex(); //Populate the index from A1
+
+public:
+	//Constructors
+	Map();
+	explicit Map(pmr::memory_resource*); //An empty map that allocates from the given resource
+	Map(const Map<K, V>&); //Copy constructor. Deep copy.
+	Map(Map<K, V>&&) noexcept; //Move constructor. Take over the argument's memory and leave it empty.
+
+	//Assignment operators
+	Map<K, V>& operator = (const Map<K, V>&); //Assignment operator. Memory clean up and deep copy.
+	Map<K, V>& operator = (Map<K, V>&&) noexcept; //Move assignment operator. Memory clean up and take over the argument's memory.
+
+	//Destructor
+	~Map(); //Destructor.
+
+	//Getters, Setters, operators and other functions
+	int getSize() const; //Return the common size of the map.
+	int find(const K&) const; //Return the index of the element of the Keys array == the argument. Return -1 if not found.
+	int find(const V&) const; //Return the index of the first element of the Values array == the argument. Return -1 if not found.
+	K& operator[](const V&) const; //Assert the argument is found in the Values array and then return the key with the given value 
+	V& operator[](const K&) const; //Assert the argument is found in the Keys array and then return the value with the given key
+	const K& keyAtIndex(const int&) const; //Assert the index argument and then return the key at the given index
+	V& valueAtIndex(const int&) const; //Assert the index argument and then return the value at the given index
+	void setKeyAtIndex(const int&, const K&); //Assert the index argument and then replace the key at the given index
+	void reserve(const int&); //Make room for the given number of pairs without reallocating
+	size_t getMemoryUsage() const; //Return the number of bytes the calling object takes, including what it allocated
+	void append(const K&, const V&); //Append the key-value pair to the calling object
+	bool remove(const int&); //If the index argument is a valid index, then remove the key-value pair at the index argument
+							//from the calling object and return true. Otherwise return false. 
+
+	template <class K, class V>
+	friend ostream& operator << (ostream&, const Map<K, V>&);
+};
+
+template <class K, class V>
+size_t Map<K, V>::hashKey(const K& key)
+{
+	return hash<K>()(key);
+}
+
+template <class K, class V>
+void Map<K, V>::buildIndex()
+{
+	index.clear();
+	index.reserve(A1.getSize());
+	for (int i = 0; i < A1.getSize(); i++)
+		index.insert(hashKey(A1[i]), i);
+}
+
+template <class K, class V>
+Map<K, V>::Map()
+{}
+
+template <class K, class V>
+Map<K, V>::Map(pmr::memory_resource* resource) : A1(resource), A2(resource), index(resource)
+{}
+
+template <class K, class V>
+Map<K, V>::Map(const Map<K, V>& x) : A1(x.A1), A2(x.A2), index(x.index)
+{}
+
+template <class K, class V>
+Map<K, V>::Map(Map<K, V>&& x) noexcept : A1(std::move(x.A1)), A2(std::move(x.A2)), index(std::move(x.index))
+{}
+
+template <class K, class V>
+Map<K, V>& Map<K, V>::operator = (const Map<K, V>& x)
+{
+	// Check for self assignment, for example map1 = map1
+	if (this == &x)
+		return *this;
+
+	A1 = x.A1;
+	A2 = x.A2;
+	index = x.index;
+
+	return *this;
+}
+
+template <class K, class V>
+Map<K, V>& Map<K, V>::operator = (Map<K, V>&& x) noexcept
+{
+	// Check for self assignment, for example map1 = move(map1)
+	if (this == &x)
+		return *this;
+
+	A1 = std::move(x.A1);
+	A2 = std::move(x.A2);
+	index = std::move(x.index);
+
+	return *this;
+}
+
+template <class K, class V>
+Map<K, V>::~Map()
+{}
+
+template <class K, class V>
+int Map<K, V>::getSize() const
+{
+	return A1.getSize();
+}
+
+template <class K, class V>
+int Map<K, V>::find(const K& key) const
+{
+	if (A1.getSize() > indexThreshold)
+		return index.find(hashKey(key), [&](const int& i) { return A1[i] == key; });
+
+	for (int i = 0; i < A1.getSize(); i++)
+	{
+		if (A1[i] == key)
+			return i;
+	}
+
+	return -1;
+}
+
+template <class K, class V>
+int Map<K, V>::find(const V& value) const
+{
+	for (int i = 0; i < A2.getSize(); i++)
+	{
+		if (A2[i] == value)
+			return i;
+	}
+
+	return -1;
+}
+
+template <class K, class V>
+K& Map<K, V>::operator[](const V& value) const //Assert the argument is found in the Values array and then return the key with the given value 
+{
+	int i = find(value);
+	assert(i != -1);
+
+	return A1[i];
+}
+
+template <class K, class V>
+V& Map<K, V>::operator[](const K& key) const //Assert the argument is found in the Keys array and then return the value with the given key
+{
+	int i = find(key);
+	assert(i != -1);
+
+	return A2[i];
+}
+
+template <class K, class V>
+const K& Map<K, V>::keyAtIndex(const int& index) const
+{
+	assert(index >= 0 && index < A1.getSize());
+
+	return A1[index];
+}
+
+template <class K, class V>
+V& Map<K, V>::valueAtIndex(const int& index) const
+{
+	assert(index >= 0 && index < A2.getSize());
+
+	return A2[index];
+}
+
+template <class K, class V>
+void Map<K, V>::setKeyAtIndex(const int& index, const K& key)
+{
+	assert(index >= 0 && index < A1.getSize());
+
+	if (A1.getSize() > indexThreshold)
+	{
+		this->index.erase(hashKey(A1[index]), index);
+		this->index.insert(hashKey(key), index);
+	}
+
+	A1[index] = key;
+}
+
+template <class K, class V>
+void Map<K, V>::reserve(const int& n)
+{
+	A1.reserve(n);
+	A2.reserve(n);
+}
+
+template <class K, class V>
+size_t Map<K, V>::getMemoryUsage() const
+{
+	return sizeof(Map<K, V>) + size_t(A1.getCapacity()) * sizeof(K) + size_t(A2.getCapacity()) * sizeof(V) + index.getMemoryUsage();
+}
+
+template <class K, class V>
+void Map<K, V>::append(const K& key, const V& value)
+{
+	A1.append(key);
+	A2.append(value);
+
+	if (A1.getSize() == indexThreshold + 1)
+		buildIndex();
+	else if (A1.getSize() > indexThreshold)
+		index.insert(hashKey(key), A1.getSize() - 1);
+}
+
+template <class K, class V>
+bool Map<K, V>::remove(const int& index)
+{
+	if (index >= 0 && index < A1.getSize())
+	{
+		if (A1.getSize() == indexThreshold + 1)
+			this->index.clear();
+		else if (A1.getSize() > indexThreshold)
+		{
+			this->index.erase(hashKey(A1[index]), index);
+			this->index.shiftPositionsAfter(index);
+		}
+
+		A1.remove(index);
+		A2.remove(index);
+
+		return true;
+	}
+
+	return false;
+}
+
+template <class K, class V>
+ostream& operator << (ostream& out, const Map<K, V>& m)
+{
+	if (m.getSize() == 0)
+		out << "[Empty Map]\n";
 	else
 	{
-		for (int i = 0; i < m.size; i++)
-			out << m.A1[i] << ", " << m.A2[i] << endl;
+		for (int i = 0; i < m.getSize(); i++)
+			out << m.A1[i] << ", " << m.A2[i] << '\n';
+	}
+	return out;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//An array of fixed size chunks of 2^chunkBits elements that copies share until one of them is written. Copying the
+//array copies a pointer to its chunk directory, whatever its size; the first write to a copy afterwards copies the
+//directory (one pointer per chunk) and the chunk being written, and every chunk no copy writes stays shared. Elements
+//never move, so a pointer to one stays valid until the element is written or removed, and the elements of a chunk are
+//contiguous. Reads go through operator[], writes through modify, so a read never copies anything.
+//
+//Copies may be read and written from different threads, one thread per copy: a chunk or directory is only written in
+//place by a copy that holds the only reference to it.
+//
+//Chunks are allocated from a memory resource, the default resource unless one is given. Unlike a SmarterArray, a copy
+//allocates from the same resource as the original, since they share chunks anyway. Assigning a copy keeps the resource
+//of the left hand side. A shared chunk is freed by whichever copy lets go of it last, so the resource of an array whose
+//copies end on other threads must be thread safe.
+
+template <class T, int chunkBits>
+class CowArray
+{
+private:
+	//Chunks and directories remember the resource they came from, since a chunk shared by copies may outlive the
+	//array that allocated it
+	struct Chunk
+	{
+		atomic<int> references;
+		pmr::memory_resource* resource;
+		T items[1 << chunkBits];
+	};
+
+	struct Directory
+	{
+		atomic<int> references;
+		pmr::memory_resource* resource;
+		SmarterArray<Chunk*> chunks;
+
+		explicit Directory(pmr::memory_resource*);
+	};
+
+	Directory* directory; //Shared by copies. nullptr until the first append.
+	Chunk* const* table; //The chunk pointers of the directory, cached to save a load on every read
+	int size;
+	pmr::memory_resource* resource; //Where new chunks and directories are allocated from. Not owned.
+
+	void updateTable(); //Call whenever the directory or its chunk pointers move
+	Chunk* newChunk() const; //Allocate a chunk with one reference
+	Directory* newDirectory() const; //Allocate a directory with one reference and no chunks
+	static void release(Chunk*);
+	static void release(Directory*);
+	void detachDirectory(); //Make sure the directory is not shared, so its chunk pointers can be replaced
+	Chunk* detachChunk(const int& chunk); //Make sure the chunk is not shared and return it
+
+public:
+	static const int chunkSize = 1 << chunkBits;
+
+	CowArray();
+	explicit CowArray(pmr::memory_resource*); //An empty array whose chunks are allocated from the given resource
+	CowArray(const CowArray<T, chunkBits>&); //Share the chunks of the argument. O(1). The copy allocates from the same
+											//resource as the argument.
+	CowArray(CowArray<T, chunkBits>&&) noexcept;
+	CowArray<T, chunkBits>& operator = (const CowArray<T, chunkBits>&);
+	CowArray<T, chunkBits>& operator = (CowArray<T, chunkBits>&&) noexcept;
+	~CowArray();
+
+	int getSize() const;
+	int getChunkCount() const;
+	const T* getChunk(const int& chunk) const; //Return the elements of a chunk. The last one may be partly used.
+	size_t getMemoryUsage() const; //Return the number of bytes the calling object takes, counting shared chunks in full
+	const T& operator[](const int&) const;
+	T& modify(const int&); //Return the element at the index for writing, copying whatever it shares with other copies
+	void append(const T&);
+	void swapRemove(const int&); //Move the last element into the index and remove the last element
+	void reserve(const int&); //Make room in the directory for the given number of elements
+	pmr::memory_resource* getResource() const; //Return the resource new chunks are allocated from
+	void setResource(pmr::memory_resource*); //Allocate new chunks from the given resource. Chunks already allocated are
+											//freed to the resource they came from.
+};
+
+template <class T, int chunkBits>
+CowArray<T, chunkBits>::Directory::Directory(pmr::memory_resource* resource) : resource(resource), chunks(resource)
+{
+	references = 1;
+}
+
+template <class T, int chunkBits>
+typename CowArray<T, chunkBits>::Chunk* CowArray<T, chunkBits>::newChunk() const
+{
+	Chunk* chunk = new (resource->allocate(sizeof(Chunk), alignof(Chunk))) Chunk;
+	chunk->references = 1;
+	chunk->resource = resource;
+	return chunk;
+}
+
+template <class T, int chunkBits>
+typename CowArray<T, chunkBits>::Directory* CowArray<T, chunkBits>::newDirectory() const
+{
+	return new (resource->allocate(sizeof(Directory), alignof(Directory))) Directory(resource);
+}
+
+template <class T, int chunkBits>
+void CowArray<T, chunkBits>::release(Chunk* chunk)
+{
+	if (chunk->references.fetch_sub(1, memory_order_acq_rel) != 1)
+		return;
+
+	pmr::memory_resource* resource = chunk->resource;
+	chunk->~Chunk();
+	resource->deallocate(chunk, sizeof(Chunk), alignof(Chunk));
+}
+
+template <class T, int chunkBits>
+void CowArray<T, chunkBits>::release(Directory* directory)
+{
+	if (directory == nullptr || directory->references.fetch_sub(1, memory_order_acq_rel) != 1)
+		return;
+
+	for (int i = 0; i < directory->chunks.getSize(); i++)
+		release(directory->chunks[i]);
+	pmr::memory_resource* resource = directory->resource;
+	directory->~Directory();
+	resource->deallocate(directory, sizeof(Directory), alignof(Directory));
+}
+
+template <class T, int chunkBits>
+void CowArray<T, chunkBits>::updateTable()
+{
+	table = (directory == nullptr || directory->chunks.getSize() == 0) ? nullptr : &directory->chunks[0];
+}
+
+template <class T, int chunkBits>
+void CowArray<T, chunkBits>::detachDirectory()
+{
+	if (directory == nullptr)
+	{
+		directory = newDirectory();
+		updateTable();
+		return;
+	}
+	if (directory->references.load(memory_order_acquire) == 1)
+		return;
+
+	Directory* copy = newDirectory();
+	copy->chunks.reserve(directory->chunks.getSize());
+	for (int i = 0; i < directory->chunks.getSize(); i++)
+	{
+		directory->chunks[i]->references.fetch_add(1, memory_order_relaxed);
+		copy->chunks.append(directory->chunks[i]);
+	}
+	release(directory);
+	directory = copy;
+	updateTable();
+}
+
+template <class T, int chunkBits>
+typename CowArray<T, chunkBits>::Chunk* CowArray<T, chunkBits>::detachChunk(const int& chunk)
+{
+	detachDirectory();
+	Chunk*& c = directory->chunks[chunk];
+	if (c->references.load(memory_order_acquire) != 1)
+	{
+		Chunk* copy = newChunk();
+		int used = min(size - (chunk << chunkBits), int(chunkSize));
+		for (int i = 0; i < used; i++)
+			copy->items[i] = c->items[i];
+		release(c);
+		c = copy;
+	}
+	return c;
+}
+
+template <class T, int chunkBits>
+CowArray<T, chunkBits>::CowArray()
+{
+	directory = nullptr;
+	table = nullptr;
+	size = 0;
+	resource = pmr::get_default_resource();
+}
+
+template <class T, int chunkBits>
+CowArray<T, chunkBits>::CowArray(pmr::memory_resource* resource)
+{
+	directory = nullptr;
+	table = nullptr;
+	size = 0;
+	this->resource = resource;
+}
+
+template <class T, int chunkBits>
+CowArray<T, chunkBits>::CowArray(const CowArray<T, chunkBits>& a)
+{
+	directory = a.directory;
+	table = a.table;
+	size = a.size;
+	resource = a.resource;
+	if (directory != nullptr)
+		directory->references.fetch_add(1, memory_order_relaxed);
+}
+
+template <class T, int chunkBits>
+CowArray<T, chunkBits>::CowArray(CowArray<T, chunkBits>&& a) noexcept
+{
+	directory = a.directory;
+	table = a.table;
+	size = a.size;
+	resource = a.resource;
+	a.directory = nullptr;
+	a.table = nullptr;
+	a.size = 0;
+}
+
+template <class T, int chunkBits>
+CowArray<T, chunkBits>& CowArray<T, chunkBits>::operator = (const CowArray<T, chunkBits>& a)
+{
+	if (a.directory != nullptr)
+		a.directory->references.fetch_add(1, memory_order_relaxed);
+	release(directory);
+	directory = a.directory;
+	table = a.table;
+	size = a.size;
+	return *this;
+}
+
+template <class T, int chunkBits>
+CowArray<T, chunkBits>& CowArray<T, chunkBits>::operator = (CowArray<T, chunkBits>&& a) noexcept
+{
+	if (this != &a)
+	{
+		release(directory);
+		directory = a.directory;
+		table = a.table;
+		size = a.size;
+		resource = a.resource;
+		a.directory = nullptr;
+		a.table = nullptr;
+		a.size = 0;
+	}
+	return *this;
+}
+
+template <class T, int chunkBits>
+CowArray<T, chunkBits>::~CowArray()
+{
+	release(directory);
+}
+
+template <class T, int chunkBits>
+int CowArray<T, chunkBits>::getSize() const
+{
+	return size;
+}
+
+template <class T, int chunkBits>
+int CowArray<T, chunkBits>::getChunkCount() const
+{
+	return directory == nullptr ? 0 : directory->chunks.getSize();
+}
+
+template <class T, int chunkBits>
+const T* CowArray<T, chunkBits>::getChunk(const int& chunk) const
+{
+	assert(chunk >= 0 && chunk < getChunkCount());
+
+	return table[chunk]->items;
+}
+
+template <class T, int chunkBits>
+size_t CowArray<T, chunkBits>::getMemoryUsage() const
+{
+	if (directory == nullptr)
+		return sizeof(CowArray<T, chunkBits>);
+
+	return sizeof(CowArray<T, chunkBits>) + sizeof(Directory) + sizeof(Chunk*) * size_t(directory->chunks.getCapacity()) +
+		sizeof(Chunk) * size_t(directory->chunks.getSize());
+}
+
+template <class T, int chunkBits>
+const T& CowArray<T, chunkBits>::operator[](const int& index) const
+{
+	assert(index >= 0 && index < size);
+
+	return table[index >> chunkBits]->items[index & (chunkSize - 1)];
+}
+
+template <class T, int chunkBits>
+T& CowArray<T, chunkBits>::modify(const int& index)
+{
+	assert(index >= 0 && index < size);
+
+	return detachChunk(index >> chunkBits)->items[index & (chunkSize - 1)];
+}
+
+template <class T, int chunkBits>
+void CowArray<T, chunkBits>::append(const T& e)
+{
+	//e may be an element of the calling object, which the detaching below could release
+	T copy = e;
+	detachDirectory();
+	if (size == directory->chunks.getSize() << chunkBits)
+	{
+		directory->chunks.append(newChunk());
+		updateTable();
+	}
+	detachChunk(size >> chunkBits)->items[size & (chunkSize - 1)] = std::move(copy);
+	size++;
+}
+
+template <class T, int chunkBits>
+void CowArray<T, chunkBits>::swapRemove(const int& index)
+{
+	assert(index >= 0 && index < size);
+
+	if (index != size - 1)
+	{
+		T last = (*this)[size - 1];
+		modify(index) = std::move(last);
+	}
+	size--;
+
+	//Drop the last chunk once nothing is left in it
+	if (size == (directory->chunks.getSize() - 1) << chunkBits)
+	{
+		detachDirectory();
+		release(directory->chunks[directory->chunks.getSize() - 1]);
+		directory->chunks.remove(directory->chunks.getSize() - 1);
+		updateTable();
+	}
+}
+
+template <class T, int chunkBits>
+void CowArray<T, chunkBits>::reserve(const int& count)
+{
+	detachDirectory();
+	directory->chunks.reserve((count + chunkSize - 1) >> chunkBits);
+	updateTable();
+}
+
+template <class T, int chunkBits>
+pmr::memory_resource* CowArray<T, chunkBits>::getResource() const
+{
+	return resource;
+}
+
+template <class T, int chunkBits>
+void CowArray<T, chunkBits>::setResource(pmr::memory_resource* resource)
+{
+	this->resource = resource;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//Interned names. Every distinct first name, last name and course name is stored once in a bump-allocated arena and is
+//referred to by a 32-bit symbol, so comparing two names is comparing two integers. Names are never freed and nothing
+//in the pool ever moves, so the characters of a symbol stay valid for the life of the program and can be read without
+//locking while other threads intern new names.
+
+typedef uint32_t Symbol;
+
+class NamePool
+{
+private:
+	struct Entry
+	{
+		const char* data;
+		uint32_t length;
+		uint32_t hash; //hashName of the name
+	};
+
+	static const int arenaBlockSize = 1 << 16; //Bytes per arena block. A longer name gets a block of its own.
+	static const int entryBlockBits = 16; //Each entry block holds 2^entryBlockBits entries
+	static const int maxEntryBlocks = 1 << 12; //So the pool holds at most 2^28 names
+
+	SmarterArray<char*> arenaBlocks; //Every block allocated for names, so they can be freed
+	char* arenaNext; //Where the next name is copied to in the current block
+	int arenaLeft; //Bytes left in the current block
+	size_t arenaBytes; //Bytes allocated for all arena blocks
+	Entry* entryBlocks[maxEntryBlocks]; //The name of each symbol. Blocks are allocated as needed and never move.
+	atomic<uint32_t> count; //The number of symbols. Published after the entry of a new symbol is written.
+	HashIndex index; //Symbols hashed by their names
+	mutable shared_mutex lock; //Guards everything above except reads of existing entries
+
+	int findLocked(const string_view& name, const uint32_t& hash) const; //Return the symbol of the name, or -1
+
+public:
+	NamePool();
+	NamePool(const NamePool&) = delete;
+	NamePool& operator = (const NamePool&) = delete;
+	~NamePool();
+
+	static uint32_t hashName(const string_view& name);
+	Symbol intern(const string_view& name); //Return the symbol of the name, adding the name to the pool if it is new
+	bool find(const string_view& name, Symbol& symbol) const; //If the name is in the pool, set symbol to it and return true.
+															//Otherwise return false without adding it.
+	string_view getName(const Symbol&) const; //Assert the symbol is valid and then return its name
+	uint32_t getHash(const Symbol&) const; //Assert the symbol is valid and then return hashName of its name
+	int getSize() const; //Return the number of distinct names in the pool
+	size_t getMemoryUsage() const; //Return the number of bytes allocated by the pool
+};
+
+NamePool::NamePool()
+{
+	arenaNext = nullptr;
+	arenaLeft = 0;
+	arenaBytes = 0;
+	for (int i = 0; i < maxEntryBlocks; i++)
+		entryBlocks[i] = nullptr;
+	count = 0;
+}
+
+NamePool::~NamePool()
+{
+	for (int i = 0; i < arenaBlocks.getSize(); i++)
+		delete[] arenaBlocks[i];
+	for (int i = 0; i < maxEntryBlocks; i++)
+		delete[] entryBlocks[i];
+}
+
+int NamePool::findLocked(const string_view& name, const uint32_t& hash) const
+{
+	return index.find(hash, [&](const int& i) { return getName(Symbol(i)) == name; });
+}
+
+uint32_t NamePool::hashName(const string_view& name)
+{
+	return uint32_t(hash<string_view>()(name));
+}
+
+Symbol NamePool::intern(const string_view& name)
+{
+	uint32_t h = hashName(name);
+	{
+		shared_lock<shared_mutex> reading(lock);
+		int i = findLocked(name, h);
+		if (i != -1)
+			return Symbol(i);
+	}
+
+	unique_lock<shared_mutex> writing(lock);
+	int i = findLocked(name, h); //Another thread may have added the name in between
+	if (i != -1)
+		return Symbol(i);
+
+	uint32_t symbol = count.load(memory_order_relaxed);
+	assert(symbol < uint32_t(maxEntryBlocks) << entryBlockBits);
+	assert(name.size() <= size_t(INT32_MAX));
+
+	char* data = nullptr;
+	int length = int(name.size());
+	if (length > arenaLeft)
+	{
+		int blockSize = length > arenaBlockSize ? length : arenaBlockSize;
+		char* block = new char[blockSize];
+		arenaBlocks.append(block);
+		arenaBytes += blockSize;
+		if (blockSize == arenaBlockSize) //An oversized block holds just this name and the current block stays current
+		{
+			arenaNext = block;
+			arenaLeft = blockSize;
+		}
+		else
+			data = block;
+	}
+	if (data == nullptr)
+	{
+		data = arenaNext;
+		arenaNext += length;
+		arenaLeft -= length;
+	}
+	if (length > 0)
+		memcpy(data, name.data(), length);
+
+	Entry*& entries = entryBlocks[symbol >> entryBlockBits];
+	if (entries == nullptr)
+		entries = new Entry[size_t(1) << entryBlockBits];
+	entries[symbol & ((1u << entryBlockBits) - 1)] = Entry{ data, uint32_t(length), h };
+	index.insert(h, int(symbol));
+	count.store(symbol + 1, memory_order_release);
+
+	return symbol;
+}
+
+bool NamePool::find(const string_view& name, Symbol& symbol) const
+{
+	shared_lock<shared_mutex> reading(lock);
+	int i = findLocked(name, hashName(name));
+	if (i == -1)
+		return false;
+
+	symbol = Symbol(i);
+	return true;
+}
+
+string_view NamePool::getName(const Symbol& symbol) const
+{
+	assert(symbol < count.load(memory_order_acquire));
+
+	const Entry& e = entryBlocks[symbol >> entryBlockBits][symbol & ((1u << entryBlockBits) - 1)];
+	return string_view(e.data, e.length);
+}
+
+uint32_t NamePool::getHash(const Symbol& symbol) const
+{
+	assert(symbol < count.load(memory_order_acquire));
+
+	return entryBlocks[symbol >> entryBlockBits][symbol & ((1u << entryBlockBits) - 1)].hash;
+}
+
+int NamePool::getSize() const
+{
+	return int(count.load(memory_order_acquire));
+}
+
+size_t NamePool::getMemoryUsage() const
+{
+	shared_lock<shared_mutex> reading(lock);
+	size_t entryBlockCount = (count.load(memory_order_relaxed) + (1u << entryBlockBits) - 1) >> entryBlockBits;
+	return sizeof(NamePool) + arenaBytes + entryBlockCount * (sizeof(Entry) << entryBlockBits) +
+		size_t(arenaBlocks.getCapacity()) * sizeof(char*) + index.getMemoryUsage();
+}
+
+NamePool& namePool()
+{
+	//The pool every Student and Course interns its names into
+	static NamePool pool;
+	return pool;
+}
+
+Symbol noneSymbol()
+{
+	//The name of a default constructed Student or Course, interned once rather than under the pool's lock on every
+	//construction
+	static const Symbol none = namePool().intern("None");
+	return none;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class Course
+{
+private:
+	Symbol name; //Interned in namePool()
+	int creditHours;
+public:
+	Course();
+	Course(const string_view&, const int&);
+	Course(const Symbol&, const int&);
+	string_view getCourseName() const;
+	Symbol getCourseNameSymbol() const;
+	int getCreditHours() const;
+	void setCourseName(const string_view&);
+	void setCreditHours(const int&);
+	bool operator == (const Course&) const; //Return true if course names are equal and credit hours are also equal.
+	friend istream& operator >> (istream&, Course&);
+	friend ostream& operator << (ostream&, const Course&);
+};
+
+Course::Course()
+{
+	name = noneSymbol();
+	creditHours = 0;
+}
+
+Course::Course(const string_view& name, const int& hours)
+{
+	this->name = namePool().intern(name);
+	creditHours = hours;
+}
+
+Course::Course(const Symbol& name, const int& hours)
+{
+	this->name = name;
+	creditHours = hours;
+}
+
+string_view Course::getCourseName() const
+{
+	return namePool().getName(name);
+}
+
+Symbol Course::getCourseNameSymbol() const
+{
+	return name;
+}
+
+int Course::getCreditHours() const
+{
+	return creditHours;
+}
+
+void Course::setCourseName(const string_view& name)
+{
+	this->name = namePool().intern(name);
+}
+
+void Course::setCreditHours(const int& hours)
+{
+	creditHours = hours;
+}
+
+bool Course::operator == (const Course& c) const
+{
+	if (name == c.name && creditHours == c.creditHours)
+		return true;
+
+	return false;
+}
+
+istream& operator >> (istream& in, Course& c)
+{
+	string name;
+	cout << "Please input the name of the course: ";
+	in >> name;
+	c.setCourseName(name);
+
+	cout << "Please input the credit hours of the course: ";
+	in >> c.creditHours;
+
+	return in;
+}
+
+ostream& operator << (ostream& out, const Course& c)
+{
+	out << "Course Name = " << c.getCourseName() << ", Credit Hours = " << c.creditHours;
+	return out;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct Date
+{
+	int d, m, y;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class Student
+{
+private:
+	Symbol fn, ln; //first name and last name, interned in namePool()
+	Date dob;
+public:
+	Student();
+	Student(const string_view& firstName, const string_view& lastName, const Date&);
+	Student(const Symbol& firstName, const Symbol& lastName, const Date&);
+	string_view getFirstName() const;
+	string_view getLastName() const;
+	Symbol getFirstNameSymbol() const;
+	Symbol getLastNameSymbol() const;
+	Date getDob() const;
+	void setFirstName(const string_view&);
+	void setLastName(const string_view&);
+	void setDob(const Date&);
+	bool operator == (const Student&) const; //Return true if all the first names, last names, and date of births are equal
+	friend istream& operator >> (istream&, Student&);
+	friend ostream& operator << (ostream&, const Student&);
+};
+
+Student::Student()
+{
+	fn = noneSymbol();
+	ln = fn;
+	dob.y = 0;
+	dob.m = 0;
+	dob.d = 0;
+}
+
+Student::Student(const string_view& firstName, const string_view& lastName, const Date& birthDate) : dob(birthDate)
+{
+	fn = namePool().intern(firstName);
+	ln = namePool().intern(lastName);
+}
+
+Student::Student(const Symbol& firstName, const Symbol& lastName, const Date& birthDate) : fn(firstName), ln(lastName), dob(birthDate) {}
+
+string_view Student::getFirstName() const
+{
+	return namePool().getName(fn);
+}
+
+string_view Student::getLastName() const
+{
+	return namePool().getName(ln);
+}
+
+Symbol Student::getFirstNameSymbol() const
+{
+	return fn;
+}
+
+Symbol Student::getLastNameSymbol() const
+{
+	return ln;
+}
+
+Date Student::getDob() const
+{
+	return dob;
+}
+
+void Student::setFirstName(const string_view& firstName)
+{
+	fn = namePool().intern(firstName);
+}
+
+void Student::setLastName(const string_view& lastName)
+{
+	ln = namePool().intern(lastName);
+}
+
+void Student::setDob(const Date& birthDate)
+{
+	dob = birthDate;
+}
+
+bool Student::operator == (const Student& s) const
+{
+	if ((fn == s.fn) && (ln == s.ln) && (dob.m == s.dob.m) && (dob.d == s.dob.d) && (dob.y == s.dob.y))
+		return true;
+
+	return false;
+}
+
+istream& operator >> (istream& in, Student& s)
+{
+	string name;
+	cout << "Please enter your first name: ";
+	in >> name;
+	s.setFirstName(name);
+
+	cout << "Please enter your last name: ";
+	in >> name;
+	s.setLastName(name);
+
+	cout << "Please enter your date of birth: " << endl;
+	cout << "\tMonth: ";
+	in >> s.dob.m;
+	cout << "\tDay: ";
+	in >> s.dob.d;
+	cout << "\tYear: ";
+	in >> s.dob.y;
+
+	return in;
+}
+
+ostream& operator << (ostream& out, const Student& s)
+{
+	out << "Full Name = " << s.getFirstName() << " " << s.getLastName() << ": ";
+	out << "DOB (d-m-y) = " << s.dob.d << "-" << s.dob.m << "-" << s.dob.y;
+	return out;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+typedef Map<int, char> StudentMap;
+typedef unsigned int StudentId; //A handle to a student that stays valid while other students are registered or removed
+typedef unsigned int CourseId; //A handle to a course that stays valid while other courses are offered or removed
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//The enrolments of every student, packed into one array. An enrolment is a single word: the course index in the high
+//24 bits and the letter grade in the low 8. Each student owns a segment of the array in enrolment order, with room for
+//at least segmentCapacity enrolments once it has any. A student that outgrows its segment moves to one twice the size
+//at the end of the array, and once less than half of the array is in use it is compacted back into student order.
+//A pass over all students is then a pass over contiguous memory.
+//
+//The array is a CowArray, so copying a store is O(1). A segment never straddles two chunks of it (the rest of a chunk
+//too small for the next segment is left as a hole), which keeps every student's enrolments contiguous and caps them
+//at maxEnrolmentsPerStudent.
+//
+//A second array laid out the same way holds each enrolment's roster slot: the student's position in the course's
+//roster, so the owner of the rosters can take a student out of one without searching it.
+
+class EnrolmentStore
+{
+private:
+	static const int enrolmentChunkBits = 14;
+	static const int segmentChunkBits = 12;
+
+	CowArray<uint32_t, enrolmentChunkBits> enrolments; //The segments of all students, with holes left behind by moved or
+														//removed segments and at the ends of chunks
+	struct Segment
+	{
+		uint32_t offset; //Where the segment starts
+		uint32_t count; //How many enrolments the student has
+		uint32_t capacity; //How many enrolments the segment can hold
+	};
+
+	CowArray<uint32_t, enrolmentChunkBits> rosterSlots; //The roster slot of each enrolment, at the enrolment's offset
+	CowArray<Segment, segmentChunkBits> segments; //The segment of each student, so finding its enrolments is one lookup
+	int usedSlots; //The total capacity of all segments. The rest of the array is holes.
+
+	static const int segmentCapacity = 8;
+
+	static void padForSegment(CowArray<uint32_t, enrolmentChunkBits>& to, const uint32_t& capacity); //Pad the array to
+																								//the next chunk if a
+																								//segment would not fit
+	void moveSegment(const int& student, const uint32_t& capacity); //Move a student's segment to a new one at the end
+	void compact(); //Rewrite the array with the segments in student order and no holes but those at the ends of chunks
+
+public:
+	static const int maxCourses = 1 << 24; //Course indices must be below this to fit in an enrolment
+	static const int maxEnrolmentsPerStudent = 1 << enrolmentChunkBits;
+
+	EnrolmentStore();
+	explicit EnrolmentStore(pmr::memory_resource*); //An empty store allocated from the given resource
+
+	static uint32_t pack(const int& courseIndex, const char& letterGrade);
+	static int getCourse(const uint32_t& enrolment);
+	static char getGrade(const uint32_t& enrolment);
+
+	int getSize() const; //Return the number of students
+	void addStudent(const int& capacity); //Add a student with no enrolments and room for the given number of them
+	void swapRemoveStudent(const int& student); //Remove a student. The last student moves into its index.
+	void reserve(const int& students, const int& enrolments); //Make room for the given numbers of students and enrolments
+	void reserveEnrolments(const int& count); //Make room for count more enrolments, counting the segment moves they cause
+	size_t getMemoryUsage() const; //Return the number of bytes allocated
+	pmr::memory_resource* getResource() const;
+	void setResource(pmr::memory_resource*); //Allocate from the given resource from now on. A compaction moves every
+											//enrolment there.
+
+	int getCount(const int& student) const; //Return the number of enrolments of a student
+	const uint32_t* getEnrolments(const int& student) const; //Return the enrolments of a student, in enrolment order.
+															//Valid until the next change to the store.
+	int find(const int& student, const int& courseIndex) const; //Return the position of the course among the student's
+																//enrolments, or -1 if the student is not enrolled in it
+	template <class F>
+	void forEachStudent(const int& begin, const int& end, const F& f) const; //Call f(student, enrolments, count) for the
+																			//students in [begin, end) in order. Faster
+																			//than getEnrolments on every student.
+	int getCourse(const int& student, const int& position) const;
+	char getGrade(const int& student, const int& position) const;
+	int getRosterSlot(const int& student, const int& position) const;
+	void append(const int& student, const int& courseIndex, const char& letterGrade, const int& rosterSlot); //The student
+																					//must have fewer than
+																					//maxEnrolmentsPerStudent enrolments
+	void remove(const int& student, const int& position); //The later enrolments of the student move up one position
+	void assign(const int& student, const uint32_t* enrolments, const uint32_t* rosterSlots, const int& count); //Replace
+																					//all enrolments of a student,
+																					//moving its segment at most once
+	void setGrade(const int& student, const int& position, const char& letterGrade);
+	void setCourse(const int& student, const int& position, const int& courseIndex);
+	void setRosterSlot(const int& student, const int& position, const int& rosterSlot);
+};
+
+EnrolmentStore::EnrolmentStore()
+{
+	usedSlots = 0;
+}
+
+EnrolmentStore::EnrolmentStore(pmr::memory_resource* resource) : enrolments(resource), rosterSlots(resource), segments(resource)
+{
+	usedSlots = 0;
+}
+
+uint32_t EnrolmentStore::pack(const int& courseIndex, const char& letterGrade)
+{
+	assert(courseIndex >= 0 && courseIndex < maxCourses);
+
+	return (uint32_t(courseIndex) << 8) | uint8_t(letterGrade);
+}
+
+int EnrolmentStore::getCourse(const uint32_t& enrolment)
+{
+	return int(enrolment >> 8);
+}
+
+char EnrolmentStore::getGrade(const uint32_t& enrolment)
+{
+	return char(enrolment & 0xff);
+}
+
+void EnrolmentStore::padForSegment(CowArray<uint32_t, enrolmentChunkBits>& to, const uint32_t& capacity)
+{
+	assert(capacity <= uint32_t(maxEnrolmentsPerStudent));
+
+	const uint32_t chunkSize = uint32_t(maxEnrolmentsPerStudent);
+	if (uint32_t(to.getSize()) % chunkSize + capacity > chunkSize)
+	{
+		while (uint32_t(to.getSize()) % chunkSize != 0)
+			to.append(0);
+	}
+}
+
+void EnrolmentStore::moveSegment(const int& student, const uint32_t& capacity)
+{
+	//The two arrays always have the same size, so they are padded alike
+	padForSegment(enrolments, capacity);
+	padForSegment(rosterSlots, capacity);
+	assert(size_t(enrolments.getSize()) + capacity <= size_t(INT32_MAX));
+
+	uint32_t offset = uint32_t(enrolments.getSize()), count = segments[student].count;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		enrolments.append(enrolments[int(segments[student].offset + i)]);
+		rosterSlots.append(rosterSlots[int(segments[student].offset + i)]);
+	}
+	for (uint32_t i = count; i < capacity; i++)
+	{
+		enrolments.append(0);
+		rosterSlots.append(0);
+	}
+
+	usedSlots += int(capacity) - int(segments[student].capacity);
+	segments.modify(student).offset = offset;
+	segments.modify(student).capacity = capacity;
+
+	if (usedSlots < enrolments.getSize() / 2)
+		compact();
+}
+
+void EnrolmentStore::compact()
+{
+	CowArray<uint32_t, enrolmentChunkBits> packed(enrolments.getResource()), packedSlots(rosterSlots.getResource());
+	packed.reserve(usedSlots);
+	packedSlots.reserve(usedSlots);
+	for (int i = 0; i < getSize(); i++)
+	{
+		uint32_t offset = segments[i].offset;
+		padForSegment(packed, segments[i].capacity);
+		padForSegment(packedSlots, segments[i].capacity);
+		segments.modify(i).offset = uint32_t(packed.getSize());
+		for (uint32_t j = 0; j < segments[i].capacity; j++)
+		{
+			packed.append(enrolments[int(offset + j)]);
+			packedSlots.append(rosterSlots[int(offset + j)]);
+		}
+	}
+	enrolments = std::move(packed);
+	rosterSlots = std::move(packedSlots);
+}
+
+int EnrolmentStore::getSize() const
+{
+	return segments.getSize();
+}
+
+void EnrolmentStore::addStudent(const int& capacity)
+{
+	assert(capacity >= 0 && capacity <= maxEnrolmentsPerStudent);
+
+	segments.append(Segment{ uint32_t(enrolments.getSize()), 0, 0 });
+	if (capacity > 0)
+		moveSegment(getSize() - 1, uint32_t(capacity));
+}
+
+void EnrolmentStore::swapRemoveStudent(const int& student)
+{
+	assert(student >= 0 && student < getSize());
+
+	usedSlots -= int(segments[student].capacity);
+	segments.swapRemove(student);
+
+	if (usedSlots < enrolments.getSize() / 2)
+		compact();
+}
+
+void EnrolmentStore::reserve(const int& students, const int& enrolments)
+{
+	segments.reserve(students);
+	this->enrolments.reserve(enrolments);
+	rosterSlots.reserve(enrolments);
+}
+
+void EnrolmentStore::reserveEnrolments(const int& count)
+{
+	//An enrolment that fills its segment moves the segment to the end of the array with at least twice the capacity,
+	//so each one appends at most segmentCapacity slots on average
+	enrolments.reserve(enrolments.getSize() + count * segmentCapacity);
+	rosterSlots.reserve(rosterSlots.getSize() + count * segmentCapacity);
+}
+
+size_t EnrolmentStore::getMemoryUsage() const
+{
+	return sizeof(EnrolmentStore) + enrolments.getMemoryUsage() + rosterSlots.getMemoryUsage() + segments.getMemoryUsage();
+}
+
+pmr::memory_resource* EnrolmentStore::getResource() const
+{
+	return enrolments.getResource();
+}
+
+void EnrolmentStore::setResource(pmr::memory_resource* resource)
+{
+	enrolments.setResource(resource);
+	rosterSlots.setResource(resource);
+	segments.setResource(resource);
+}
+
+int EnrolmentStore::getCount(const int& student) const
+{
+	return int(segments[student].count);
+}
+
+const uint32_t* EnrolmentStore::getEnrolments(const int& student) const
+{
+	const Segment& segment = segments[student];
+	if (segment.count == 0)
+		return nullptr;
+	return &enrolments[int(segment.offset)];
+}
+
+int EnrolmentStore::find(const int& student, const int& courseIndex) const
+{
+	const uint32_t* e = getEnrolments(student);
+	int count = getCount(student);
+	for (int i = 0; i < count; i++)
+	{
+		if (getCourse(e[i]) == courseIndex)
+			return i;
+	}
+
+	return -1;
+}
+
+int EnrolmentStore::getCourse(const int& student, const int& position) const
+{
+	assert(position >= 0 && position < getCount(student));
+
+	return getCourse(enrolments[int(segments[student].offset) + position]);
+}
+
+char EnrolmentStore::getGrade(const int& student, const int& position) const
+{
+	assert(position >= 0 && position < getCount(student));
+
+	return getGrade(enrolments[int(segments[student].offset) + position]);
+}
+
+int EnrolmentStore::getRosterSlot(const int& student, const int& position) const
+{
+	assert(position >= 0 && position < getCount(student));
+
+	return int(rosterSlots[int(segments[student].offset) + position]);
+}
+
+void EnrolmentStore::append(const int& student, const int& courseIndex, const char& letterGrade, const int& rosterSlot)
+{
+	assert(student >= 0 && student < getSize() && getCount(student) < maxEnrolmentsPerStudent);
+
+	if (segments[student].count == segments[student].capacity)
+		moveSegment(student, segments[student].capacity < uint32_t(segmentCapacity) ? uint32_t(segmentCapacity) :
+			min(2 * segments[student].capacity, uint32_t(maxEnrolmentsPerStudent)));
+
+	enrolments.modify(int(segments[student].offset + segments[student].count)) = pack(courseIndex, letterGrade);
+	rosterSlots.modify(int(segments[student].offset + segments[student].count)) = uint32_t(rosterSlot);
+	segments.modify(student).count++;
+}
+
+void EnrolmentStore::remove(const int& student, const int& position)
+{
+	assert(position >= 0 && position < getCount(student));
+
+	//The segment lies within one chunk, so it can be shifted through a single pointer
+	int offset = int(segments[student].offset), count = getCount(student);
+	uint32_t* e = &enrolments.modify(offset);
+	uint32_t* r = &rosterSlots.modify(offset);
+	for (int i = position; i < count - 1; i++)
+	{
+		e[i] = e[i + 1];
+		r[i] = r[i + 1];
+	}
+	segments.modify(student).count--;
+}
+
+void EnrolmentStore::assign(const int& student, const uint32_t* enrolments, const uint32_t* rosterSlots, const int& count)
+{
+	assert(student >= 0 && student < getSize() && count >= 0 && count <= maxEnrolmentsPerStudent);
+
+	if (uint32_t(count) > segments[student].capacity)
+	{
+		uint32_t capacity = max(uint32_t(segmentCapacity), 2 * segments[student].capacity);
+		while (capacity < uint32_t(count))
+			capacity *= 2;
+		segments.modify(student).count = 0; //Nothing of the old segment needs copying
+		moveSegment(student, min(capacity, uint32_t(maxEnrolmentsPerStudent)));
+	}
+
+	if (count > 0)
+	{
+		uint32_t* e = &this->enrolments.modify(int(segments[student].offset));
+		uint32_t* r = &this->rosterSlots.modify(int(segments[student].offset));
+		for (int i = 0; i < count; i++)
+		{
+			e[i] = enrolments[i];
+			r[i] = rosterSlots[i];
+		}
+	}
+	segments.modify(student).count = uint32_t(count);
+}
+
+template <class F>
+void EnrolmentStore::forEachStudent(const int& begin, const int& end, const F& f) const
+{
+	assert(begin >= 0 && begin <= end && end <= getSize());
+
+	//Walk the segments a chunk at a time, and look up the chunk of enrolments only when a segment is in a new one
+	const uint32_t* chunk = nullptr;
+	int chunkIndex = -1;
+	for (int student = begin; student < end; )
+	{
+		const Segment* segment = segments.getChunk(student >> segmentChunkBits);
+		int last = min(end, ((student >> segmentChunkBits) + 1) << segmentChunkBits);
+		for (; student < last; student++)
+		{
+			const Segment& s = segment[student & ((1 << segmentChunkBits) - 1)];
+			if (s.count == 0)
+			{
+				f(student, nullptr, 0);
+				continue;
+			}
+			if (int(s.offset >> enrolmentChunkBits) != chunkIndex)
+			{
+				chunkIndex = int(s.offset >> enrolmentChunkBits);
+				chunk = enrolments.getChunk(chunkIndex);
+			}
+			f(student, chunk + (s.offset & (maxEnrolmentsPerStudent - 1)), int(s.count));
+		}
+	}
+}
+
+void EnrolmentStore::setGrade(const int& student, const int& position, const char& letterGrade)
+{
+	assert(position >= 0 && position < getCount(student));
+
+	uint32_t& e = enrolments.modify(int(segments[student].offset) + position);
+	e = pack(getCourse(e), letterGrade);
+}
+
+void EnrolmentStore::setCourse(const int& student, const int& position, const int& courseIndex)
+{
+	assert(position >= 0 && position < getCount(student));
+
+	uint32_t& e = enrolments.modify(int(segments[student].offset) + position);
+	e = pack(courseIndex, getGrade(e));
+}
+
+void EnrolmentStore::setRosterSlot(const int& student, const int& position, const int& rosterSlot)
+{
+	assert(position >= 0 && position < getCount(student));
+
+	rosterSlots.modify(int(segments[student].offset) + position) = uint32_t(rosterSlot);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//Read-only views of the records of a SchoolManagementSystem for reporting. A view copies nothing and allocates nothing;
+//it only stays valid until the next mutation of the system it came from. Unlike references to the records, views do
+//not expose how the system stores them.
+
+class StudentView
+{
+private:
+	string_view fn, ln;
+	Date dob;
+public:
+	StudentView(const string_view& firstName, const string_view& lastName, const Date&);
+	string_view getFirstName() const;
+	string_view getLastName() const;
+	Date getDob() const;
+	Student toStudent() const; //Return a copy of the student
+	friend ostream& operator << (ostream&, const StudentView&);
+};
+
+StudentView::StudentView(const string_view& firstName, const string_view& lastName, const Date& birthDate) : fn(firstName), ln(lastName), dob(birthDate) {}
+
+string_view StudentView::getFirstName() const
+{
+	return fn;
+}
+
+string_view StudentView::getLastName() const
+{
+	return ln;
+}
+
+Date StudentView::getDob() const
+{
+	return dob;
+}
+
+Student StudentView::toStudent() const
+{
+	return Student(string(fn), string(ln), dob);
+}
+
+ostream& operator << (ostream& out, const StudentView& s)
+{
+	out << "Full Name = " << s.fn << " " << s.ln << ": ";
+	out << "DOB (d-m-y) = " << s.dob.d << "-" << s.dob.m << "-" << s.dob.y;
+	return out;
+}
+
+class CourseView
+{
+private:
+	string_view name;
+	int creditHours;
+public:
+	CourseView(const string_view& name, const int& hours);
+	string_view getCourseName() const;
+	int getCreditHours() const;
+	Course toCourse() const; //Return a copy of the course
+	friend ostream& operator << (ostream&, const CourseView&);
+};
+
+CourseView::CourseView(const string_view& name, const int& hours) : name(name), creditHours(hours) {}
+
+string_view CourseView::getCourseName() const
+{
+	return name;
+}
+
+int CourseView::getCreditHours() const
+{
+	return creditHours;
+}
+
+Course CourseView::toCourse() const
+{
+	return Course(string(name), creditHours);
+}
+
+ostream& operator << (ostream& out, const CourseView& c)
+{
+	out << "Course Name = " << c.name << ", Credit Hours = " << c.creditHours;
+	return out;
+}
+
+class StudentMapView
+{
+private:
+	const uint32_t* enrolments; //Packed as in EnrolmentStore
+	int count;
+public:
+	StudentMapView(const uint32_t* enrolments, const int& count);
+	int getSize() const; //Return the number of courses the student is enrolled in
+	int find(const int& courseIndex) const; //Return the position of the course in the map, or -1 if the student is not enrolled
+	int keyAtIndex(const int&) const; //Assert the index argument and then return the course index at the given position
+	char valueAtIndex(const int&) const; //Assert the index argument and then return the letter grade at the given position
+	StudentMap toStudentMap() const; //Return a copy of the map
+	friend ostream& operator << (ostream&, const StudentMapView&);
+};
+
+StudentMapView::StudentMapView(const uint32_t* enrolments, const int& count) : enrolments(enrolments), count(count) {}
+
+int StudentMapView::getSize() const
+{
+	return count;
+}
+
+int StudentMapView::find(const int& courseIndex) const
+{
+	for (int i = 0; i < count; i++)
+	{
+		if (EnrolmentStore::getCourse(enrolments[i]) == courseIndex)
+			return i;
+	}
+
+	return -1;
+}
+
+int StudentMapView::keyAtIndex(const int& index) const
+{
+	assert(index >= 0 && index < count);
+
+	return EnrolmentStore::getCourse(enrolments[index]);
+}
+
+char StudentMapView::valueAtIndex(const int& index) const
+{
+	assert(index >= 0 && index < count);
+
+	return EnrolmentStore::getGrade(enrolments[index]);
+}
+
+StudentMap StudentMapView::toStudentMap() const
+{
+	StudentMap m;
+	m.reserve(count);
+	for (int i = 0; i < count; i++)
+		m.append(EnrolmentStore::getCourse(enrolments[i]), EnrolmentStore::getGrade(enrolments[i]));
+
+	return m;
+}
+
+ostream& operator << (ostream& out, const StudentMapView& v)
+{
+	//The same layout as the operator << of a Map
+	if (v.count == 0)
+		out << "[Empty Map]\n";
+	else
+	{
+		for (int i = 0; i < v.count; i++)
+			out << EnrolmentStore::getCourse(v.enrolments[i]) << ", " << EnrolmentStore::getGrade(v.enrolments[i]) << '\n';
+	}
+	return out;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//The students of a SchoolManagementSystem stored column by column. Every field lives in its own contiguous column (the
+//names as symbols of namePool()), so a scan over one field, for example the birth years of an age cohort, reads a
+//single linear array instead of chasing each student's heap strings.
+
+class StudentTable
+{
+private:
+	CowArray<Symbol, 12> firstNameColumn;
+	CowArray<Symbol, 12> lastNameColumn;
+	CowArray<int, 12> birthYearColumn;
+	CowArray<int, 12> birthMonthColumn;
+	CowArray<int, 12> birthDayColumn;
+
+public:
+	int getSize() const;
+	void append(const Symbol& firstName, const Symbol& lastName, const Date&);
+	void swapRemove(const int& index); //Remove the student at the index. The last student moves into its index.
+	void reserve(const int& count); //Make room for count students in every column
+	void clear();
+
+	Symbol getFirstNameSymbol(const int& index) const;
+	Symbol getLastNameSymbol(const int& index) const;
+	string_view getFirstName(const int& index) const;
+	string_view getLastName(const int& index) const;
+	Date getDob(const int& index) const;
+	StudentView view(const int& index) const;
+	Student getStudent(const int& index) const; //Materialize the row at the index as a Student
+	SmarterArray<int> findBornBetween(const int& fromYear, const int& toYear) const; //Return the indices of the students
+																					//born in the years fromYear to toYear, in order
+};
+
+int StudentTable::getSize() const
+{
+	return firstNameColumn.getSize();
+}
+
+void StudentTable::append(const Symbol& firstName, const Symbol& lastName, const Date& dob)
+{
+	firstNameColumn.append(firstName);
+	lastNameColumn.append(lastName);
+	birthYearColumn.append(dob.y);
+	birthMonthColumn.append(dob.m);
+	birthDayColumn.append(dob.d);
+}
+
+void StudentTable::swapRemove(const int& index)
+{
+	assert(index >= 0 && index < getSize());
+
+	firstNameColumn.swapRemove(index);
+	lastNameColumn.swapRemove(index);
+	birthYearColumn.swapRemove(index);
+	birthMonthColumn.swapRemove(index);
+	birthDayColumn.swapRemove(index);
+}
+
+void StudentTable::reserve(const int& count)
+{
+	firstNameColumn.reserve(count);
+	lastNameColumn.reserve(count);
+	birthYearColumn.reserve(count);
+	birthMonthColumn.reserve(count);
+	birthDayColumn.reserve(count);
+}
+
+void StudentTable::clear()
+{
+	*this = StudentTable();
+}
+
+Symbol StudentTable::getFirstNameSymbol(const int& index) const
+{
+	return firstNameColumn[index];
+}
+
+Symbol StudentTable::getLastNameSymbol(const int& index) const
+{
+	return lastNameColumn[index];
+}
+
+string_view StudentTable::getFirstName(const int& index) const
+{
+	return namePool().getName(firstNameColumn[index]);
+}
+
+string_view StudentTable::getLastName(const int& index) const
+{
+	return namePool().getName(lastNameColumn[index]);
+}
+
+Date StudentTable::getDob(const int& index) const
+{
+	return Date{ birthDayColumn[index], birthMonthColumn[index], birthYearColumn[index] };
+}
+
+StudentView StudentTable::view(const int& index) const
+{
+	return StudentView(getFirstName(index), getLastName(index), getDob(index));
+}
+
+Student StudentTable::getStudent(const int& index) const
+{
+	return Student(firstNameColumn[index], lastNameColumn[index], getDob(index));
+}
+
+SmarterArray<int> StudentTable::findBornBetween(const int& fromYear, const int& toYear) const
+{
+	SmarterArray<int> indices;
+	int n = getSize();
+	if (n == 0)
+		return indices;
+
+	//Counting first is a branch-free pass the compiler can vectorize chunk by chunk, and it sizes the result exactly
+	const int chunkSize = CowArray<int, 12>::chunkSize;
+	int count = 0;
+	for (int c = 0; c < birthYearColumn.getChunkCount(); c++)
+	{
+		const int* years = birthYearColumn.getChunk(c);
+		int length = min(chunkSize, n - c * chunkSize);
+		for (int i = 0; i < length; i++)
+			count += years[i] >= fromYear && years[i] <= toYear;
+	}
+
+	indices.reserve(count);
+	for (int c = 0; c < birthYearColumn.getChunkCount() && indices.getSize() < count; c++)
+	{
+		const int* years = birthYearColumn.getChunk(c);
+		int length = min(chunkSize, n - c * chunkSize);
+		for (int i = 0; i < length; i++)
+		{
+			if (years[i] >= fromYear && years[i] <= toYear)
+				indices.append(c * chunkSize + i);
+		}
+	}
+	return indices;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+int gradePoints(const char& letterGrade) //Return the grade points of a letter grade, or -1 if the course is not graded yet
+{
+	switch (letterGrade)
+	{
+	case 'A': return 4;
+	case 'B': return 3;
+	case 'C': return 2;
+	case 'D': return 1;
+	case 'F': return 0;
+	default: return -1;
+	}
+}
+
+struct GradeTotals
+{
+	int qualityPoints; //The sum of grade points times credit hours over the graded courses of a student
+	int units; //The sum of credit hours over the graded courses of a student
+
+	void add(const char& letterGrade, const int& creditHours); //Count a course with the given grade. Ungraded courses are ignored.
+	void subtract(const char& letterGrade, const int& creditHours); //Stop counting a course with the given grade
+	double getGPA() const; //Return the GPA the totals describe, or 0.0 if nothing is graded
+	bool operator == (const GradeTotals&) const;
+};
+
+void GradeTotals::add(const char& letterGrade, const int& creditHours)
+{
+	int points = gradePoints(letterGrade);
+	if (points == -1)
+		return;
+
+	qualityPoints += points * creditHours;
+	units += creditHours;
+}
+
+void GradeTotals::subtract(const char& letterGrade, const int& creditHours)
+{
+	int points = gradePoints(letterGrade);
+	if (points == -1)
+		return;
+
+	qualityPoints -= points * creditHours;
+	units -= creditHours;
+}
+
+double GradeTotals::getGPA() const
+{
+	if (units == 0)
+		return 0.0;
+
+	return double(qualityPoints) / units;
+}
+
+bool GradeTotals::operator == (const GradeTotals& t) const
+{
+	return qualityPoints == t.qualityPoints && units == t.units;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//Kernels that sum the GradeTotals of one student's packed enrolments (see EnrolmentStore) in a single pass, given the
+//credit hours of every course in one contiguous array. Instead of comparing the grade against each letter they look
+//it up in tables built from gradePoints, so all kernels give exactly the totals GradeTotals::add would.
+
+typedef GradeTotals(*GradeTotalsKernel)(const uint32_t* enrolments, const int& count, const int* creditHours);
+
+struct GradeTables
+{
+	alignas(32) int32_t points[256]; //The grade points of each grade byte, or 0 if it does not count towards a GPA
+	alignas(32) int32_t counted[256]; //All ones if the grade byte counts towards a GPA, or 0
+
+	GradeTables();
+};
+
+GradeTables::GradeTables()
+{
+	for (int i = 0; i < 256; i++)
+	{
+		int p = gradePoints(char(i));
+		points[i] = p == -1 ? 0 : p;
+		counted[i] = p == -1 ? 0 : -1;
+	}
+}
+
+static const GradeTables gradeTables;
+
+GradeTotals sumGradeTotalsScalar(const uint32_t* enrolments, const int& count, const int* creditHours)
+{
+	GradeTotals totals{ 0, 0 };
+	for (int i = 0; i < count; i++)
+	{
+		//Masking the credit hours instead of skipping ungraded courses keeps the loop free of branches on the grade
+		uint32_t grade = enrolments[i] & 0xff;
+		int hours = creditHours[enrolments[i] >> 8] & gradeTables.counted[grade];
+		totals.qualityPoints += gradeTables.points[grade] * hours;
+		totals.units += hours;
+	}
+
+	return totals;
+}
+
+#ifdef SMS_X86_SIMD
+//Eight enrolments per step. Every letter grade lies within the eight bytes from 'A', so a lane permute of that part of
+//the tables looks up all eight grades at once; the credit hours of the counted lanes are gathered by course index.
+//The last step masks off the lanes past the end, so no byte outside the student's enrolments is read.
+TARGET_AVX2 GradeTotals sumGradeTotalsAvx2(const uint32_t* enrolments, const int& count, const int* creditHours)
+{
+	const __m256i points = _mm256_loadu_si256((const __m256i*)&gradeTables.points['A']);
+	const __m256i counted = _mm256_loadu_si256((const __m256i*)&gradeTables.counted['A']);
+	const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	const __m256i lowByte = _mm256_set1_epi32(0xff), firstGrade = _mm256_set1_epi32('A');
+	const __m256i tableSize = _mm256_set1_epi32(8), minusOne = _mm256_set1_epi32(-1);
+	__m256i qualityPoints = _mm256_setzero_si256(), units = _mm256_setzero_si256();
+
+	for (int i = 0; i < count; i += 8)
+	{
+		__m256i active = _mm256_cmpgt_epi32(_mm256_set1_epi32(count - i), lanes);
+		__m256i e = _mm256_maskload_epi32((const int*)(enrolments + i), active);
+		__m256i grade = _mm256_sub_epi32(_mm256_and_si256(e, lowByte), firstGrade);
+		__m256i inTable = _mm256_and_si256(_mm256_cmpgt_epi32(tableSize, grade), _mm256_cmpgt_epi32(grade, minusOne));
+		__m256i mask = _mm256_and_si256(_mm256_and_si256(active, inTable), _mm256_permutevar8x32_epi32(counted, grade));
+		__m256i hours = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), creditHours, _mm256_srli_epi32(e, 8), mask, 4);
+		qualityPoints = _mm256_add_epi32(qualityPoints, _mm256_mullo_epi32(_mm256_permutevar8x32_epi32(points, grade), hours));
+		units = _mm256_add_epi32(units, hours);
+	}
+
+	alignas(32) int32_t q[8], u[8];
+	_mm256_store_si256((__m256i*)q, qualityPoints);
+	_mm256_store_si256((__m256i*)u, units);
+	GradeTotals totals{ 0, 0 };
+	for (int i = 0; i < 8; i++)
+	{
+		totals.qualityPoints += q[i];
+		totals.units += u[i];
+	}
+
+	return totals;
+}
+#endif
+
+bool cpuSupportsAvx2()
+{
+#if !defined(SMS_X86_SIMD)
+	return false;
+#elif defined(_MSC_VER)
+	//AVX2 needs the CPU to have it and the OS to save the upper halves of the ymm registers
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0, avx = (info[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+		return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+GradeTotalsKernel getGradeTotalsKernel() //Return the fastest kernel the CPU supports
+{
+#ifdef SMS_X86_SIMD
+	static const GradeTotalsKernel kernel = cpuSupportsAvx2() ? sumGradeTotalsAvx2 : sumGradeTotalsScalar;
+	return kernel;
+#else
+	return sumGradeTotalsScalar;
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//An order statistics tree (a treap with subtree sizes) over the students of a school, ordered by GPA from highest
+//to lowest and, among equal GPAs, by position from lowest to highest. The first student in this order is therefore
+//exactly the one a front to back scan for the highest GPA would pick.
+class StudentRankIndex
+{
+private:
+	struct Node
+	{
+		double gpa;
+		int position; //The position of the student in the school's lists
+		unsigned int priority;
+		int left, right; //Child nodes, -1 if none
+		int size; //The number of nodes in the subtree rooted here
+	};
+
+	SmarterArray<Node> nodes; //Every node ever allocated. Removed nodes are recycled through freeNodes.
+	SmarterArray<int> freeNodes;
+	SmarterArray<int> nodeOfPosition; //The node of the student at each position
+	int root;
+	unsigned int seed; //State of the priority generator (kept separate from rand() so indexing never disturbs it)
+
+	int sizeOf(const int&) const;
+	void updateSize(const int&); //Recompute the subtree size of a node from its children
+	bool comesBefore(const int&, const int&) const; //Return true if the first node is ranked ahead of the second
+	void split(int, const int&, int&, int&); //Split a subtree into the nodes ranked ahead of a key node and the rest
+	int merge(const int&, const int&); //Join two subtrees where every node of the first is ranked ahead of the second
+	int erase(const int&, const int&); //Remove a node from a subtree and return the new subtree root
+	void link(const int&); //Insert a detached node into the tree
+	int computeSizes(const int&); //Recompute the subtree sizes of a whole subtree and return its size
+	void collectTop(const int&, const int&, SmarterArray<int>&) const;
+	void collectRange(const int&, const double&, const double&, SmarterArray<int>&) const;
+
+public:
+	StudentRankIndex();
+
+	int getSize() const; //Return the number of students in the index
+	void append(const double& gpa); //Add the student at the next position with the given GPA
+	void assign(const SmarterArray<double>& gpas); //Replace the contents with the students at positions 0, 1, ... with the
+												//given GPAs. Builds the tree in one pass after a sort instead of n inserts.
+	void remove(const int& position); //Remove the student at the given position. The last student moves into the position.
+	void update(const int& position, const double& gpa); //Record a new GPA for the student at the given position
+	int getTop() const; //Return the position of the top student, or -1 if the index is empty
+	int getRank(const int& position) const; //Return the rank of the student at the given position. The top student has rank 1.
+	SmarterArray<int> getTop(const int& k) const; //Return the positions of the first k students in rank order
+	SmarterArray<int> getInRange(const double& minGPA, const double& maxGPA) const; //Return the positions of the students
+																				//with minGPA <= GPA <= maxGPA in rank order
+};
+
+StudentRankIndex::StudentRankIndex()
+{
+	root = -1;
+	seed = 2463534242u;
+}
+
+int StudentRankIndex::sizeOf(const int& t) const
+{
+	return t == -1 ? 0 : nodes[t].size;
+}
+
+void StudentRankIndex::updateSize(const int& t)
+{
+	nodes[t].size = 1 + sizeOf(nodes[t].left) + sizeOf(nodes[t].right);
+}
+
+bool StudentRankIndex::comesBefore(const int& a, const int& b) const
+{
+	if (nodes[a].gpa != nodes[b].gpa)
+		return nodes[a].gpa > nodes[b].gpa;
+
+	return nodes[a].position < nodes[b].position;
+}
+
+void StudentRankIndex::split(int t, const int& key, int& l, int& r) //t is taken by value because l or r may alias it
+{
+	if (t == -1)
+	{
+		l = r = -1;
+		return;
+	}
+
+	if (comesBefore(t, key))
+	{
+		split(nodes[t].right, key, nodes[t].right, r);
+		l = t;
+	}
+	else
+	{
+		split(nodes[t].left, key, l, nodes[t].left);
+		r = t;
+	}
+	updateSize(t);
+}
+
+int StudentRankIndex::merge(const int& l, const int& r)
+{
+	if (l == -1)
+		return r;
+	if (r == -1)
+		return l;
+
+	if (nodes[l].priority > nodes[r].priority)
+	{
+		nodes[l].right = merge(nodes[l].right, r);
+		updateSize(l);
+		return l;
+	}
+
+	nodes[r].left = merge(l, nodes[r].left);
+	updateSize(r);
+	return r;
+}
+
+int StudentRankIndex::erase(const int& t, const int& key)
+{
+	if (t == key)
+		return merge(nodes[t].left, nodes[t].right);
+
+	if (comesBefore(key, t))
+		nodes[t].left = erase(nodes[t].left, key);
+	else
+		nodes[t].right = erase(nodes[t].right, key);
+	updateSize(t);
+
+	return t;
+}
+
+void StudentRankIndex::link(const int& n)
+{
+	nodes[n].left = nodes[n].right = -1;
+	nodes[n].size = 1;
+
+	int l, r;
+	split(root, n, l, r);
+	root = merge(merge(l, n), r);
+}
+
+int StudentRankIndex::getSize() const
+{
+	return nodeOfPosition.getSize();
+}
+
+void StudentRankIndex::append(const double& gpa)
+{
+	//xorshift32
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+
+	Node node{ gpa, nodeOfPosition.getSize(), seed, -1, -1, 1 };
+	int n;
+	if (freeNodes.getSize() > 0)
+	{
+		n = freeNodes[freeNodes.getSize() - 1];
+		freeNodes.remove(freeNodes.getSize() - 1);
+		nodes[n] = node;
+	}
+	else
+	{
+		n = nodes.getSize();
+		nodes.append(node);
+	}
+
+	nodeOfPosition.append(n);
+	link(n);
+}
+
+int StudentRankIndex::computeSizes(const int& t)
+{
+	if (t == -1)
+		return 0;
+
+	nodes[t].size = 1 + computeSizes(nodes[t].left) + computeSizes(nodes[t].right);
+	return nodes[t].size;
+}
+
+void StudentRankIndex::assign(const SmarterArray<double>& gpas)
+{
+	int n = gpas.getSize();
+
+	nodes = SmarterArray<Node>();
+	freeNodes = SmarterArray<int>();
+	nodeOfPosition = SmarterArray<int>();
+	root = -1;
+	if (n == 0)
+		return;
+
+	nodes.reserve(n);
+	nodeOfPosition.reserve(n);
+	for (int i = 0; i < n; i++)
+	{
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+
+		nodes.append(Node{ gpas[i], i, seed, -1, -1, 1 });
+		nodeOfPosition.append(i);
+	}
+
+	struct Key
+	{
+		double gpa;
+		int position;
+	};
+	SmarterArray<Key> order;
+	order.reserve(n);
+	for (int i = 0; i < n; i++)
+		order.append(Key{ gpas[i], i });
+	sort(&order[0], &order[0] + n, [](const Key& a, const Key& b) { return a.gpa != b.gpa ? a.gpa > b.gpa : a.position < b.position; });
+
+	//Build the treap from the nodes in rank order with a stack of the right spine (Cartesian tree construction)
+	SmarterArray<int> spine;
+	for (int i = 0; i < n; i++)
+	{
+		int t = order[i].position, last = -1;
+		while (spine.getSize() > 0 && nodes[spine[spine.getSize() - 1]].priority < nodes[t].priority)
+		{
+			last = spine[spine.getSize() - 1];
+			spine.remove(spine.getSize() - 1);
+		}
+
+		nodes[t].left = last;
+		if (spine.getSize() > 0)
+			nodes[spine[spine.getSize() - 1]].right = t;
+		spine.append(t);
+	}
+
+	root = spine[0];
+	computeSizes(root);
+}
+
+void StudentRankIndex::remove(const int& position)
+{
+	assert(position >= 0 && position < nodeOfPosition.getSize());
+
+	int n = nodeOfPosition[position];
+	root = erase(root, n);
+	freeNodes.append(n);
+
+	int last = nodeOfPosition.getSize() - 1;
+	if (position != last)
+	{
+		//The position breaks GPA ties, so the moved student has to be re-linked under its new position
+		int moved = nodeOfPosition[last];
+		root = erase(root, moved);
+		nodes[moved].position = position;
+		link(moved);
+	}
+
+	nodeOfPosition.swapRemove(position);
+}
+
+void StudentRankIndex::update(const int& position, const double& gpa)
+{
+	assert(position >= 0 && position < nodeOfPosition.getSize());
+
+	int n = nodeOfPosition[position];
+	if (nodes[n].gpa == gpa)
+		return;
+
+	root = erase(root, n);
+	nodes[n].gpa = gpa;
+	link(n);
+}
+
+int StudentRankIndex::getTop() const
+{
+	if (root == -1)
+		return -1;
+
+	int t = root;
+	while (nodes[t].left != -1)
+		t = nodes[t].left;
+
+	return nodes[t].position;
+}
+
+int StudentRankIndex::getRank(const int& position) const
+{
+	assert(position >= 0 && position < nodeOfPosition.getSize());
+
+	int n = nodeOfPosition[position];
+	int ahead = 0;
+	for (int t = root; t != n;)
+	{
+		if (comesBefore(n, t))
+			t = nodes[t].left;
+		else
+		{
+			ahead += sizeOf(nodes[t].left) + 1;
+			t = nodes[t].right;
+		}
+	}
+
+	return ahead + sizeOf(nodes[n].left) + 1;
+}
+
+void StudentRankIndex::collectTop(const int& t, const int& k, SmarterArray<int>& result) const
+{
+	if (t == -1 || result.getSize() == k)
+		return;
+
+	collectTop(nodes[t].left, k, result);
+	if (result.getSize() < k)
+	{
+		result.append(nodes[t].position);
+		collectTop(nodes[t].right, k, result);
+	}
+}
+
+SmarterArray<int> StudentRankIndex::getTop(const int& k) const
+{
+	SmarterArray<int> result;
+	result.reserve(k < getSize() ? k : getSize());
+	collectTop(root, k, result);
+
+	return result;
+}
+
+void StudentRankIndex::collectRange(const int& t, const double& minGPA, const double& maxGPA, SmarterArray<int>& result) const
+{
+	if (t == -1)
+		return;
+
+	//Higher GPAs are on the left
+	if (nodes[t].gpa > maxGPA)
+		collectRange(nodes[t].right, minGPA, maxGPA, result);
+	else if (nodes[t].gpa < minGPA)
+		collectRange(nodes[t].left, minGPA, maxGPA, result);
+	else
+	{
+		collectRange(nodes[t].left, minGPA, maxGPA, result);
+		result.append(nodes[t].position);
+		collectRange(nodes[t].right, minGPA, maxGPA, result);
+	}
+}
+
+SmarterArray<int> StudentRankIndex::getInRange(const double& minGPA, const double& maxGPA) const
+{
+	SmarterArray<int> result;
+	collectRange(root, minGPA, maxGPA, result);
+
+	return result;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//Typeahead and fuzzy search over the names of a set of records. A record is identified by a stable id (a StudentId or
+//CourseId), so removing one record never disturbs the entries of another, and any number of records may hold the same
+//name. Matching ignores ASCII case.
+//
+//The distinct names are kept in order in a list of sorted blocks of at most maxBlockSize names: a prefix search is a
+//binary search for the first match followed by a walk, and adding or removing a name shifts one block. Each name is
+//stored with its first eight case folded bytes, so most comparisons are settled without reading the name. For fuzzy
+//search the index also keeps the names containing each trigram of the case folded names, with one boundary character
+//at each end. A single edit changes at most three trigrams, so a name within d edits of a query with t distinct
+//trigrams shares at least t - 3d of them, and only names sharing that many are checked with an edit distance.
+
+class NameSearchIndex
+{
+private:
+	struct Name
+	{
+		Symbol symbol;
+		SmarterArray<uint32_t> holders; //The ids of the records holding the name, in no particular order
+	};
+
+	struct Entry
+	{
+		uint64_t key; //The first 8 case folded bytes of the name, big endian and padded with zeros
+		Symbol symbol;
+	};
+
+	static const int maxBlockSize = 256;
+
+	SmarterArray<SmarterArray<Entry>> blocks; //The distinct names in order (see comesBefore). No block is empty.
+	SmarterArray<Entry> blockFirsts; //The first entry of each block
+	SmarterArray<Name> nameList; //The distinct names with their holders, in no particular order
+	HashIndex nameIndex; //Positions in nameList hashed by name
+	bool fuzzy; //Whether trigrams are kept
+	SmarterArray<uint32_t> trigramList; //The distinct trigrams of the names
+	SmarterArray<SmarterArray<Symbol>> postingList; //The names containing each trigram of trigramList, in no particular order
+	HashIndex trigramIndex; //Positions in trigramList hashed by trigram
+	pmr::memory_resource* resource; //Where new blocks, holder lists and posting lists are allocated from. Not owned.
+
+	static char fold(const char&); //Return the lower case of an ASCII letter and any other character as it is
+	static int compareFolded(const string_view&, const string_view&); //Compare ignoring case. Return a negative number,
+																	//zero or a positive number as the first comes
+																	//before, with or after the second.
+	static uint64_t getKey(const string_view&);
+	static Entry makeEntry(const Symbol&);
+	static bool comesBefore(const Entry&, const Entry&); //Ignoring case, then by the characters themselves
+	static SmarterArray<uint32_t> getTrigrams(const string_view& name); //Return the distinct trigrams of the case folded
+																		//name, each packed into the low 24 bits
+	static size_t hashTrigram(const uint32_t&);
+	static int editDistance(const string_view&, const string_view&, const int& maxDistance, int* rows); //Return the
+											//Levenshtein distance ignoring case, or maxDistance + 1 if it is greater.
+											//rows must have room for 2 * (length of the second + 1) ints.
+	int findName(const Symbol&) const; //Return the position of the name in nameList, or -1
+	int findBlock(const Entry&) const; //Return the block the name is in or belongs in
+	void addName(const Symbol&); //Add a new distinct name to the blocks and the trigrams
+	void removeName(const Symbol&); //Remove a distinct name from the blocks and the trigrams
+	int findTrigram(const uint32_t&) const; //Return the position of the trigram in trigramList, or -1
+
+public:
+	explicit NameSearchIndex(const bool& fuzzy); //fuzzy says whether findSimilar will be used, which costs memory
+
+	static bool startsWith(const string_view& name, const string_view& prefix); //Ignoring case
+
+	int getNameCount() const; //Return the number of distinct names
+	void setResource(pmr::memory_resource*); //Allocate the lists made from now on (one or more per new name) from the
+											//given resource
+	void insert(const Symbol& name, const uint32_t& id); //Record that the record with the id holds the name
+	void erase(const Symbol& name, const uint32_t& id); //Assert the record with the id holds the name and then forget it
+	size_t getMemoryUsage() const; //Return the number of bytes allocated
+
+	template <class F>
+	void findPrefix(const string_view& prefix, const F& f) const; //Call f(id) for every record holding a name that starts
+																//with prefix, in name order, until f returns false
+	template <class F>
+	void findSimilar(const string_view& name, const int& maxDistance, const F& f) const; //Call f(id, distance) for every
+																					//record holding a name within
+																					//maxDistance edits of name, closest
+																					//first, until f returns false
+};
+
+NameSearchIndex::NameSearchIndex(const bool& fuzzy)
+{
+	this->fuzzy = fuzzy;
+	resource = pmr::get_default_resource();
+}
+
+char NameSearchIndex::fold(const char& c)
+{
+	return (c >= 'A' && c <= 'Z') ? char(c - 'A' + 'a') : c;
+}
+
+int NameSearchIndex::compareFolded(const string_view& a, const string_view& b)
+{
+	size_t n = min(a.size(), b.size());
+	for (size_t i = 0; i < n; i++)
+	{
+		uint8_t x = uint8_t(fold(a[i])), y = uint8_t(fold(b[i]));
+		if (x != y)
+			return x < y ? -1 : 1;
+	}
+	return a.size() < b.size() ? -1 : (a.size() > b.size() ? 1 : 0);
+}
+
+uint64_t NameSearchIndex::getKey(const string_view& name)
+{
+	//Padding with zeros keeps the keys in the same order as compareFolded wherever they differ
+	uint64_t key = 0;
+	for (size_t i = 0; i < 8; i++)
+		key = (key << 8) | (i < name.size() ? uint8_t(fold(name[i])) : 0u);
+	return key;
+}
+
+NameSearchIndex::Entry NameSearchIndex::makeEntry(const Symbol& name)
+{
+	return Entry{ getKey(namePool().getName(name)), name };
+}
+
+bool NameSearchIndex::comesBefore(const Entry& a, const Entry& b)
+{
+	if (a.key != b.key)
+		return a.key < b.key;
+
+	string_view x = namePool().getName(a.symbol), y = namePool().getName(b.symbol);
+	int c = compareFolded(x, y);
+	return c != 0 ? c < 0 : x < y;
+}
+
+SmarterArray<uint32_t> NameSearchIndex::getTrigrams(const string_view& name)
+{
+	SmarterArray<uint32_t> trigrams;
+	trigrams.reserve(int(name.size()));
+	auto at = [&](const size_t& i) { return (i == 0 || i > name.size()) ? 0u : uint32_t(uint8_t(fold(name[i - 1]))); };
+	for (size_t i = 0; i < name.size(); i++)
+	{
+		uint32_t trigram = (at(i) << 16) | (at(i + 1) << 8) | at(i + 2);
+		if (trigrams.find(trigram) == -1)
+			trigrams.append(trigram);
+	}
+	return trigrams;
+}
+
+size_t NameSearchIndex::hashTrigram(const uint32_t& trigram)
+{
+	char bytes[3] = { char(trigram >> 16), char(trigram >> 8), char(trigram) };
+	return NamePool::hashName(string_view(bytes, 3));
+}
+
+int NameSearchIndex::editDistance(const string_view& a, const string_view& b, const int& maxDistance, int* rows)
+{
+	int* previous = rows;
+	int* current = rows + b.size() + 1;
+	for (size_t j = 0; j <= b.size(); j++)
+		previous[j] = int(j);
+
+	for (size_t i = 1; i <= a.size(); i++)
+	{
+		current[0] = int(i);
+		int best = current[0];
+		for (size_t j = 1; j <= b.size(); j++)
+		{
+			int substitution = previous[j - 1] + (fold(a[i - 1]) == fold(b[j - 1]) ? 0 : 1);
+			current[j] = min(substitution, min(previous[j], current[j - 1]) + 1);
+			best = min(best, current[j]);
+		}
+		if (best > maxDistance) //Every later row is at least as far
+			return maxDistance + 1;
+		swap(previous, current);
+	}
+
+	return min(previous[b.size()], maxDistance + 1);
+}
+
+int NameSearchIndex::findName(const Symbol& name) const
+{
+	return nameIndex.find(namePool().getHash(name), [&](const int& i) { return nameList[i].symbol == name; });
+}
+
+int NameSearchIndex::findBlock(const Entry& name) const
+{
+	//The last block whose first name does not come after the name
+	int low = 0, high = blockFirsts.getSize() - 1;
+	while (low < high)
+	{
+		int middle = (low + high + 1) / 2;
+		if (comesBefore(name, blockFirsts[middle]))
+			high = middle - 1;
+		else
+			low = middle;
+	}
+	return low;
+}
+
+int NameSearchIndex::findTrigram(const uint32_t& trigram) const
+{
+	return trigramIndex.find(hashTrigram(trigram), [&](const int& i) { return trigramList[i] == trigram; });
+}
+
+void NameSearchIndex::addName(const Symbol& name)
+{
+	Entry entry = makeEntry(name);
+	if (blocks.getSize() == 0)
+	{
+		blocks.emplace_back(resource);
+		blockFirsts.append(entry);
+	}
+
+	int b = findBlock(entry);
+	SmarterArray<Entry>& block = blocks[b];
+	int i = block.getSize() == 0 ? 0 : int(lower_bound(&block[0], &block[0] + block.getSize(), entry, comesBefore) - &block[0]);
+	block.append(entry);
+	for (int j = block.getSize() - 1; j > i; j--)
+		block[j] = block[j - 1];
+	block[i] = entry;
+	blockFirsts[b] = block[0];
+
+	if (block.getSize() > maxBlockSize)
+	{
+		//Split the block in two and insert the upper half after it
+		int half = block.getSize() / 2;
+		SmarterArray<Entry> upper(resource);
+		upper.reserve(int(maxBlockSize));
+		for (int j = half; j < block.getSize(); j++)
+			upper.append(block[j]);
+		while (block.getSize() > half)
+			block.remove(block.getSize() - 1);
+
+		blockFirsts.append(upper[0]);
+		for (int j = blockFirsts.getSize() - 1; j > b + 1; j--)
+			blockFirsts[j] = blockFirsts[j - 1];
+		blockFirsts[b + 1] = upper[0];
+
+		blocks.emplace_back();
+		for (int j = blocks.getSize() - 1; j > b + 1; j--)
+			blocks[j] = std::move(blocks[j - 1]);
+		blocks[b + 1] = std::move(upper);
+	}
+
+	if (!fuzzy)
+		return;
+
+	SmarterArray<uint32_t> trigrams = getTrigrams(namePool().getName(name));
+	for (int t = 0; t < trigrams.getSize(); t++)
+	{
+		int position = findTrigram(trigrams[t]);
+		if (position == -1)
+		{
+			position = trigramList.getSize();
+			trigramList.append(trigrams[t]);
+			postingList.emplace_back(resource);
+			trigramIndex.insert(hashTrigram(trigrams[t]), position);
+		}
+		postingList[position].append(name);
+	}
+}
+
+void NameSearchIndex::removeName(const Symbol& name)
+{
+	Entry entry = makeEntry(name);
+	int b = findBlock(entry);
+	SmarterArray<Entry>& block = blocks[b];
+	int i = int(lower_bound(&block[0], &block[0] + block.getSize(), entry, comesBefore) - &block[0]);
+	assert(i < block.getSize() && block[i].symbol == name);
+	block.remove(i);
+	if (block.getSize() == 0)
+	{
+		blocks.remove(b);
+		blockFirsts.remove(b);
+	}
+	else
+		blockFirsts[b] = block[0];
+
+	if (!fuzzy)
+		return;
+
+	SmarterArray<uint32_t> trigrams = getTrigrams(namePool().getName(name));
+	for (int t = 0; t < trigrams.getSize(); t++)
+	{
+		int position = findTrigram(trigrams[t]);
+		SmarterArray<Symbol>& postings = postingList[position];
+		postings.swapRemove(postings.find(name));
+		if (postings.getSize() > 0)
+			continue;
+
+		//The last trigram moves into the position of the one no name has any more
+		int last = trigramList.getSize() - 1;
+		trigramIndex.erase(hashTrigram(trigrams[t]), position);
+		if (position != last)
+			trigramIndex.replacePosition(hashTrigram(trigramList[last]), last, position);
+		trigramList.swapRemove(position);
+		postingList.swapRemove(position);
+	}
+}
+
+bool NameSearchIndex::startsWith(const string_view& name, const string_view& prefix)
+{
+	return name.size() >= prefix.size() && compareFolded(name.substr(0, prefix.size()), prefix) == 0;
+}
+
+void NameSearchIndex::setResource(pmr::memory_resource* resource)
+{
+	this->resource = resource;
+}
+
+int NameSearchIndex::getNameCount() const
+{
+	return nameList.getSize();
+}
+
+void NameSearchIndex::insert(const Symbol& name, const uint32_t& id)
+{
+	int position = findName(name);
+	if (position == -1)
+	{
+		position = nameList.getSize();
+		nameList.append(Name{ name, SmarterArray<uint32_t>(resource) });
+		nameIndex.insert(namePool().getHash(name), position);
+		addName(name);
+	}
+	nameList[position].holders.append(id);
+}
+
+void NameSearchIndex::erase(const Symbol& name, const uint32_t& id)
+{
+	int position = findName(name);
+	assert(position != -1);
+
+	SmarterArray<uint32_t>& holders = nameList[position].holders;
+	int i = holders.find(id);
+	assert(i != -1);
+	holders.swapRemove(i);
+	if (holders.getSize() > 0)
+		return;
+
+	removeName(name);
+	int last = nameList.getSize() - 1;
+	nameIndex.erase(namePool().getHash(name), position);
+	if (position != last)
+		nameIndex.replacePosition(namePool().getHash(nameList[last].symbol), last, position);
+	nameList.swapRemove(position);
+}
+
+size_t NameSearchIndex::getMemoryUsage() const
+{
+	size_t bytes = sizeof(NameSearchIndex) + size_t(blocks.getCapacity()) * sizeof(SmarterArray<Entry>) +
+		size_t(blockFirsts.getCapacity()) * sizeof(Entry) + size_t(nameList.getCapacity()) * sizeof(Name) + nameIndex.getMemoryUsage() + size_t(trigramList.getCapacity()) * sizeof(uint32_t) +
+		size_t(postingList.getCapacity()) * sizeof(SmarterArray<Symbol>) + trigramIndex.getMemoryUsage();
+	for (int i = 0; i < blocks.getSize(); i++)
+		bytes += size_t(blocks[i].getCapacity()) * sizeof(Entry);
+	for (int i = 0; i < nameList.getSize(); i++)
+		bytes += size_t(nameList[i].holders.getCapacity()) * sizeof(uint32_t);
+	for (int i = 0; i < postingList.getSize(); i++)
+		bytes += size_t(postingList[i].getCapacity()) * sizeof(Symbol);
+	return bytes;
+}
+
+template <class F>
+void NameSearchIndex::findPrefix(const string_view& prefix, const F& f) const
+{
+	//Names starting with the prefix follow every name that comes before the prefix itself, so the walk starts at the
+	//first name that does not, in the last block whose first name comes before the prefix
+	uint64_t prefixKey = getKey(prefix);
+	auto before = [&](const Entry& name)
+	{
+		return name.key != prefixKey ? name.key < prefixKey : compareFolded(namePool().getName(name.symbol), prefix) < 0;
+	};
+	if (blocks.getSize() == 0)
+		return;
+	int first = max(0, int(partition_point(&blockFirsts[0], &blockFirsts[0] + blockFirsts.getSize(), before) - &blockFirsts[0]) - 1);
+
+	for (int b = first; b < blocks.getSize(); b++)
+	{
+		const SmarterArray<Entry>& block = blocks[b];
+		int i = b == first ? int(partition_point(&block[0], &block[0] + block.getSize(), before) - &block[0]) : 0;
+		for (; i < block.getSize(); i++)
+		{
+			if (!startsWith(namePool().getName(block[i].symbol), prefix))
+				return;
+
+			const SmarterArray<uint32_t>& holders = nameList[findName(block[i].symbol)].holders;
+			for (int h = 0; h < holders.getSize(); h++)
+			{
+				if (!f(holders[h]))
+					return;
+			}
+		}
+	}
+}
+
+template <class F>
+void NameSearchIndex::findSimilar(const string_view& name, const int& maxDistance, const F& f) const
+{
+	assert(fuzzy && maxDistance >= 0);
+
+	SmarterArray<uint32_t> trigrams = getTrigrams(name);
+	int threshold = trigrams.getSize() - 3 * maxDistance;
+
+	SmarterArray<Symbol> candidates;
+	if (threshold <= 0)
+	{
+		//The query is too short for the trigrams to rule anything out
+		candidates.reserve(nameList.getSize());
+		for (int i = 0; i < nameList.getSize(); i++)
+			candidates.append(nameList[i].symbol);
+	}
+	else
+	{
+		//A name sharing threshold of the query's trigrams lacks at most 3 * maxDistance of them, so it is in at least one
+		//of any 3 * maxDistance + 1 of their posting lists. The names in the shortest ones are counted through all of the
+		//lists, and only those sharing enough trigrams are read and checked.
+		static const SmarterArray<Symbol> none; //The postings of a trigram no name has
+		SmarterArray<const SmarterArray<Symbol>*> lists;
+		for (int t = 0; t < trigrams.getSize(); t++)
+		{
+			int position = findTrigram(trigrams[t]);
+			lists.append(position == -1 ? &none : &postingList[position]);
+		}
+		sort(&lists[0], &lists[0] + lists.getSize(), [](const SmarterArray<Symbol>* a, const SmarterArray<Symbol>* b)
+		{
+			return a->getSize() < b->getSize();
+		});
+		SmarterArray<Symbol> hits;
+		SmarterArray<int> shared; //The number of the query's trigrams each of hits has
+		HashIndex hitIndex; //Positions in hits hashed by name
+		int hitCount = 0;
+		for (int l = 0; l <= 3 * maxDistance; l++)
+			hitCount += lists[l]->getSize();
+		hitIndex.reserve(hitCount);
+		for (int l = 0; l < lists.getSize(); l++)
+		{
+			for (int i = 0; i < lists[l]->getSize(); i++)
+			{
+				Symbol hit = (*lists[l])[i];
+				size_t hash = size_t((uint64_t(hit) * 0x9E3779B97F4A7C15ull) >> 32);
+				int position = hitIndex.find(hash, [&](const int& j) { return hits[j] == hit; });
+				if (position != -1)
+					shared[position]++;
+				else if (l <= 3 * maxDistance)
+				{
+					hitIndex.insert(hash, hits.getSize());
+					hits.append(hit);
+					shared.append(1);
+				}
+			}
+		}
+		for (int i = 0; i < hits.getSize(); i++)
+		{
+			if (shared[i] >= threshold)
+				candidates.append(hits[i]);
+		}
+	}
+
+	struct Match
+	{
+		int distance;
+		Entry name;
+	};
+	SmarterArray<Match> matches;
+	SmarterArray<int> rows;
+	for (int i = 0; i < 2 * int(name.size() + maxDistance + 1); i++)
+		rows.append(0);
+	for (int i = 0; i < candidates.getSize(); i++)
+	{
+		string_view candidate = namePool().getName(candidates[i]);
+		if (candidate.size() > name.size() + maxDistance || candidate.size() + maxDistance < name.size())
+			continue;
+		int distance = editDistance(name, candidate, maxDistance, &rows[0]);
+		if (distance <= maxDistance)
+			matches.append(Match{ distance, makeEntry(candidates[i]) });
+	}
+	if (matches.getSize() > 0)
+		sort(&matches[0], &matches[0] + matches.getSize(), [](const Match& a, const Match& b)
+		{
+			return a.distance != b.distance ? a.distance < b.distance : comesBefore(a.name, b.name);
+		});
+
+	for (int i = 0; i < matches.getSize(); i++)
+	{
+		const SmarterArray<uint32_t>& holders = nameList[findName(matches[i].name.symbol)].holders;
+		for (int h = 0; h < holders.getSize(); h++)
+		{
+			if (!f(holders[h], matches[i].distance))
+				return;
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//A read-only memory mapping of a whole file
+class MappedFile
+{
+private:
+	const char* data;
+	size_t size;
+#ifdef _WIN32
+	HANDLE file, mapping;
+#else
+	int fd;
+#endif
+
+public:
+	MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator = (const MappedFile&) = delete;
+	~MappedFile(); //Unmap the file
+
+	bool open(const string& path); //Map the file at the given path. Return false if it cannot be opened or is empty.
+	void close();
+	const char* getData() const;
+	size_t getSize() const;
+};
+
+MappedFile::MappedFile()
+{
+	data = nullptr;
+	size = 0;
+#ifdef _WIN32
+	file = INVALID_HANDLE_VALUE;
+	mapping = nullptr;
+#else
+	fd = -1;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::open(const string& path)
+{
+	close();
+
+#ifdef _WIN32
+	file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0 || uint64_t(fileSize.QuadPart) > SIZE_MAX)
+	{
+		close();
+		return false;
+	}
+	size = size_t(fileSize.QuadPart);
+
+	mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping != nullptr)
+		data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+	fd = ::open(path.c_str(), O_RDONLY);
+	if (fd == -1)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0)
+	{
+		close();
+		return false;
+	}
+	size = size_t(st.st_size);
+
+	void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (p != MAP_FAILED)
+	{
+		data = static_cast<const char*>(p);
+		madvise(p, size, MADV_SEQUENTIAL);
+	}
+#endif
+
+	if (data == nullptr)
+	{
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+	if (data != nullptr)
+		UnmapViewOfFile(data);
+	if (mapping != nullptr)
+		CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+	mapping = nullptr;
+	file = INVALID_HANDLE_VALUE;
+#else
+	if (data != nullptr)
+		munmap(const_cast<char*>(data), size);
+	if (fd != -1)
+		::close(fd);
+	fd = -1;
+#endif
+	data = nullptr;
+	size = 0;
+}
+
+const char* MappedFile::getData() const
+{
+	return data;
+}
+
+size_t MappedFile::getSize() const
+{
+	return size;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//The binary snapshot format of a SchoolManagementSystem. All integers are little endian and every section starts on
+//a 4 byte boundary, so the loader can read the records straight out of a memory mapping of the file. After the header:
+//	uint32 stringOffsets[stringCount + 1]		Offsets of the interned strings within the string bytes
+//	char stringBytes[stringBytes]				Every distinct name once, padded with zeros to a multiple of 4
+//	SnapshotCourse courses[courseCount]
+//	SnapshotStudent students[studentCount]
+//	uint32 enrolmentOffsets[studentCount + 1]	Where each student's enrolments start within enrolments
+//	SnapshotEnrolment enrolments[enrolmentCount]	The StudentMap pairs of every student in map order
+//	uint32 rosterOffsets[courseCount + 1]		Where each course's roster starts within rosters
+//	int32 rosters[enrolmentCount]				The student indices of every course roster in roster order
+//	uint32 studentIds[studentCount], studentGenerations[studentSlotCount]
+//	uint32 courseIds[courseCount], courseGenerations[courseSlotCount]
+//	uint32 waitlistOffsets[courseCount + 1]		Where each course's waitlist starts within waitlists
+//	int32 waitlists[waitlistCount]				The student indices of every course waitlist, first in line first
+struct SnapshotHeader
+{
+	char magic[8]; //"SMSSNAP" and a terminating zero
+	uint32_t version;
+	uint32_t stringCount, stringBytes;
+	uint32_t courseCount, studentCount, enrolmentCount;
+	uint32_t courseSlotCount, studentSlotCount;
+	uint32_t waitlistCount;
+	uint32_t padding; //Zero
+	uint64_t logSequence; //The sequence number of the last logged mutation the snapshot includes
+	uint64_t checksum; //FNV-1a over every byte after the header
+};
+
+struct SnapshotCourse
+{
+	uint32_t name; //Index of an interned string
+	int32_t creditHours;
+	int32_t capacity;
+};
+
+struct SnapshotStudent
+{
+	uint32_t firstName, lastName; //Indices of interned strings
+	int32_t d, m, y;
+};
+
+struct SnapshotEnrolment
+{
+	int32_t courseIndex;
+	int32_t letterGrade;
+};
+
+//Version 2 predates seat limits: its header has no waitlist count, its courses no capacity and it has no waitlist
+//sections. The loader still accepts it, giving every course unlimited seats and an empty waitlist.
+struct SnapshotHeaderV2
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t stringCount, stringBytes;
+	uint32_t courseCount, studentCount, enrolmentCount;
+	uint32_t courseSlotCount, studentSlotCount;
+	uint64_t logSequence;
+	uint64_t checksum;
+};
+
+struct SnapshotCourseV2
+{
+	uint32_t name;
+	int32_t creditHours;
+};
+
+static_assert(sizeof(SnapshotHeader) == 64 && sizeof(SnapshotCourse) == 12 && sizeof(SnapshotStudent) == 20 &&
+	sizeof(SnapshotEnrolment) == 8 && sizeof(SnapshotHeaderV2) == 56 && sizeof(SnapshotCourseV2) == 8,
+	"snapshot records must have fixed sizes");
+
+//The writer and the loader copy integers in host order, which is only the format's order on a little endian host. Every
+//Windows target is little endian; elsewhere the compiler reports the byte order.
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "snapshots are read and written in host byte order, which must be little endian"
+#endif
+
+const uint32_t snapshotVersion = 3;
+
+uint64_t fnv1a(const char* data, const size_t& size, uint64_t h = 14695981039346656037ULL)
+{
+	for (size_t i = 0; i < size; i++)
+	{
+		h ^= uint8_t(data[i]);
+		h *= 1099511628211ULL;
+	}
+
+	return h;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//The mutations a write-ahead log records
+enum LogOperation : uint8_t
+{
+	logRegisterStudent = 1, //string firstName, string lastName, int32 d, m, y
+	logEnrolStudent, //int32 studentIndex, courseIndex
+	logRemoveStudent, //int32 studentIndex
+	logWithdrawStudent, //int32 studentIndex, courseIndex
+	logAssignLetterGrade, //int32 studentIndex, courseIndex, letterGrade
+	logOfferCourse, //string name, int32 creditHours
+	logRemoveCourse, //int32 courseIndex
+	logSetCourseCreditHours, //int32 courseIndex, creditHours
+	logSetCourseCapacity, //int32 courseIndex, capacity
+	logRequestSeat, //int32 studentIndex, courseIndex
+	logLeaveWaitlist //int32 studentIndex, courseIndex
+};
+
+//An append-only log of mutations. Each record is framed as
+//	uint32 length, uint64 sequence, uint8 operation, payload, uint32 checksum
+//where length counts the bytes from the sequence to the end of the payload and the checksum covers the same bytes.
+//Strings in payloads are a uint32 length followed by the characters. Records are buffered and written out together
+//with a single flush to disk once groupCommitSize of them are pending (group commit), so with a group size of 1
+//every mutation is durable when it returns and larger groups trade a bounded window of loss for throughput.
+class WriteAheadLog
+{
+private:
+	string buffer; //Records not written to the file yet
+	size_t recordStart; //Where the record being built starts within the buffer
+	int pendingRecords;
+	int groupCommitSize;
+	bool failed; //Set once a write or flush to disk fails
+#ifdef _WIN32
+	HANDLE file;
+#else
+	int fd;
+#endif
+
+public:
+	WriteAheadLog();
+	WriteAheadLog(const WriteAheadLog&) = delete;
+	WriteAheadLog& operator = (const WriteAheadLog&) = delete;
+	~WriteAheadLog(); //Write out pending records and close the file
+
+	bool open(const string& path, const int& groupCommitSize); //Open (or create) the log for appending. Return false on an I/O error.
+	void close(); //Write out pending records and close the file
+	bool isOpen() const;
+	bool good() const; //Return false if any write or flush to disk has failed
+	int getGroupCommitSize() const;
+	void setGroupCommitSize(const int&);
+
+	void beginRecord(const uint64_t& sequence, const uint8_t& operation);
+	void putInt(const int32_t&);
+	void putString(const string_view&);
+	void endRecord(); //Close the record and, once a group is complete, commit it
+	bool sync(); //Write out and flush every pending record now. Return false on an I/O error.
+	bool truncate(); //Commit and then discard every record in the file
+};
+
+WriteAheadLog::WriteAheadLog()
+{
+	recordStart = 0;
+	pendingRecords = 0;
+	groupCommitSize = 1;
+	failed = false;
+#ifdef _WIN32
+	file = INVALID_HANDLE_VALUE;
+#else
+	fd = -1;
+#endif
+}
+
+WriteAheadLog::~WriteAheadLog()
+{
+	close();
+}
+
+bool WriteAheadLog::open(const string& path, const int& groupCommitSize)
+{
+	assert(groupCommitSize >= 1);
+
+	close();
+	this->groupCommitSize = groupCommitSize;
+	failed = false;
+
+#ifdef _WIN32
+	file = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER zero;
+	zero.QuadPart = 0;
+	SetFilePointerEx(file, zero, nullptr, FILE_END);
+#else
+	fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+	if (fd == -1)
+		return false;
+#endif
+
+	return true;
+}
+
+void WriteAheadLog::close()
+{
+	if (!isOpen())
+		return;
+
+	sync();
+#ifdef _WIN32
+	CloseHandle(file);
+	file = INVALID_HANDLE_VALUE;
+#else
+	::close(fd);
+	fd = -1;
+#endif
+}
+
+bool WriteAheadLog::isOpen() const
+{
+#ifdef _WIN32
+	return file != INVALID_HANDLE_VALUE;
+#else
+	return fd != -1;
+#endif
+}
+
+bool WriteAheadLog::good() const
+{
+	return !failed;
+}
+
+int WriteAheadLog::getGroupCommitSize() const
+{
+	return groupCommitSize;
+}
+
+void WriteAheadLog::setGroupCommitSize(const int& groupCommitSize)
+{
+	assert(groupCommitSize >= 1);
+
+	this->groupCommitSize = groupCommitSize;
+	if (pendingRecords >= groupCommitSize)
+		sync();
+}
+
+void WriteAheadLog::beginRecord(const uint64_t& sequence, const uint8_t& operation)
+{
+	recordStart = buffer.size();
+	buffer.append(4, '\0'); //The length, filled in by endRecord
+	buffer.append(reinterpret_cast<const char*>(&sequence), sizeof sequence);
+	buffer.push_back(char(operation));
+}
+
+void WriteAheadLog::putInt(const int32_t& value)
+{
+	buffer.append(reinterpret_cast<const char*>(&value), sizeof value);
+}
+
+void WriteAheadLog::putString(const string_view& value)
+{
+	uint32_t length = uint32_t(value.size());
+	buffer.append(reinterpret_cast<const char*>(&length), sizeof length);
+	buffer.append(value);
+}
+
+void WriteAheadLog::endRecord()
+{
+	uint32_t length = uint32_t(buffer.size() - recordStart - 4);
+	memcpy(&buffer[recordStart], &length, sizeof length);
+
+	uint32_t checksum = uint32_t(fnv1a(buffer.data() + recordStart + 4, length));
+	buffer.append(reinterpret_cast<const char*>(&checksum), sizeof checksum);
+
+	if (++pendingRecords >= groupCommitSize)
+		sync();
+}
+
+bool WriteAheadLog::sync()
+{
+	if (!isOpen())
+		return false;
+	if (pendingRecords == 0)
+		return !failed;
+
+#ifdef _WIN32
+	DWORD written = 0;
+	if (!WriteFile(file, buffer.data(), DWORD(buffer.size()), &written, nullptr) || written != buffer.size() || !FlushFileBuffers(file))
+		failed = true;
+#else
+	for (size_t done = 0; done < buffer.size();)
+	{
+		ssize_t n = ::write(fd, buffer.data() + done, buffer.size() - done);
+		if (n <= 0)
+		{
+			failed = true;
+			break;
+		}
+		done += size_t(n);
+	}
+	if (fdatasync(fd) != 0)
+		failed = true;
+#endif
+
+	buffer.clear();
+	pendingRecords = 0;
+
+	return !failed;
+}
+
+bool WriteAheadLog::truncate()
+{
+	if (!sync())
+		return false;
+
+#ifdef _WIN32
+	LARGE_INTEGER zero;
+	zero.QuadPart = 0;
+	if (!SetFilePointerEx(file, zero, nullptr, FILE_BEGIN) || !SetEndOfFile(file) || !FlushFileBuffers(file))
+		failed = true;
+#else
+	if (ftruncate(fd, 0) != 0 || fsync(fd) != 0)
+		failed = true;
+#endif
+
+	return !failed;
+}
+
+//Reads the fields of one log record payload in order. Every getter returns false once the payload runs out.
+class LogPayloadReader
+{
+private:
+	const char* p;
+	const char* end;
+
+public:
+	LogPayloadReader(const char* data, const size_t& size);
+
+	bool getInt(int32_t&);
+	bool getString(string&);
+	bool atEnd() const;
+};
+
+LogPayloadReader::LogPayloadReader(const char* data, const size_t& size)
+{
+	p = data;
+	end = data + size;
+}
+
+bool LogPayloadReader::getInt(int32_t& value)
+{
+	if (size_t(end - p) < sizeof value)
+		return false;
+
+	memcpy(&value, p, sizeof value);
+	p += sizeof value;
+	return true;
+}
+
+bool LogPayloadReader::getString(string& value)
+{
+	uint32_t length;
+	if (size_t(end - p) < sizeof length)
+		return false;
+
+	memcpy(&length, p, sizeof length);
+	p += sizeof length;
+	if (size_t(end - p) < length)
+		return false;
+
+	value.assign(p, length);
+	p += length;
+	return true;
+}
+
+bool LogPayloadReader::atEnd() const
+{
+	return p == end;
+}
+
+//Write head and then body to path.tmp, flush it to disk and rename it over path. A crash at any point leaves path
+//with either its old contents or all of the new ones, and once this returns true the new contents survive a crash.
+bool replaceFileDurably(const string& path, const string_view& head, const string_view& body)
+{
+	string temporaryPath = path + ".tmp";
+	const string_view parts[2] = { head, body };
+#ifdef _WIN32
+	HANDLE file = CreateFileA(temporaryPath.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	bool ok = true;
+	for (int i = 0; i < 2 && ok; i++)
+	{
+		for (size_t done = 0; done < parts[i].size() && ok;)
+		{
+			DWORD written = 0;
+			DWORD chunk = DWORD(min(parts[i].size() - done, size_t(1) << 30));
+			ok = WriteFile(file, parts[i].data() + done, chunk, &written, nullptr) && written > 0;
+			done += written;
+		}
+	}
+	ok = ok && FlushFileBuffers(file);
+	CloseHandle(file);
+
+	//MOVEFILE_WRITE_THROUGH returns only once the rename itself is on disk
+	if (!ok || !MoveFileExA(temporaryPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+	{
+		DeleteFileA(temporaryPath.c_str());
+		return false;
+	}
+	return true;
+#else
+	int fd = ::open(temporaryPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1)
+		return false;
+
+	bool ok = true;
+	for (int i = 0; i < 2 && ok; i++)
+	{
+		for (size_t done = 0; done < parts[i].size() && ok;)
+		{
+			ssize_t n = ::write(fd, parts[i].data() + done, parts[i].size() - done);
+			ok = n > 0;
+			done += ok ? size_t(n) : 0;
+		}
+	}
+	ok = fsync(fd) == 0 && ok;
+	ok = ::close(fd) == 0 && ok;
+	if (!ok || rename(temporaryPath.c_str(), path.c_str()) != 0)
+	{
+		unlink(temporaryPath.c_str());
+		return false;
+	}
+
+	//The rename is only durable once the directory holding both names is flushed too
+	size_t slash = path.find_last_of('/');
+	string directory = slash == string::npos ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+	int directoryFd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+	if (directoryFd == -1)
+		return false;
+	ok = fsync(directoryFd) == 0;
+	::close(directoryFd);
+	return ok;
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//Splits CSV text into rows of fields without copying anything: every field is a view into the text. A field may be
+//quoted to contain commas, but doubled quotes inside a quoted field are rejected because unescaping them would need
+//a copy. Both \n and \r\n line endings are accepted and empty lines are skipped.
+class CsvReader
+{
+private:
+	const char* p;
+	const char* end;
+	int line; //The line number of the row read last
+
+public:
+	CsvReader(const char* data, const size_t& size);
+
+	int getLine() const; //Return the line number of the row read last (the first line is line 1)
+	int countRows() const; //Return an upper bound on the number of rows left to read, for reserving space
+	bool nextRow(string_view* fields, const int& maxFields, int& fieldCount, string& error);
+							//Read the next row into fields. Return false at the end of the text. If the row is malformed
+							//or has more than maxFields fields, error says why and the row should be skipped.
+};
+
+CsvReader::CsvReader(const char* data, const size_t& size)
+{
+	p = data;
+	end = data + size;
+	line = 0;
+}
+
+int CsvReader::getLine() const
+{
+	return line;
+}
+
+int CsvReader::countRows() const
+{
+	int rows = 0;
+	for (const char* q = p; q < end; q++)
+	{
+		q = static_cast<const char*>(memchr(q, '\n', size_t(end - q)));
+		rows++;
+		if (q == nullptr)
+			break;
+	}
+
+	return rows;
+}
+
+bool CsvReader::nextRow(string_view* fields, const int& maxFields, int& fieldCount, string& error)
+{
+	error.clear();
+	fieldCount = 0;
+
+	//Skip empty lines
+	while (p < end && (*p == '\n' || *p == '\r'))
+	{
+		if (*p == '\n')
+			line++;
+		p++;
+	}
+	if (p == end)
+		return false;
+
+	line++;
+	const char* eol = static_cast<const char*>(memchr(p, '\n', size_t(end - p)));
+	if (eol == nullptr)
+		eol = end;
+	const char* rowEnd = (eol > p && eol[-1] == '\r') ? eol - 1 : eol;
+
+	while (error.empty())
+	{
+		const char* fieldStart = p;
+		const char* fieldEnd;
+		if (p < rowEnd && *p == '"')
+		{
+			fieldStart = ++p;
+			while (p < rowEnd && *p != '"')
+				p++;
+			fieldEnd = p;
+			if (p == rowEnd)
+				error = "unterminated quoted field";
+			else if (++p < rowEnd && *p != ',')
+				error = *p == '"' ? "escaped quotes are not supported" : "text after a quoted field";
+		}
+		else
+		{
+			while (p < rowEnd && *p != ',')
+				p++;
+			fieldEnd = p;
+		}
+
+		if (!error.empty())
+			break;
+		if (fieldCount == maxFields)
+		{
+			error = "too many fields";
+			break;
+		}
+		fields[fieldCount++] = string_view(fieldStart, size_t(fieldEnd - fieldStart));
+
+		if (p == rowEnd)
+			break;
+		p++; //The comma
+	}
+
+	p = eol < end ? eol + 1 : end;
+
+	return true;
+}
+
+bool parseInt(const string_view& field, int& value) //Parse a whole field as a decimal integer
+{
+	const char* last = field.data() + field.size();
+	from_chars_result result = from_chars(field.data(), last, value);
+	return field.size() > 0 && result.ec == errc() && result.ptr == last;
+}
+
+struct ImportError
+{
+	int line; //The line of the file the rejected row is on, or 0 if the file could not be read
+	string message;
+};
+
+struct ImportReport
+{
+	int rows; //The number of data rows read
+	int imported; //The number of rows applied to the system
+	SmarterArray<ImportError> errors; //Why each of the other rows was rejected
+};
+
+const int unlimitedSeats = INT32_MAX; //The capacity of a course without a seat limit
+
+//What requestSeat did with a request
+enum SeatStatus : uint8_t
+{
+	seatRejected, //The student is already enrolled in or waiting for the course, or has the most enrolments allowed
+	seatTaken, //The student is enrolled
+	seatWaitlisted //The course is full and the student joined the end of its waitlist
+};
+
+struct EnrolmentOperation
+{
+	enum Kind : uint8_t { enrol, withdraw, grade };
+
+	Kind kind;
+	int studentIndex;
+	int courseIndex;
+	char letterGrade; //The grade to assign. Only used by grade operations.
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//A fixed set of worker threads for splitting a loop across cores. parallelFor cuts the range into chunks that the
+//workers and the calling thread claim one at a time from a shared counter, so a thread that finishes its chunks early
+//takes over the ones still unclaimed instead of waiting for the slowest. One loop runs at a time; parallelFor must not
+//be called from inside a loop body or from two threads at once.
+
+class ThreadPool
+{
+private:
+	SmarterArray<thread> workers;
+	mutex lock;
+	condition_variable wake; //Signalled when a loop starts or the pool shuts down
+	condition_variable finished; //Signalled when the last worker leaves a loop
+	const function<void(const int&, const int&)>* body; //The body of the running loop
+	int count; //The size of the range of the running loop
+	int chunkSize;
+	atomic<int> nextChunk; //The first index of the next unclaimed chunk
+	int busyWorkers; //The number of workers still inside the running loop
+	uint64_t generation; //Counts the loops started, so that a worker joins each one exactly once
+	bool stopping;
+
+	void work(); //The loop each worker runs until the pool shuts down
+	void runChunks(); //Claim and run chunks of the running loop until none are left
+
+public:
+	explicit ThreadPool(const int& threadCount); //threadCount counts the calling thread, so threadCount - 1 workers start
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator = (const ThreadPool&) = delete;
+	~ThreadPool();
+
+	int getThreadCount() const;
+	void parallelFor(const int& count, const function<void(const int&, const int&)>& body); //Call body(begin, end) over
+																						//chunks that cover [0, count) and
+																						//return once all are done
+};
+
+ThreadPool::ThreadPool(const int& threadCount)
+{
+	assert(threadCount >= 1);
+
+	body = nullptr;
+	count = 0;
+	chunkSize = 1;
+	nextChunk = 0;
+	busyWorkers = 0;
+	generation = 0;
+	stopping = false;
+	workers.reserve(threadCount - 1);
+	for (int i = 1; i < threadCount; i++)
+		workers.append(thread(&ThreadPool::work, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		lock_guard<mutex> guard(lock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (int i = 0; i < workers.getSize(); i++)
+		workers[i].join();
+}
+
+int ThreadPool::getThreadCount() const
+{
+	return workers.getSize() + 1;
+}
+
+void ThreadPool::work()
+{
+	uint64_t seen = 0;
+	while (true)
+	{
+		{
+			unique_lock<mutex> guard(lock);
+			wake.wait(guard, [&]() { return stopping || generation != seen; });
+			if (stopping)
+				return;
+			seen = generation;
+		}
+
+		runChunks();
+
+		lock_guard<mutex> guard(lock);
+		if (--busyWorkers == 0)
+			finished.notify_one();
+	}
+}
+
+void ThreadPool::runChunks()
+{
+	while (true)
+	{
+		int begin = nextChunk.fetch_add(chunkSize);
+		if (begin >= count)
+			return;
+		(*body)(begin, min(begin + chunkSize, count));
+	}
+}
+
+void ThreadPool::parallelFor(const int& count, const function<void(const int&, const int&)>& body)
+{
+	assert(count >= 0);
+
+	if (count == 0)
+		return;
+
+	{
+		lock_guard<mutex> guard(lock);
+		assert(busyWorkers == 0);
+		this->body = &body;
+		this->count = count;
+		//Several chunks per thread keep the threads balanced when chunks take uneven time, without making the shared
+		//counter a bottleneck on short ranges
+		chunkSize = max(1, count / (getThreadCount() * 16));
+		nextChunk = 0;
+		busyWorkers = workers.getSize();
+		generation++;
+	}
+	wake.notify_all();
+
+	runChunks();
+
+	unique_lock<mutex> guard(lock);
+	finished.wait(guard, [&]() { return busyWorkers == 0; });
+	this->body = nullptr;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//A frozen, read-only copy of a SchoolManagementSystem as of one mutation, for reports that must not see later ones.
+//Taking one is O(1) whatever the size of the system: it shares every chunk of the system's storage, and a later
+//mutation of the system copies only the chunks it writes. A snapshot may be read by any number of threads, and kept
+//while the system it came from goes on changing or is destroyed.
+
+class SchoolSnapshot
+{
+private:
+	StudentTable studentTable;
+	CowArray<Course, 8> courseList;
+	EnrolmentStore enrolmentStore;
+	CowArray<GradeTotals, 12> studentTotalsList;
+	uint64_t sequence; //The sequence number of the last mutation the snapshot includes
+
+	SchoolSnapshot(const StudentTable&, const CowArray<Course, 8>&, const EnrolmentStore&, const CowArray<GradeTotals, 12>&,
+		const uint64_t& sequence);
+
+public:
+	int getNumberOfRegisteredStudents() const;
+	int getNumberOfCoursesOffered() const;
+	uint64_t getSequence() const; //Return the sequence number (see SchoolManagementSystem::getLogSequence) it was taken at
+
+	StudentView viewStudent(const int& studentIndex) const;
+	Student getStudent(const int& studentIndex) const; //Return a copy of the student
+	StudentMapView viewStudentMap(const int& studentIndex) const;
+	double getStudentGPA(const int& studentIndex) const;
+	CourseView viewCourse(const int& courseIndex) const;
+	Course getCourse(const int& courseIndex) const; //Return a copy of the course
+
+	friend class SchoolManagementSystem;
+	friend ostream& operator << (ostream&, const SchoolSnapshot&);
+};
+
+SchoolSnapshot::SchoolSnapshot(const StudentTable& students, const CowArray<Course, 8>& courses, const EnrolmentStore& enrolments,
+	const CowArray<GradeTotals, 12>& totals, const uint64_t& sequence) :
+	studentTable(students), courseList(courses), enrolmentStore(enrolments), studentTotalsList(totals), sequence(sequence) {}
+
+int SchoolSnapshot::getNumberOfRegisteredStudents() const
+{
+	return studentTable.getSize();
+}
+
+int SchoolSnapshot::getNumberOfCoursesOffered() const
+{
+	return courseList.getSize();
+}
+
+uint64_t SchoolSnapshot::getSequence() const
+{
+	return sequence;
+}
+
+StudentView SchoolSnapshot::viewStudent(const int& studentIndex) const
+{
+	assert(studentIndex >= 0 && studentIndex < studentTable.getSize());
+
+	return studentTable.view(studentIndex);
+}
+
+Student SchoolSnapshot::getStudent(const int& studentIndex) const
+{
+	assert(studentIndex >= 0 && studentIndex < studentTable.getSize());
+
+	return studentTable.getStudent(studentIndex);
+}
+
+StudentMapView SchoolSnapshot::viewStudentMap(const int& studentIndex) const
+{
+	assert(studentIndex >= 0 && studentIndex < enrolmentStore.getSize());
+
+	return StudentMapView(enrolmentStore.getEnrolments(studentIndex), enrolmentStore.getCount(studentIndex));
+}
+
+double SchoolSnapshot::getStudentGPA(const int& studentIndex) const
+{
+	assert(studentIndex >= 0 && studentIndex < studentTable.getSize());
+
+	return studentTotalsList[studentIndex].getGPA();
+}
+
+CourseView SchoolSnapshot::viewCourse(const int& courseIndex) const
+{
+	assert(courseIndex >= 0 && courseIndex < courseList.getSize());
+
+	return CourseView(courseList[courseIndex].getCourseName(), courseList[courseIndex].getCreditHours());
+}
+
+Course SchoolSnapshot::getCourse(const int& courseIndex) const
+{
+	assert(courseIndex >= 0 && courseIndex < courseList.getSize());
+
+	return courseList[courseIndex];
+}
+
+ostream& operator << (ostream& out, const SchoolSnapshot& snapshot)
+{
+	//Lines end in '\n' rather than endl, which would flush the stream after every one of them
+	out << "\nStudents List\n";
+	if (snapshot.studentTable.getSize() == 0)
+		out << "No student has been registered yet.\n";
+	for (int studentIndex = 0; studentIndex < snapshot.studentTable.getSize(); studentIndex++)
+		out << "Student at index " << studentIndex << ": " << snapshot.studentTable.view(studentIndex) << '\n';
+
+	out << "\nCourses List\n";
+	if (snapshot.courseList.getSize() == 0)
+		out << "No course has been offered yet.\n";
+	for (int courseIndex = 0; courseIndex < snapshot.courseList.getSize(); courseIndex++)
+		out << "Course at index " << courseIndex << ": " << snapshot.courseList[courseIndex] << '\n';
+
+	out << "\nStudents Map\n";
+	if (snapshot.enrolmentStore.getSize() == 0)
+		out << "No student is enrolled in any course yet.\n";
+	for (int studentIndex = 0; studentIndex < snapshot.enrolmentStore.getSize(); studentIndex++)
+	{
+		out << "Student at index " << studentIndex << '\n';
+		out << snapshot.viewStudentMap(studentIndex);
+		out << "GPA = " << snapshot.getStudentGPA(studentIndex) << "\n\n";
+	}
+	return out << flush;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class SchoolManagementSystem
+{
+private:
+	struct WaitlistEntry
+	{
+		StudentId student;
+		CourseId course; //An id rather than an index, so the place needs no update when another course moves
+		int previous, next; //Positions in waitlistEntryList of the places before and after this one, or -1
+	};
+
+	struct Waitlist
+	{
+		int first, last; //Positions in waitlistEntryList of the first and last places in line, or -1 if none
+		int size;
+	};
+
+	StudentTable studentTable; //The students in the school, stored column by column
+	CowArray<Course, 8> courseList; //The courses in the school
+	EnrolmentStore enrolmentStore; //The courses and letter grades of the students, kept in step with studentTable
+	HashIndex studentNameIndex; //Positions in studentTable hashed by (first name, last name)
+	CowArray<GradeTotals, 12> studentTotalsList; //The running GPA totals of the students, kept in step with enrolmentStore
+	StudentRankIndex studentRankIndex; //The students ranked by GPA, kept in step with studentTotalsList
+	SmarterArray<SmarterArray<int>> courseRosterList; //The indices of the students enrolled in each course, kept in step
+													//with enrolmentStore, which holds each student's slot in them
+	SlotMap studentIds; //The stable ids of the students, kept in step with studentTable
+	SlotMap courseIds; //The stable ids of the courses, kept in step with courseList
+	SmarterArray<int> courseCapacityList; //The seat limit of each course, or unlimitedSeats, kept in step with courseList
+	SmarterArray<Waitlist> courseWaitlistList; //The students waiting for a seat in each course, first come first served,
+												//kept in step with courseList. Never holds anyone while the course
+												//has a free seat.
+	SmarterArray<WaitlistEntry> waitlistEntryList; //Every place on a waitlist, in no particular order. The places of each
+												//course are linked in line order, so any of them is unlinked in O(1).
+	HashIndex waitlistEntryIndex; //Positions in waitlistEntryList hashed by (student id, course id)
+	HashIndex waitlistStudentIndex; //Positions in waitlistEntryList hashed by student id, to find a student's places
+	WriteAheadLog* log; //Where mutations are logged, or nullptr. Not owned.
+	pmr::memory_resource* storageResource; //Where enrolments and name search lists are allocated from. Not owned.
+	uint64_t logSequence; //The sequence number of the last mutation (counted whether or not a log is attached)
+
+	HashIndex courseNameIndex; //Positions in courseList hashed by course name
+	NameSearchIndex courseNameSearch; //The courses' ids by name, for typeahead and fuzzy search
+	NameSearchIndex studentLastNameSearch; //The students' ids by last name, for typeahead and fuzzy search
+	NameSearchIndex studentFirstNameSearch; //The students' ids by first name, for typeahead only
+
+	static size_t combineNameHashes(const uint32_t& firstNameHash, const uint32_t& lastNameHash); //Combine the NamePool::hashName
+																								//hashes of a student's names
+	static size_t hashStudentName(const Symbol& firstName, const Symbol& lastName);
+	GradeTotals computeStudentTotals(const int& studentIndex) const; //Recompute the GPA totals of a student from its map
+	void updateStudentRank(const int& studentIndex); //Re-rank a student after its GPA totals changed
+	bool beginLogRecord(const uint8_t& operation); //Number a mutation and, if a log is attached, start its record.
+												//Return true if the caller should fill in and end the record.
+	bool applyLogRecord(const uint8_t& operation, LogPayloadReader& payload); //Validate and apply one logged mutation
+	void reserveStudents(const int& count); //Make room for count more students in every per-student list
+	void reserveCourses(const int& count); //Make room for count more courses in every per-course list
+	static size_t hashStudentId(const StudentId&);
+	static size_t hashWaitlistPlace(const StudentId&, const CourseId&);
+	int findWaitlistEntry(const StudentId& id, const int& courseIndex) const; //Return the position in waitlistEntryList, or -1
+	int findAnyWaitlistEntry(const StudentId& id) const; //Return the position of any of the student's places, or -1
+	void addWaitlistEntry(const StudentId& id, const int& courseIndex); //Put the student at the back of the course's line
+	void eraseWaitlistEntry(int position); //Take the place out of its line and out of waitlistEntryList
+	void seatStudent(const int& studentIndex, const int& courseIndex); //Enrol a student without checks or logging
+	void removeFromRoster(const int& courseIndex, const int& rosterSlot); //Move the last student of the roster into the
+																		//slot and record its new slot. O(1).
+	void promoteWaitlisted(const int& courseIndex); //Give the free seats of a course to the front of its waitlist
+
+public:
+	SchoolManagementSystem();
+	SchoolManagementSystem(const SchoolManagementSystem&) = delete; //A copy would append to the same log as the original
+																	//with diverging sequence numbers. Use takeSnapshot
+																	//or saveSnapshot to keep a copy of the data.
+	SchoolManagementSystem(SchoolManagementSystem&&) = default;
+	SchoolManagementSystem& operator = (const SchoolManagementSystem&) = delete;
+	SchoolManagementSystem& operator = (SchoolManagementSystem&&) = default;
+
+	int getNumberOfRegisteredStudents() const;
+	int getNumberOfCoursesOffered() const;
+
+	int findStudent(const string_view& firstName, const string_view& lastName) const;
+	int findStudent(const Symbol& firstName, const Symbol& lastName) const;
+	Student getStudent(const int& studentIndex) const; //Return a copy of the student. Use viewStudent to read it in place.
+	StudentMap getStudentMap(const int& studentIndex) const; //Return a copy of the student's map. Use viewStudentMap to read
+															//it in place.
+	StudentView viewStudent(const int& studentIndex) const;
+	StudentMapView viewStudentMap(const int& studentIndex) const;
+	StudentId getStudentId(const int& studentIndex) const;
+	int getStudentIndex(const StudentId& id) const; //Return the current index of the student with the given id, or -1 if removed
+	bool registerStudent(const Student& s);
+	bool enrolStudent(const int& studentIndex, const int& courseIndex); //Fails if the course has no free seat
+	void removeStudent(const int& studentIndex); //Remove a student. The last student moves into its index. The seats
+												//it frees go to the waitlists of its courses. Each course the student
+												//or the moved student is enrolled in and each waitlist place is O(1).
+	bool withdrawStudent(const int& studentIndex, const int& courseIndex); //The seat freed goes to the front of the
+																		//course's waitlist
+	SeatStatus requestSeat(const int& studentIndex, const int& courseIndex); //Enrol the student if the course has a free
+																			//seat, or else add it to the waitlist
+	SeatStatus previewSeatRequest(const int& studentIndex, const int& courseIndex) const; //Return what requestSeat would
+																						//do now, without doing it
+	bool leaveWaitlist(const int& studentIndex, const int& courseIndex); //Return false if the student is not waiting for the course
+	bool assignLetterGrade(const int& studentIndex, const int& courseIndex, const char& letterGrade);
+	bool applyBatch(const SmarterArray<EnrolmentOperation>& operations, int* failedOperation = nullptr); //Apply the
+								//operations as if by the matching calls in order, each student's in one pass. If any of
+								//those calls would fail (or assert), apply none and, if given, set *failedOperation to
+								//the position of the first such operation. A withdrawal from a course with a waitlist
+								//would enrol another student, so it fails the batch too.
+	double getStudentGPA(const int& studentIndex) const;
+	int getTopStudentIndex() const; //Return the index of the student with the highest GPA (the lowest index among ties), or -1
+	SmarterArray<int> getTopStudentIndices(const int& k) const; //Return the indices of the k students with the highest GPAs, best first
+	int getStudentRank(const int& studentIndex) const; //Return the rank of a student by GPA. The top student has rank 1.
+	SmarterArray<int> getStudentsInGPARange(const double& minGPA, const double& maxGPA) const; //Return the indices of the
+																							//students with minGPA <= GPA <= maxGPA, best first
+	SmarterArray<int> getStudentsBornIn(const int& fromYear, const int& toYear) const; //Return the indices of the students
+																						//born in the years fromYear to toYear, in order
+	bool checkGPACache() const; //Return true if the cached GPA totals of every student match a full recompute
+
+	//End of term batch: recompute every GPA from the grades themselves rather than the cached totals, split across the
+	//threads of a pool, or on the calling thread alone if pool is nullptr. The results do not depend on the thread count.
+	void computeAllGPAs(double* gpas, const int& count, ThreadPool* pool = nullptr) const; //Fill gpas[i] with the GPA
+																						//of student i; count must
+																						//equal the number of students
+	SmarterArray<int> computeTopStudentIndices(const int& k, ThreadPool* pool = nullptr) const; //Return the same students
+																							//as getTopStudentIndices(k),
+																							//ties broken the same way
+
+	int findCourse(const string_view& courseName) const;
+	int findCourse(const Symbol& courseName) const;
+	const Course& getCourse(const int& courseIndex) const;
+	CourseView viewCourse(const int& courseIndex) const;
+	CourseId getCourseId(const int& courseIndex) const;
+	int getCourseIndex(const CourseId& id) const; //Return the current index of the course with the given id, or -1 if removed
+	bool offerCourse(const Course& course);
+	void removeCourse(const int& courseIndex); //Remove a course. The last course moves into its index.
+	void setCourseCreditHours(const int& courseIndex, const int& creditHours);
+	const SmarterArray<int>& getCourseRoster(const int& courseIndex) const; //Return the indices of the students enrolled in a course,
+																		//in no particular order: a student leaving the
+																		//course is replaced by the last one
+	int getCourseCapacity(const int& courseIndex) const; //Return the seat limit of a course, or unlimitedSeats
+	void setCourseCapacity(const int& courseIndex, const int& capacity); //Students already enrolled keep their seats, even
+																		//past the new limit. Seats a higher limit frees
+																		//go to the waitlist.
+	SmarterArray<int> getWaitlist(const int& courseIndex) const; //Return the indices of the students waiting for a seat, first in line first
+
+	//Typeahead and fuzzy search. Names match ignoring ASCII case; at most maxResults indices are returned.
+	SmarterArray<int> findCoursesByPrefix(const string_view& prefix, const int& maxResults) const; //In name order
+	SmarterArray<int> findCoursesLike(const string_view& courseName, const int& maxDistance, const int& maxResults) const; //Return
+											//the courses whose names are within maxDistance edits of courseName, closest first
+	SmarterArray<int> findStudentsByPrefix(const string_view& lastNamePrefix, const string_view& firstNamePrefix,
+										const int& maxResults) const; //Return the students whose last and first names start
+																	//with the prefixes, in order of the first one given
+	SmarterArray<int> findStudentsLike(const string_view& lastName, const int& maxDistance, const int& maxResults) const; //Return
+											//the students whose last names are within maxDistance edits of lastName, closest first
+
+	bool saveSnapshot(const string& path) const; //Write the whole system to a binary snapshot file, through a temporary
+												//file flushed to disk and renamed over path, so a crash leaves the
+												//previous snapshot or the new one. Return false on an I/O error.
+	bool loadSnapshot(const string& path); //Replace the whole system with the contents of a snapshot file. Return false
+										//(leaving the system unchanged) if the file is missing, corrupt or of an unknown version.
+										//Version 2 files load with unlimited seats and no waitlists.
+
+	//Bulk CSV import. The first row of each file is a header and is skipped. Rows that fail validation are reported
+	//and skipped; every other row is applied through the regular mutators (so it is also logged).
+	ImportReport importStudentsCsv(const string& path); //Columns: firstName, lastName, day, month, year
+	ImportReport importCoursesCsv(const string& path); //Columns: name, creditHours
+	ImportReport importEnrolmentsCsv(const string& path); //Columns: firstName, lastName, courseName and optionally letterGrade
+
+	void setWriteAheadLog(WriteAheadLog* log); //Log every later mutation to the given open log, or stop logging if nullptr.
+											//The log is not owned and must outlive its use here.
+	void setStorageResource(pmr::memory_resource* resource); //Allocate the enrolment store and the lists of the name
+										//search indexes from the given resource from now on, or from the default
+										//resource if nullptr. The enrolments already stored move there at their next
+										//compaction, and loadSnapshot keeps the resource. It is not owned and must
+										//outlive the system and its snapshots, and be thread safe if snapshots are
+										//released on other threads.
+	uint64_t getLogSequence() const; //Return the sequence number of the last mutation
+	bool isLogging() const; //Return true if a log is attached
+	int replayLog(const string& path); //Apply the records of a log that follow the current sequence number. Stops at the
+										//first torn, corrupt or out of sequence record. Return the number of records applied.
+	bool recover(const string& snapshotPath, const string& logPath); //Load the snapshot (if it exists) and replay the log
+																	//on top of it. Return false if the snapshot is corrupt.
+	bool compact(const string& snapshotPath); //Fold the attached log into a new snapshot and empty the log.
+											//Return false (keeping the log) on an I/O error.
+
+	SchoolSnapshot takeSnapshot() const; //Return a frozen copy of the system as it is now. O(1).
+
+	friend ostream& operator << (ostream&, const SchoolManagementSystem&);
+	static Student generateRandomStudent();
+	static char generateRandomLetterGrade();
+};
+
+SchoolManagementSystem::SchoolManagementSystem() : courseNameSearch(true), studentLastNameSearch(true), studentFirstNameSearch(false)
+{
+	log = nullptr;
+	storageResource = pmr::get_default_resource();
+	logSequence = 0;
+}
+
+int SchoolManagementSystem::getNumberOfRegisteredStudents() const
+{
+	return studentTable.getSize();
+}
+
+int SchoolManagementSystem::getNumberOfCoursesOffered() const
+{
+	return courseList.getSize();
+}
+
+size_t SchoolManagementSystem::combineNameHashes(const uint32_t& firstNameHash, const uint32_t& lastNameHash)
+{
+	size_t h = firstNameHash;
+	h ^= lastNameHash + 0x9e3779b9 + (h << 6) + (h >> 2);
+	return h;
+}
+
+size_t SchoolManagementSystem::hashStudentName(const Symbol& firstName, const Symbol& lastName)
+{
+	return combineNameHashes(namePool().getHash(firstName), namePool().getHash(lastName));
+}
+
+int SchoolManagementSystem::findStudent(const string_view& firstName, const string_view& lastName) const
+{
+	//Hashing the strings directly saves looking both names up in the pool first
+	return studentNameIndex.find(combineNameHashes(NamePool::hashName(firstName), NamePool::hashName(lastName)), [&](const int& i)
+	{
+		return (studentTable.getFirstName(i) == firstName) && (studentTable.getLastName(i) == lastName);
+	});
+}
+
+int SchoolManagementSystem::findStudent(const Symbol& firstName, const Symbol& lastName) const
+{
+	return studentNameIndex.find(hashStudentName(firstName, lastName), [&](const int& i)
+	{
+		return (studentTable.getFirstNameSymbol(i) == firstName) && (studentTable.getLastNameSymbol(i) == lastName);
+	});
+}
+
+Student SchoolManagementSystem::getStudent(const int& studentIndex) const
+{
+	assert(studentIndex >= 0 && studentIndex < studentTable.getSize());
+
+	return studentTable.getStudent(studentIndex);
+}
+
+StudentMap SchoolManagementSystem::getStudentMap(const int& studentIndex) const
+{
+	return viewStudentMap(studentIndex).toStudentMap();
+}
+
+StudentView SchoolManagementSystem::viewStudent(const int& studentIndex) const
+{
+	assert(studentIndex >= 0 && studentIndex < studentTable.getSize());
+
+	return studentTable.view(studentIndex);
+}
+
+StudentMapView SchoolManagementSystem::viewStudentMap(const int& studentIndex) const
+{
+	assert(studentIndex >= 0 && studentIndex < enrolmentStore.getSize());
+
+	return StudentMapView(enrolmentStore.getEnrolments(studentIndex), enrolmentStore.getCount(studentIndex));
+}
+
+bool SchoolManagementSystem::registerStudent(const Student& s)
+{
+	if (findStudent(s.getFirstNameSymbol(), s.getLastNameSymbol()) != -1)
+		return false;
+
+	studentNameIndex.insert(hashStudentName(s.getFirstNameSymbol(), s.getLastNameSymbol()), studentTable.getSize());
+	studentTable.append(s.getFirstNameSymbol(), s.getLastNameSymbol(), s.getDob());
+	enrolmentStore.addStudent(0);
+	studentTotalsList.append(GradeTotals{ 0, 0 });
+	studentRankIndex.append(0.0);
+	studentIds.insert();
+	studentLastNameSearch.insert(s.getLastNameSymbol(), studentIds.getId(studentTable.getSize() - 1));
+	studentFirstNameSearch.insert(s.getFirstNameSymbol(), studentIds.getId(studentTable.getSize() - 1));
+
+	if (beginLogRecord(logRegisterStudent))
+	{
+		Date dob = s.getDob();
+		log->putString(s.getFirstName());
+		log->putString(s.getLastName());
+		log->putInt(dob.d);
+		log->putInt(dob.m);
+		log->putInt(dob.y);
+		log->endRecord();
+	}
+
+	return true;
+}
+
+bool SchoolManagementSystem::enrolStudent(const int& studentIndex, const int& courseIndex)
+{
+	assert(studentIndex >= 0 && studentIndex < studentTable.getSize());
+	assert(courseIndex >= 0 && courseIndex < courseList.getSize());
+
+	if (enrolmentStore.find(studentIndex, courseIndex) != -1 ||
+		enrolmentStore.getCount(studentIndex) == EnrolmentStore::maxEnrolmentsPerStudent ||
+		courseRosterList[courseIndex].getSize() >= courseCapacityList[courseIndex])
+		return false;
+
+	seatStudent(studentIndex, courseIndex);
+
+	if (beginLogRecord(logEnrolStudent))
+	{
+		log->putInt(studentIndex);
+		log->putInt(courseIndex);
+		log->endRecord();
+	}
+
+	return true;
+}
+
+StudentId SchoolManagementSystem::getStudentId(const int& studentIndex) const
+{
+	assert(studentIndex >= 0 && studentIndex < studentTable.getSize());
+
+	return studentIds.getId(studentIndex);
+}
+
+int SchoolManagementSystem::getStudentIndex(const StudentId& id) const
+{
+	return studentIds.find(id);
+}
+
+void SchoolManagementSystem::removeStudent(const int& studentIndex)
+{
+	assert(studentIndex >= 0 && studentIndex < studentTable.getSize());
+
+	//The last student moves into the removed student's index, so it is the only other student whose index changes
+	int last = studentTable.getSize() - 1;
+
+	//Waitlists hold ids, so only the removed student's own places need to go
+	StudentId id = studentIds.getId(studentIndex);
+	for (int p = findAnyWaitlistEntry(id); p != -1; p = findAnyWaitlistEntry(id))
+		eraseWaitlistEntry(p);
+	SmarterArray<int> freedCourses;
+	for (int i = 0; i < enrolmentStore.getCount(studentIndex); i++)
+	{
+		if (courseWaitlistList[enrolmentStore.getCourse(studentIndex, i)].size > 0)
+			freedCourses.append(enrolmentStore.getCourse(studentIndex, i));
+	}
+
+	studentNameIndex.erase(hashStudentName(studentTable.getFirstNameSymbol(studentIndex), studentTable.getLastNameSymbol(studentIndex)), studentIndex);
+	if (studentIndex != last)
+		studentNameIndex.replacePosition(hashStudentName(studentTable.getFirstNameSymbol(last), studentTable.getLastNameSymbol(last)), last, studentIndex);
+
+	for (int i = 0; i < enrolmentStore.getCount(studentIndex); i++)
+		removeFromRoster(enrolmentStore.getCourse(studentIndex, i), enrolmentStore.getRosterSlot(studentIndex, i));
+	if (studentIndex != last)
+	{
+		for (int i = 0; i < enrolmentStore.getCount(last); i++)
+			courseRosterList[enrolmentStore.getCourse(last, i)][enrolmentStore.getRosterSlot(last, i)] = studentIndex;
+	}
+
+	studentLastNameSearch.erase(studentTable.getLastNameSymbol(studentIndex), studentIds.getId(studentIndex));
+	studentFirstNameSearch.erase(studentTable.getFirstNameSymbol(studentIndex), studentIds.getId(studentIndex));
+
+	studentTable.swapRemove(studentIndex);
+	enrolmentStore.swapRemoveStudent(studentIndex);
+	studentTotalsList.swapRemove(studentIndex);
+	studentRankIndex.remove(studentIndex);
+	studentIds.swapRemove(studentIndex);
+
+	for (int i = 0; i < freedCourses.getSize(); i++)
+		promoteWaitlisted(freedCourses[i]);
+
+	if (beginLogRecord(logRemoveStudent))
+	{
+		log->putInt(studentIndex);
+		log->endRecord();
+	}
+}
+
+bool SchoolManagementSystem::withdrawStudent(const int& studentIndex, const int& courseIndex)
+{
+	assert(studentIndex >= 0 && studentIndex < studentTable.getSize());
+	assert(courseIndex >= 0 && courseIndex < courseList.getSize());
+
+	int i = enrolmentStore.find(studentIndex, courseIndex);
+	if (i == -1)
+		return false;
+
+	studentTotalsList.modify(studentIndex).subtract(enrolmentStore.getGrade(studentIndex, i), courseList[courseIndex].getCreditHours());
+	int rosterSlot = enrolmentStore.getRosterSlot(studentIndex, i);
+	enrolmentStore.remove(studentIndex, i);
+	updateStudentRank(studentIndex);
+
+	removeFromRoster(courseIndex, rosterSlot);
+	promoteWaitlisted(courseIndex);
+
+	if (beginLogRecord(logWithdrawStudent))
+	{
+		log->putInt(studentIndex);
+		log->putInt(courseIndex);
+		log->endRecord();
+	}
+
+	return true;
+}
+
+SeatStatus SchoolManagementSystem::requestSeat(const int& studentIndex, const int& courseIndex)
+{
+	assert(studentIndex >= 0 && studentIndex < studentTable.getSize());
+	assert(courseIndex >= 0 && courseIndex < courseList.getSize());
+
+	SeatStatus status = previewSeatRequest(studentIndex, courseIndex);
+	if (status == seatRejected)
+		return seatRejected;
+
+	if (status == seatTaken)
+		seatStudent(studentIndex, courseIndex);
+	else
+		addWaitlistEntry(studentIds.getId(studentIndex), courseIndex);
+
+	if (beginLogRecord(logRequestSeat))
+	{
+		log->putInt(studentIndex);
+		log->putInt(courseIndex);
+		log->endRecord();
+	}
+
+	return status;
+}
+
+SeatStatus SchoolManagementSystem::previewSeatRequest(const int& studentIndex, const int& courseIndex) const
+{
+	assert(studentIndex >= 0 && studentIndex < studentTable.getSize());
+	assert(courseIndex >= 0 && courseIndex < courseList.getSize());
+
+	if (enrolmentStore.find(studentIndex, courseIndex) != -1 ||
+		enrolmentStore.getCount(studentIndex) == EnrolmentStore::maxEnrolmentsPerStudent ||
+		findWaitlistEntry(studentIds.getId(studentIndex), courseIndex) != -1)
+		return seatRejected;
+
+	return courseRosterList[courseIndex].getSize() < courseCapacityList[courseIndex] ? seatTaken : seatWaitlisted;
+}
+
+bool SchoolManagementSystem::leaveWaitlist(const int& studentIndex, const int& courseIndex)
+{
+	assert(studentIndex >= 0 && studentIndex < studentTable.getSize());
+	assert(courseIndex >= 0 && courseIndex < courseList.getSize());
+
+	StudentId id = studentIds.getId(studentIndex);
+	int p = findWaitlistEntry(id, courseIndex);
+	if (p == -1)
+		return false;
+
+	eraseWaitlistEntry(p);
+
+	if (beginLogRecord(logLeaveWaitlist))
+	{
+		log->putInt(studentIndex);
+		log->putInt(courseIndex);
+		log->endRecord();
+	}
+
+	return true;
+}
+
+size_t SchoolManagementSystem::hashStudentId(const StudentId& id)
+{
+	return size_t((uint64_t(id) * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+size_t SchoolManagementSystem::hashWaitlistPlace(const StudentId& student, const CourseId& course)
+{
+	return size_t(((uint64_t(student) << 32 | course) * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+int SchoolManagementSystem::findWaitlistEntry(const StudentId& id, const int& courseIndex) const
+{
+	CourseId course = courseIds.getId(courseIndex);
+	return waitlistEntryIndex.find(hashWaitlistPlace(id, course), [&](const int& i)
+	{
+		return waitlistEntryList[i].student == id && waitlistEntryList[i].course == course;
+	});
+}
+
+int SchoolManagementSystem::findAnyWaitlistEntry(const StudentId& id) const
+{
+	return waitlistStudentIndex.find(hashStudentId(id), [&](const int& i) { return waitlistEntryList[i].student == id; });
+}
+
+void SchoolManagementSystem::addWaitlistEntry(const StudentId& id, const int& courseIndex)
+{
+	int position = waitlistEntryList.getSize();
+	Waitlist& waitlist = courseWaitlistList[courseIndex];
+	waitlistEntryList.append(WaitlistEntry{ id, courseIds.getId(courseIndex), waitlist.last, -1 });
+	if (waitlist.last == -1)
+		waitlist.first = position;
+	else
+		waitlistEntryList[waitlist.last].next = position;
+	waitlist.last = position;
+	waitlist.size++;
+
+	waitlistEntryIndex.insert(hashWaitlistPlace(id, waitlistEntryList[position].course), position);
+	waitlistStudentIndex.insert(hashStudentId(id), position);
+}
+
+void SchoolManagementSystem::eraseWaitlistEntry(int position) //position is taken by value because it may alias a line's first
+{
+	//Unlink the place from its line
+	const WaitlistEntry& e = waitlistEntryList[position];
+	Waitlist& waitlist = courseWaitlistList[courseIds.find(e.course)];
+	if (e.previous == -1)
+		waitlist.first = e.next;
+	else
+		waitlistEntryList[e.previous].next = e.next;
+	if (e.next == -1)
+		waitlist.last = e.previous;
+	else
+		waitlistEntryList[e.next].previous = e.previous;
+	waitlist.size--;
+	waitlistEntryIndex.erase(hashWaitlistPlace(e.student, e.course), position);
+	waitlistStudentIndex.erase(hashStudentId(e.student), position);
+
+	//The last place moves into the position, so its neighbours (or its line's ends) must point at the new position
+	int last = waitlistEntryList.getSize() - 1;
+	if (position != last)
+	{
+		const WaitlistEntry& moved = waitlistEntryList[last];
+		Waitlist& movedWaitlist = courseWaitlistList[courseIds.find(moved.course)];
+		if (moved.previous == -1)
+			movedWaitlist.first = position;
+		else
+			waitlistEntryList[moved.previous].next = position;
+		if (moved.next == -1)
+			movedWaitlist.last = position;
+		else
+			waitlistEntryList[moved.next].previous = position;
+		waitlistEntryIndex.replacePosition(hashWaitlistPlace(moved.student, moved.course), last, position);
+		waitlistStudentIndex.replacePosition(hashStudentId(moved.student), last, position);
+	}
+	waitlistEntryList.swapRemove(position);
+}
+
+void SchoolManagementSystem::seatStudent(const int& studentIndex, const int& courseIndex)
+{
+	enrolmentStore.append(studentIndex, courseIndex, 'N', courseRosterList[courseIndex].getSize());
+	courseRosterList[courseIndex].append(studentIndex);
+}
+
+void SchoolManagementSystem::removeFromRoster(const int& courseIndex, const int& rosterSlot)
+{
+	SmarterArray<int>& roster = courseRosterList[courseIndex];
+	roster.swapRemove(rosterSlot);
+	if (rosterSlot < roster.getSize())
+		enrolmentStore.setRosterSlot(roster[rosterSlot], enrolmentStore.find(roster[rosterSlot], courseIndex), rosterSlot);
+}
+
+void SchoolManagementSystem::promoteWaitlisted(const int& courseIndex)
+{
+	//Not logged: replaying the mutation that freed the seats promotes the same students again
+	const Waitlist& waitlist = courseWaitlistList[courseIndex];
+	while (waitlist.first != -1 && courseRosterList[courseIndex].getSize() < courseCapacityList[courseIndex])
+	{
+		StudentId id = waitlistEntryList[waitlist.first].student;
+		eraseWaitlistEntry(waitlist.first);
+
+		//A student who has reached the enrolment limit since joining loses its place
+		int studentIndex = studentIds.find(id);
+		if (enrolmentStore.getCount(studentIndex) < EnrolmentStore::maxEnrolmentsPerStudent)
+			seatStudent(studentIndex, courseIndex);
+	}
+}
+
+bool SchoolManagementSystem::assignLetterGrade(const int& studentIndex, const int& courseIndex, const char& letterGrade)
+{
+	assert(studentIndex >= 0 && studentIndex < studentTable.getSize());
+	assert(courseIndex >= 0 && courseIndex < courseList.getSize());
+	assert(letterGrade == 'A' || letterGrade == 'B' || letterGrade == 'C' || letterGrade == 'D' || letterGrade == 'F');
+
+	int i = enrolmentStore.find(studentIndex, courseIndex);
+	if (i == -1)
+		return false;
+
+	int creditHours = courseList[courseIndex].getCreditHours();
+	studentTotalsList.modify(studentIndex).subtract(enrolmentStore.getGrade(studentIndex, i), creditHours);
+	studentTotalsList.modify(studentIndex).add(letterGrade, creditHours);
+	enrolmentStore.setGrade(studentIndex, i, letterGrade);
+	updateStudentRank(studentIndex);
+
+	if (beginLogRecord(logAssignLetterGrade))
+	{
+		log->putInt(studentIndex);
+		log->putInt(courseIndex);
+		log->putInt(letterGrade);
+		log->endRecord();
+	}
+
+	return true;
+}
+
+bool SchoolManagementSystem::applyBatch(const SmarterArray<EnrolmentOperation>& operations, int* failedOperation)
+{
+	//Group the operations by student, keeping each student's in batch order. Whether an operation succeeds depends only
+	//on the enrolments of its own student, so each group can be checked and applied on its own.
+	int n = operations.getSize();
+	SmarterArray<int> order;
+	order.reserve(n);
+	for (int i = 0; i < n; i++)
+		order.append(i);
+	if (n > 0)
+		stable_sort(&order[0], &order[0] + n, [&](const int& a, const int& b) { return operations[a].studentIndex < operations[b].studentIndex; });
+
+	//Replay the group of operations order[begin, end) on a copy of its student's enrolments and their roster slots,
+	//left in scratch[0, scratchCount) and scratchSlots. Return the position of the first operation that would fail,
+	//or -1.
+	SmarterArray<uint32_t> scratch, scratchSlots;
+	int scratchCount = 0;
+	auto simulate = [&](const int& begin, const int& end) -> int
+	{
+		int studentIndex = operations[order[begin]].studentIndex;
+		if (studentIndex < 0 || studentIndex >= studentTable.getSize())
+			return order[begin];
+
+		auto push = [&](const uint32_t& enrolment, const uint32_t& rosterSlot)
+		{
+			if (scratchCount == scratch.getSize())
+			{
+				scratch.append(enrolment);
+				scratchSlots.append(rosterSlot);
+			}
+			else
+			{
+				scratch[scratchCount] = enrolment;
+				scratchSlots[scratchCount] = rosterSlot;
+			}
+			scratchCount++;
+		};
+
+		scratchCount = 0;
+		const uint32_t* enrolments = enrolmentStore.getEnrolments(studentIndex);
+		for (int i = 0; i < enrolmentStore.getCount(studentIndex); i++)
+			push(enrolments[i], uint32_t(enrolmentStore.getRosterSlot(studentIndex, i)));
+
+		for (int k = begin; k < end; k++)
+		{
+			const EnrolmentOperation& op = operations[order[k]];
+			if (op.courseIndex < 0 || op.courseIndex >= courseList.getSize())
+				return order[k];
+
+			int position = -1;
+			for (int i = 0; i < scratchCount && position == -1; i++)
+			{
+				if (EnrolmentStore::getCourse(scratch[i]) == op.courseIndex)
+					position = i;
+			}
+
+			switch (op.kind)
+			{
+			case EnrolmentOperation::enrol:
+				if (position != -1 || scratchCount == EnrolmentStore::maxEnrolmentsPerStudent)
+					return order[k];
+				push(EnrolmentStore::pack(op.courseIndex, 'N'), 0); //The slot is filled in with the rosters below
+				break;
+			case EnrolmentOperation::withdraw:
+				if (position == -1)
+					return order[k];
+				for (int i = position; i < scratchCount - 1; i++)
+				{
+					scratch[i] = scratch[i + 1];
+					scratchSlots[i] = scratchSlots[i + 1];
+				}
+				scratchCount--;
+				break;
+			case EnrolmentOperation::grade:
+				if (position == -1 || gradePoints(op.letterGrade) == -1)
+					return order[k];
+				scratch[position] = EnrolmentStore::pack(op.courseIndex, op.letterGrade);
+				break;
+			default:
+				return order[k];
+			}
+		}
+
+		return -1;
+	};
+
+	//Seats are shared by the students of a course, so they are counted in batch order, as if every earlier operation
+	//succeeded (if one does not, it is the first failure anyway). Only courses with a seat limit can have a waitlist.
+	int firstFailure = -1;
+	SmarterArray<int> seatsTaken; //The size of each roster, filled in when the first course with a seat limit comes up
+	for (int i = 0; i < n && firstFailure == -1; i++)
+	{
+		const EnrolmentOperation& op = operations[i];
+		if (op.courseIndex < 0 || op.courseIndex >= courseList.getSize() || courseCapacityList[op.courseIndex] == unlimitedSeats)
+			continue;
+
+		if (seatsTaken.getSize() == 0)
+		{
+			seatsTaken.reserve(courseList.getSize());
+			for (int j = 0; j < courseList.getSize(); j++)
+				seatsTaken.append(courseRosterList[j].getSize());
+		}
+		if (op.kind == EnrolmentOperation::enrol)
+		{
+			if (seatsTaken[op.courseIndex] >= courseCapacityList[op.courseIndex])
+				firstFailure = i;
+			seatsTaken[op.courseIndex]++;
+		}
+		else if (op.kind == EnrolmentOperation::withdraw)
+		{
+			if (courseWaitlistList[op.courseIndex].size > 0)
+				firstFailure = i;
+			seatsTaken[op.courseIndex]--;
+		}
+	}
+
+	for (int begin = 0, end; begin < n; begin = end)
+	{
+		for (end = begin + 1; end < n && operations[order[end]].studentIndex == operations[order[begin]].studentIndex; end++);
+		int failure = simulate(begin, end);
+		if (failure != -1 && (firstFailure == -1 || failure < firstFailure))
+			firstFailure = failure;
+	}
+	if (firstFailure != -1)
+	{
+		if (failedOperation != nullptr)
+			*failedOperation = firstFailure;
+		return false;
+	}
+
+	//Everything checks out: write each student's final enrolments and totals in one go
+	for (int begin = 0, end; begin < n; begin = end)
+	{
+		int studentIndex = operations[order[begin]].studentIndex;
+		for (end = begin + 1; end < n && operations[order[end]].studentIndex == studentIndex; end++);
+		simulate(begin, end);
+		enrolmentStore.assign(studentIndex, scratchCount > 0 ? &scratch[0] : nullptr, scratchCount > 0 ? &scratchSlots[0] : nullptr, scratchCount);
+		studentTotalsList.modify(studentIndex) = computeStudentTotals(studentIndex);
+		updateStudentRank(studentIndex);
+	}
+
+	//Rosters change in batch order, so they end up as the calls the batch stands for would leave them, and the log
+	//records those calls in the same order. The enrolments already hold their final state, so an enrolment that a
+	//later operation of the batch withdraws has no roster slot to keep up to date, and a withdrawal has to search the
+	//roster for its student.
+	for (int i = 0; i < n; i++)
+	{
+		const EnrolmentOperation& op = operations[i];
+		SmarterArray<int>& roster = courseRosterList[op.courseIndex];
+		if (op.kind == EnrolmentOperation::enrol)
+		{
+			int position = enrolmentStore.find(op.studentIndex, op.courseIndex);
+			if (position != -1)
+				enrolmentStore.setRosterSlot(op.studentIndex, position, roster.getSize());
+			roster.append(op.studentIndex);
+		}
+		else if (op.kind == EnrolmentOperation::withdraw)
+		{
+			int rosterSlot = roster.find(op.studentIndex);
+			roster.swapRemove(rosterSlot);
+			int position = rosterSlot < roster.getSize() ? enrolmentStore.find(roster[rosterSlot], op.courseIndex) : -1;
+			if (position != -1)
+				enrolmentStore.setRosterSlot(roster[rosterSlot], position, rosterSlot);
+		}
+
+		uint8_t operation = op.kind == EnrolmentOperation::enrol ? logEnrolStudent :
+			op.kind == EnrolmentOperation::withdraw ? logWithdrawStudent : logAssignLetterGrade;
+		if (beginLogRecord(operation))
+		{
+			log->putInt(op.studentIndex);
+			log->putInt(op.courseIndex);
+			if (op.kind == EnrolmentOperation::grade)
+				log->putInt(op.letterGrade);
+			log->endRecord();
+		}
+	}
+
+	return true;
+}
+
+GradeTotals SchoolManagementSystem::computeStudentTotals(const int& studentIndex) const
+{
+	GradeTotals totals{ 0, 0 };
+	const uint32_t* enrolments = enrolmentStore.getEnrolments(studentIndex);
+	for (int i = 0; i < enrolmentStore.getCount(studentIndex); i++)
+		totals.add(EnrolmentStore::getGrade(enrolments[i]), courseList[EnrolmentStore::getCourse(enrolments[i])].getCreditHours());
+
+	return totals;
+}
+
+double SchoolManagementSystem::getStudentGPA(const int& studentIndex) const
+{
+	assert(studentIndex >= 0 && studentIndex < studentTable.getSize());
+
+	return studentTotalsList[studentIndex].getGPA();
+}
+
+SmarterArray<int> SchoolManagementSystem::getStudentsBornIn(const int& fromYear, const int& toYear) const
+{
+	return studentTable.findBornBetween(fromYear, toYear);
+}
+
+bool SchoolManagementSystem::checkGPACache() const
+{
+	if (studentTotalsList.getSize() != studentTable.getSize())
+		return false;
+
+	for (int i = 0; i < studentTable.getSize(); i++)
+	{
+		GradeTotals totals = computeStudentTotals(i);
+		if (!(totals == studentTotalsList[i]) || totals.getGPA() != getStudentGPA(i))
+			return false;
+	}
+
+	return true;
+}
+
+void SchoolManagementSystem::computeAllGPAs(double* gpas, const int& count, ThreadPool* pool) const
+{
+	assert(count == studentTable.getSize());
+
+	SmarterArray<int> creditHours;
+	creditHours.reserve(courseList.getSize());
+	for (int i = 0; i < courseList.getSize(); i++)
+		creditHours.append(courseList[i].getCreditHours());
+
+	const int* hours = creditHours.getSize() > 0 ? &creditHours[0] : nullptr;
+
+	GradeTotalsKernel kernel = getGradeTotalsKernel();
+	function<void(const int&, const int&)> body = [&](const int& begin, const int& end)
+	{
+		enrolmentStore.forEachStudent(begin, end, [&](const int& i, const uint32_t* enrolments, const int& count)
+		{
+			gpas[i] = kernel(enrolments, count, hours).getGPA();
+		});
+	};
+
+	if (pool == nullptr)
+		body(0, count);
+	else
+		pool->parallelFor(count, body);
+}
+
+SmarterArray<int> SchoolManagementSystem::computeTopStudentIndices(const int& k, ThreadPool* pool) const
+{
+	assert(k >= 0);
+
+	int n = studentTable.getSize();
+	SmarterArray<double> gpas;
+	gpas.reserve(n);
+	for (int i = 0; i < n; i++)
+		gpas.append(0.0);
+	if (n > 0)
+		computeAllGPAs(&gpas[0], n, pool);
+
+	//The order of StudentRankIndex: higher GPA first, lower index first among equal GPAs
+	auto ranksBefore = [&](const int& a, const int& b) { return gpas[a] > gpas[b] || (gpas[a] == gpas[b] && a < b); };
+
+	//Each part of the roster keeps its own best k in a heap with its worst candidate on top; the best k overall are
+	//among the union of those, whichever thread found them
+	int parts = pool == nullptr ? 1 : pool->getThreadCount() * 4;
+	int top = min(k, n);
+	SmarterArray<SmarterArray<int>> best;
+	for (int p = 0; p < parts; p++)
+		best.emplace_back().reserve(top);
+
+	function<void(const int&, const int&)> body = [&](const int& begin, const int& end)
+	{
+		for (int p = begin; p < end; p++)
+		{
+			SmarterArray<int>& heap = best[p];
+			for (int i = int(int64_t(n) * p / parts); i < int(int64_t(n) * (p + 1) / parts) && top > 0; i++)
+			{
+				if (heap.getSize() < top)
+				{
+					heap.append(i);
+					push_heap(&heap[0], &heap[0] + heap.getSize(), ranksBefore);
+				}
+				else if (ranksBefore(i, heap[0]))
+				{
+					pop_heap(&heap[0], &heap[0] + heap.getSize(), ranksBefore);
+					heap[heap.getSize() - 1] = i;
+					push_heap(&heap[0], &heap[0] + heap.getSize(), ranksBefore);
+				}
+			}
+		}
+	};
+
+	if (pool == nullptr)
+		body(0, parts);
+	else
+		pool->parallelFor(parts, body);
+
+	SmarterArray<int> candidates;
+	candidates.reserve(parts * top);
+	for (int p = 0; p < parts; p++)
+	{
+		for (int i = 0; i < best[p].getSize(); i++)
+			candidates.append(best[p][i]);
+	}
+	if (candidates.getSize() > 0)
+		partial_sort(&candidates[0], &candidates[0] + top, &candidates[0] + candidates.getSize(), ranksBefore);
+
+	SmarterArray<int> result;
+	result.reserve(top);
+	for (int i = 0; i < top; i++)
+		result.append(candidates[i]);
+	return result;
+}
+
+void SchoolManagementSystem::updateStudentRank(const int& studentIndex)
+{
+	studentRankIndex.update(studentIndex, studentTotalsList[studentIndex].getGPA());
+}
+
+int SchoolManagementSystem::getTopStudentIndex() const
+{
+	return studentRankIndex.getTop();
+}
+
+SmarterArray<int> SchoolManagementSystem::getTopStudentIndices(const int& k) const
+{
+	assert(k >= 0);
+
+	return studentRankIndex.getTop(k);
+}
+
+int SchoolManagementSystem::getStudentRank(const int& studentIndex) const
+{
+	assert(studentIndex >= 0 && studentIndex < studentTable.getSize());
+
+	return studentRankIndex.getRank(studentIndex);
+}
+
+SmarterArray<int> SchoolManagementSystem::getStudentsInGPARange(const double& minGPA, const double& maxGPA) const
+{
+	return studentRankIndex.getInRange(minGPA, maxGPA);
+}
+
+int SchoolManagementSystem::findCourse(const string_view& courseName) const
+{
+	return courseNameIndex.find(NamePool::hashName(courseName), [&](const int& i) { return courseList[i].getCourseName() == courseName; });
+}
+
+int SchoolManagementSystem::findCourse(const Symbol& courseName) const
+{
+	return courseNameIndex.find(namePool().getHash(courseName), [&](const int& i) { return courseList[i].getCourseNameSymbol() == courseName; });
+}
+
+const Course& SchoolManagementSystem::getCourse(const int& courseIndex) const
+{
+	assert(courseIndex >= 0 && courseIndex < courseList.getSize());
+
+	return courseList[courseIndex];
+}
+
+CourseView SchoolManagementSystem::viewCourse(const int& courseIndex) const
+{
+	assert(courseIndex >= 0 && courseIndex < courseList.getSize());
+
+	return CourseView(courseList[courseIndex].getCourseName(), courseList[courseIndex].getCreditHours());
+}
+
+CourseId SchoolManagementSystem::getCourseId(const int& courseIndex) const
+{
+	assert(courseIndex >= 0 && courseIndex < courseList.getSize());
+
+	return courseIds.getId(courseIndex);
+}
+
+int SchoolManagementSystem::getCourseIndex(const CourseId& id) const
+{
+	return courseIds.find(id);
+}
+
+bool SchoolManagementSystem::offerCourse(const Course& course)
+{
+	if (findCourse(course.getCourseNameSymbol()) != -1)
+		return false;
+
+	courseNameIndex.insert(namePool().getHash(course.getCourseNameSymbol()), courseList.getSize());
+	courseList.append(course);
+	courseRosterList.emplace_back();
+	courseIds.insert();
+	courseCapacityList.append(unlimitedSeats);
+	courseWaitlistList.append(Waitlist{ -1, -1, 0 });
+	courseNameSearch.insert(course.getCourseNameSymbol(), courseIds.getId(courseList.getSize() - 1));
+
+	if (beginLogRecord(logOfferCourse))
+	{
+		log->putString(course.getCourseName());
+		log->putInt(course.getCreditHours());
+		log->endRecord();
+	}
+
+	return true;
+}
+
+void SchoolManagementSystem::removeCourse(const int& courseIndex)
+{
+	assert(courseIndex >= 0 && courseIndex < courseList.getSize());
+
+	//Drop the course from the enrolments of the students enrolled in it
+	int creditHours = courseList[courseIndex].getCreditHours();
+	const SmarterArray<int>& roster = courseRosterList[courseIndex];
+	for (int i = 0; i < roster.getSize(); i++)
+	{
+		int j = enrolmentStore.find(roster[i], courseIndex);
+
+		studentTotalsList.modify(roster[i]).subtract(enrolmentStore.getGrade(roster[i], j), creditHours);
+		enrolmentStore.remove(roster[i], j);
+		updateStudentRank(roster[i]);
+	}
+
+	//The last course moves into the removed course's index, so only the students enrolled in it need their enrolments
+	//renamed. Places on waitlists name courses by id and need no change.
+	int last = courseList.getSize() - 1;
+	courseNameSearch.erase(courseList[courseIndex].getCourseNameSymbol(), courseIds.getId(courseIndex));
+	while (courseWaitlistList[courseIndex].first != -1)
+		eraseWaitlistEntry(courseWaitlistList[courseIndex].first);
+	courseNameIndex.erase(namePool().getHash(courseList[courseIndex].getCourseNameSymbol()), courseIndex);
+	if (courseIndex != last)
+	{
+		courseNameIndex.replacePosition(namePool().getHash(courseList[last].getCourseNameSymbol()), last, courseIndex);
+
+		for (int i = 0; i < courseRosterList[last].getSize(); i++)
+		{
+			int student = courseRosterList[last][i];
+			enrolmentStore.setCourse(student, enrolmentStore.find(student, last), courseIndex);
+		}
+	}
+
+	courseList.swapRemove(courseIndex);
+	courseRosterList.swapRemove(courseIndex);
+	courseIds.swapRemove(courseIndex);
+	courseCapacityList.swapRemove(courseIndex);
+	courseWaitlistList.swapRemove(courseIndex);
+
+	if (beginLogRecord(logRemoveCourse))
+	{
+		log->putInt(courseIndex);
+		log->endRecord();
+	}
+}
+
+void SchoolManagementSystem::setCourseCreditHours(const int& courseIndex, const int& creditHours)
+{
+	assert(courseIndex >= 0 && courseIndex < courseList.getSize());
+
+	int oldCreditHours = courseList[courseIndex].getCreditHours();
+	const SmarterArray<int>& roster = courseRosterList[courseIndex];
+	for (int i = 0; i < roster.getSize(); i++)
+	{
+		char letterGrade = enrolmentStore.getGrade(roster[i], enrolmentStore.find(roster[i], courseIndex));
+
+		studentTotalsList.modify(roster[i]).subtract(letterGrade, oldCreditHours);
+		studentTotalsList.modify(roster[i]).add(letterGrade, creditHours);
+		updateStudentRank(roster[i]);
+	}
+
+	courseList.modify(courseIndex).setCreditHours(creditHours);
+
+	if (beginLogRecord(logSetCourseCreditHours))
+	{
+		log->putInt(courseIndex);
+		log->putInt(creditHours);
+		log->endRecord();
+	}
+}
+
+const SmarterArray<int>& SchoolManagementSystem::getCourseRoster(const int& courseIndex) const
+{
+	assert(courseIndex >= 0 && courseIndex < courseList.getSize());
+
+	return courseRosterList[courseIndex];
+}
+
+int SchoolManagementSystem::getCourseCapacity(const int& courseIndex) const
+{
+	assert(courseIndex >= 0 && courseIndex < courseList.getSize());
+
+	return courseCapacityList[courseIndex];
+}
+
+void SchoolManagementSystem::setCourseCapacity(const int& courseIndex, const int& capacity)
+{
+	assert(courseIndex >= 0 && courseIndex < courseList.getSize());
+	assert(capacity >= 0);
+
+	courseCapacityList[courseIndex] = capacity;
+	promoteWaitlisted(courseIndex);
+
+	if (beginLogRecord(logSetCourseCapacity))
+	{
+		log->putInt(courseIndex);
+		log->putInt(capacity);
+		log->endRecord();
+	}
+}
+
+SmarterArray<int> SchoolManagementSystem::getWaitlist(const int& courseIndex) const
+{
+	assert(courseIndex >= 0 && courseIndex < courseList.getSize());
+
+	SmarterArray<int> waitlist;
+	waitlist.reserve(courseWaitlistList[courseIndex].size);
+	for (int p = courseWaitlistList[courseIndex].first; p != -1; p = waitlistEntryList[p].next)
+		waitlist.append(studentIds.find(waitlistEntryList[p].student));
+	return waitlist;
+}
+
+SmarterArray<int> SchoolManagementSystem::findCoursesByPrefix(const string_view& prefix, const int& maxResults) const
+{
+	SmarterArray<int> results;
+	if (maxResults > 0)
+		courseNameSearch.findPrefix(prefix, [&](const uint32_t& id) { results.append(courseIds.find(id)); return results.getSize() < maxResults; });
+	return results;
+}
+
+SmarterArray<int> SchoolManagementSystem::findCoursesLike(const string_view& courseName, const int& maxDistance, const int& maxResults) const
+{
+	SmarterArray<int> results;
+	if (maxResults > 0)
+		courseNameSearch.findSimilar(courseName, maxDistance, [&](const uint32_t& id, const int&)
+		{
+			results.append(courseIds.find(id));
+			return results.getSize() < maxResults;
+		});
+	return results;
+}
+
+SmarterArray<int> SchoolManagementSystem::findStudentsByPrefix(const string_view& lastNamePrefix, const string_view& firstNamePrefix,
+																const int& maxResults) const
+{
+	SmarterArray<int> results;
+	if (maxResults <= 0)
+		return results;
+
+	//Walk the index of the first prefix given and filter on the other
+	if (!lastNamePrefix.empty() || firstNamePrefix.empty())
+		studentLastNameSearch.findPrefix(lastNamePrefix, [&](const uint32_t& id)
+		{
+			int studentIndex = studentIds.find(id);
+			if (NameSearchIndex::startsWith(namePool().getName(studentTable.getFirstNameSymbol(studentIndex)), firstNamePrefix))
+				results.append(studentIndex);
+			return results.getSize() < maxResults;
+		});
+	else
+		studentFirstNameSearch.findPrefix(firstNamePrefix, [&](const uint32_t& id)
+		{
+			results.append(studentIds.find(id));
+			return results.getSize() < maxResults;
+		});
+	return results;
+}
+
+SmarterArray<int> SchoolManagementSystem::findStudentsLike(const string_view& lastName, const int& maxDistance, const int& maxResults) const
+{
+	SmarterArray<int> results;
+	if (maxResults > 0)
+		studentLastNameSearch.findSimilar(lastName, maxDistance, [&](const uint32_t& id, const int&)
+		{
+			results.append(studentIds.find(id));
+			return results.getSize() < maxResults;
+		});
+	return results;
+}
+
+bool SchoolManagementSystem::saveSnapshot(const string& path) const
+{
+	//Intern the names so every distinct string is written once
+	SmarterArray<string> strings;
+	HashIndex stringIndex;
+	auto intern = [&](const string_view& str) -> uint32_t
+	{
+		size_t h = hash<string_view>()(str);
+		int i = stringIndex.find(h, [&](const int& j) { return strings[j] == str; });
+		if (i == -1)
+		{
+			i = strings.getSize();
+			stringIndex.insert(h, i);
+			strings.append(string(str));
+		}
+		return uint32_t(i);
+	};
+
+	SmarterArray<SnapshotCourse> courses;
+	courses.reserve(courseList.getSize());
+	for (int i = 0; i < courseList.getSize(); i++)
+		courses.append(SnapshotCourse{ intern(courseList[i].getCourseName()), courseList[i].getCreditHours(), courseCapacityList[i] });
+
+	SmarterArray<SnapshotStudent> students;
+	students.reserve(studentTable.getSize());
+	for (int i = 0; i < studentTable.getSize(); i++)
+	{
+		Date dob = studentTable.getDob(i);
+		students.append(SnapshotStudent{ intern(studentTable.getFirstName(i)), intern(studentTable.getLastName(i)), dob.d, dob.m, dob.y });
+	}
+
+	SmarterArray<uint32_t> stringOffsets;
+	stringOffsets.reserve(strings.getSize() + 1);
+	uint32_t stringBytes = 0;
+	for (int i = 0; i < strings.getSize(); i++)
+	{
+		stringOffsets.append(stringBytes);
+		stringBytes += uint32_t(strings[i].size());
+	}
+	stringOffsets.append(stringBytes);
+
+	int enrolmentCount = 0;
+	for (int i = 0; i < enrolmentStore.getSize(); i++)
+		enrolmentCount += enrolmentStore.getCount(i);
+
+	SnapshotHeader header;
+	memcpy(header.magic, "SMSSNAP", 8);
+	header.version = snapshotVersion;
+	header.stringCount = uint32_t(strings.getSize());
+	header.stringBytes = stringBytes;
+	header.courseCount = uint32_t(courseList.getSize());
+	header.studentCount = uint32_t(studentTable.getSize());
+	header.enrolmentCount = uint32_t(enrolmentCount);
+	header.courseSlotCount = uint32_t(courseIds.getSlotCount());
+	header.studentSlotCount = uint32_t(studentIds.getSlotCount());
+	header.waitlistCount = uint32_t(waitlistEntryList.getSize());
+	header.padding = 0;
+	header.logSequence = logSequence;
+
+	//Lay out everything after the header in one buffer so the checksum and the write are single passes
+	string body;
+	auto put = [&](const void* p, const size_t& n) { body.append(static_cast<const char*>(p), n); };
+	auto putWord = [&](const uint32_t& w) { put(&w, sizeof w); };
+
+	put(&stringOffsets[0], stringOffsets.getSize() * sizeof(uint32_t));
+	for (int i = 0; i < strings.getSize(); i++)
+		put(strings[i].data(), strings[i].size());
+	body.append((4 - stringBytes % 4) % 4, '\0');
+
+	if (courses.getSize() > 0)
+		put(&courses[0], courses.getSize() * sizeof(SnapshotCourse));
+	if (students.getSize() > 0)
+		put(&students[0], students.getSize() * sizeof(SnapshotStudent));
+
+	uint32_t offset = 0;
+	for (int i = 0; i < enrolmentStore.getSize(); i++)
+	{
+		putWord(offset);
+		offset += uint32_t(enrolmentStore.getCount(i));
+	}
+	putWord(offset);
+	for (int i = 0; i < enrolmentStore.getSize(); i++)
+	{
+		for (int j = 0; j < enrolmentStore.getCount(i); j++)
+		{
+			SnapshotEnrolment e{ enrolmentStore.getCourse(i, j), enrolmentStore.getGrade(i, j) };
+			put(&e, sizeof e);
+		}
+	}
+
+	offset = 0;
+	for (int i = 0; i < courseRosterList.getSize(); i++)
+	{
+		putWord(offset);
+		offset += uint32_t(courseRosterList[i].getSize());
+	}
+	putWord(offset);
+	for (int i = 0; i < courseRosterList.getSize(); i++)
+	{
+		if (courseRosterList[i].getSize() > 0)
+			put(&courseRosterList[i][0], courseRosterList[i].getSize() * sizeof(int32_t));
+	}
+
+	for (int i = 0; i < studentTable.getSize(); i++)
+		putWord(studentIds.getId(i));
+	for (int i = 0; i < studentIds.getSlotCount(); i++)
+		putWord(studentIds.getGeneration(i));
+	for (int i = 0; i < courseList.getSize(); i++)
+		putWord(courseIds.getId(i));
+	for (int i = 0; i < courseIds.getSlotCount(); i++)
+		putWord(courseIds.getGeneration(i));
+
+	offset = 0;
+	for (int i = 0; i < courseWaitlistList.getSize(); i++)
+	{
+		putWord(offset);
+		offset += uint32_t(courseWaitlistList[i].size);
+	}
+	putWord(offset);
+	for (int i = 0; i < courseWaitlistList.getSize(); i++)
+	{
+		for (int p = courseWaitlistList[i].first; p != -1; p = waitlistEntryList[p].next)
+			putWord(uint32_t(studentIds.find(waitlistEntryList[p].student)));
+	}
+
+	header.checksum = fnv1a(body.data(), body.size());
+
+	return replaceFileDurably(path, string_view(reinterpret_cast<const char*>(&header), sizeof header), body);
+}
+
+bool SchoolManagementSystem::loadSnapshot(const string& path)
+{
+	MappedFile file;
+	if (!file.open(path) || file.getSize() < sizeof(SnapshotHeaderV2))
+		return false;
+
+	SnapshotHeader header;
+	memcpy(&header, file.getData(), sizeof(SnapshotHeaderV2)); //Enough to read the version
+	if (memcmp(header.magic, "SMSSNAP", 8) != 0 || (header.version != snapshotVersion && header.version != 2))
+		return false;
+
+	bool upgrade = header.version == 2;
+	size_t headerSize = sizeof(SnapshotHeader);
+	if (upgrade)
+	{
+		SnapshotHeaderV2 old;
+		memcpy(&old, file.getData(), sizeof old);
+		header.waitlistCount = 0;
+		header.padding = 0;
+		header.logSequence = old.logSequence;
+		header.checksum = old.checksum;
+		headerSize = sizeof old;
+	}
+	else if (file.getSize() < sizeof header)
+		return false;
+	else
+		memcpy(&header, file.getData(), sizeof header);
+
+	//Check that the sections the header describes add up to the file size before touching any of them
+	uint64_t words = uint64_t(header.stringCount) + 1 + (uint64_t(header.stringBytes) + 3) / 4 +
+		(upgrade ? 2 : 3) * uint64_t(header.courseCount) + 5 * uint64_t(header.studentCount) +
+		uint64_t(header.studentCount) + 1 + 2 * uint64_t(header.enrolmentCount) +
+		uint64_t(header.courseCount) + 1 + uint64_t(header.enrolmentCount) +
+		uint64_t(header.studentCount) + header.studentSlotCount + uint64_t(header.courseCount) + header.courseSlotCount +
+		(upgrade ? 0 : uint64_t(header.courseCount) + 1 + uint64_t(header.waitlistCount));
+	if (file.getSize() != headerSize + 4 * words || header.studentCount > INT32_MAX / 2 || header.enrolmentCount > INT32_MAX / 2)
+		return false;
+
+	const char* body = file.getData() + headerSize;
+	if (fnv1a(body, file.getSize() - headerSize) != header.checksum)
+		return false;
+
+	//The mapping is page aligned and every section is a multiple of 4 bytes, so the records can be read in place
+	const char* p = body;
+	auto section = [&](const size_t& bytes) { const char* start = p; p += bytes; return start; };
+	const uint32_t* stringOffsets = reinterpret_cast<const uint32_t*>(section(4 * (size_t(header.stringCount) + 1)));
+	const char* stringBytes = section((size_t(header.stringBytes) + 3) / 4 * 4);
+	const SnapshotCourse* courses = reinterpret_cast<const SnapshotCourse*>(p);
+	SmarterArray<SnapshotCourse> upgradedCourses;
+	if (upgrade)
+	{
+		const SnapshotCourseV2* oldCourses = reinterpret_cast<const SnapshotCourseV2*>(section(sizeof(SnapshotCourseV2) * header.courseCount));
+		upgradedCourses.reserve(int(header.courseCount));
+		for (uint32_t i = 0; i < header.courseCount; i++)
+			upgradedCourses.append(SnapshotCourse{ oldCourses[i].name, oldCourses[i].creditHours, unlimitedSeats });
+		courses = header.courseCount > 0 ? &upgradedCourses[0] : nullptr;
+	}
+	else
+		section(sizeof(SnapshotCourse) * header.courseCount);
+	const SnapshotStudent* students = reinterpret_cast<const SnapshotStudent*>(section(sizeof(SnapshotStudent) * header.studentCount));
+	const uint32_t* enrolmentOffsets = reinterpret_cast<const uint32_t*>(section(4 * (size_t(header.studentCount) + 1)));
+	const SnapshotEnrolment* enrolments = reinterpret_cast<const SnapshotEnrolment*>(section(sizeof(SnapshotEnrolment) * header.enrolmentCount));
+	const uint32_t* rosterOffsets = reinterpret_cast<const uint32_t*>(section(4 * (size_t(header.courseCount) + 1)));
+	const int32_t* rosters = reinterpret_cast<const int32_t*>(section(4 * size_t(header.enrolmentCount)));
+	const uint32_t* studentIdList = reinterpret_cast<const uint32_t*>(section(4 * size_t(header.studentCount)));
+	const uint32_t* studentGenerations = reinterpret_cast<const uint32_t*>(section(4 * size_t(header.studentSlotCount)));
+	const uint32_t* courseIdList = reinterpret_cast<const uint32_t*>(section(4 * size_t(header.courseCount)));
+	const uint32_t* courseGenerations = reinterpret_cast<const uint32_t*>(section(4 * size_t(header.courseSlotCount)));
+	SmarterArray<uint32_t> emptyWaitlistOffsets;
+	const uint32_t* waitlistOffsets;
+	if (upgrade)
+	{
+		emptyWaitlistOffsets.reserve(int(header.courseCount) + 1);
+		for (uint32_t i = 0; i <= header.courseCount; i++)
+			emptyWaitlistOffsets.append(0);
+		waitlistOffsets = &emptyWaitlistOffsets[0];
+	}
+	else
+		waitlistOffsets = reinterpret_cast<const uint32_t*>(section(4 * (size_t(header.courseCount) + 1)));
+	const int32_t* waitlists = reinterpret_cast<const int32_t*>(section(4 * size_t(header.waitlistCount)));
+
+	//Validate every cross reference once, up front
+	for (uint32_t i = 0; i < header.stringCount; i++)
+	{
+		if (stringOffsets[i] > stringOffsets[i + 1])
+			return false;
+	}
+	if (stringOffsets[0] != 0 || stringOffsets[header.stringCount] != header.stringBytes)
+		return false;
+	for (uint32_t i = 0; i < header.courseCount; i++)
+	{
+		if (courses[i].name >= header.stringCount || courses[i].capacity < 0 || rosterOffsets[i] > rosterOffsets[i + 1] ||
+			waitlistOffsets[i] > waitlistOffsets[i + 1] || (waitlistOffsets[i] < waitlistOffsets[i + 1] &&
+			rosterOffsets[i + 1] - rosterOffsets[i] < uint32_t(courses[i].capacity)))
+			return false;
+	}
+	for (uint32_t i = 0; i < header.studentCount; i++)
+	{
+		if (students[i].firstName >= header.stringCount || students[i].lastName >= header.stringCount ||
+			enrolmentOffsets[i] > enrolmentOffsets[i + 1] ||
+			enrolmentOffsets[i + 1] - enrolmentOffsets[i] > uint32_t(EnrolmentStore::maxEnrolmentsPerStudent))
+			return false;
+	}
+	if (enrolmentOffsets[0] != 0 || enrolmentOffsets[header.studentCount] != header.enrolmentCount ||
+		rosterOffsets[0] != 0 || rosterOffsets[header.courseCount] != header.enrolmentCount ||
+		waitlistOffsets[0] != 0 || waitlistOffsets[header.courseCount] != header.waitlistCount)
+		return false;
+	for (uint32_t i = 0; i < header.waitlistCount; i++)
+	{
+		if (waitlists[i] < 0 || uint32_t(waitlists[i]) >= header.studentCount)
+			return false;
+	}
+	for (uint32_t i = 0; i < header.enrolmentCount; i++)
+	{
+		if (enrolments[i].courseIndex < 0 || uint32_t(enrolments[i].courseIndex) >= header.courseCount ||
+			(enrolments[i].letterGrade != 'N' && gradePoints(char(enrolments[i].letterGrade)) == -1) ||
+			rosters[i] < 0 || uint32_t(rosters[i]) >= header.studentCount)
+			return false;
+	}
+
+	SchoolManagementSystem sms;
+	sms.setStorageResource(storageResource);
+	if (!sms.studentIds.restore(studentGenerations, int(header.studentSlotCount), studentIdList, int(header.studentCount)) ||
+		!sms.courseIds.restore(courseGenerations, int(header.courseSlotCount), courseIdList, int(header.courseCount)))
+		return false;
+
+	SmarterArray<Symbol> symbols;
+	symbols.reserve(int(header.stringCount));
+	for (uint32_t i = 0; i < header.stringCount; i++)
+		symbols.append(namePool().intern(string_view(stringBytes + stringOffsets[i], stringOffsets[i + 1] - stringOffsets[i])));
+
+	sms.reserveCourses(int(header.courseCount));
+	for (uint32_t i = 0; i < header.courseCount; i++)
+	{
+		Symbol name = symbols[int(courses[i].name)];
+		if (sms.findCourse(name) != -1)
+			return false;
+
+		sms.courseNameIndex.insert(namePool().getHash(name), int(i));
+		sms.courseList.append(Course(name, courses[i].creditHours));
+		sms.courseCapacityList.append(courses[i].capacity);
+		sms.courseNameSearch.insert(name, sms.courseIds.getId(int(i)));
+
+		SmarterArray<int>& roster = sms.courseRosterList.emplace_back();
+		roster.reserve(int(rosterOffsets[i + 1] - rosterOffsets[i]));
+		for (uint32_t j = rosterOffsets[i]; j < rosterOffsets[i + 1]; j++)
+			roster.append(rosters[j]);
+	}
+
+	int studentCount = int(header.studentCount);
+	sms.studentTable.reserve(studentCount);
+	if (header.courseCount > uint32_t(EnrolmentStore::maxCourses))
+		return false;
+	sms.enrolmentStore.reserve(studentCount, int(header.enrolmentCount));
+	sms.studentTotalsList.reserve(studentCount);
+	sms.studentNameIndex.reserve(studentCount);
+	SmarterArray<double> gpas;
+	gpas.reserve(studentCount);
+	for (int i = 0; i < studentCount; i++)
+	{
+		const SnapshotStudent& r = students[i];
+		Symbol firstName = symbols[int(r.firstName)], lastName = symbols[int(r.lastName)];
+		if (sms.findStudent(firstName, lastName) != -1)
+			return false;
+
+		sms.studentNameIndex.insert(hashStudentName(firstName, lastName), i);
+		sms.studentTable.append(firstName, lastName, Date{ r.d, r.m, r.y });
+		sms.studentLastNameSearch.insert(lastName, sms.studentIds.getId(i));
+		sms.studentFirstNameSearch.insert(firstName, sms.studentIds.getId(i));
+
+		sms.enrolmentStore.addStudent(int(enrolmentOffsets[i + 1] - enrolmentOffsets[i]));
+		GradeTotals totals{ 0, 0 };
+		for (uint32_t j = enrolmentOffsets[i]; j < enrolmentOffsets[i + 1]; j++)
+		{
+			if (sms.enrolmentStore.find(i, int(enrolments[j].courseIndex)) != -1)
+				return false;
+
+			sms.enrolmentStore.append(i, enrolments[j].courseIndex, char(enrolments[j].letterGrade), 0); //Slots come with the rosters
+			totals.add(char(enrolments[j].letterGrade), sms.courseList[enrolments[j].courseIndex].getCreditHours());
+		}
+
+		sms.studentTotalsList.append(totals);
+		gpas.append(totals.getGPA());
+	}
+	sms.studentRankIndex.assign(gpas);
+
+	//Rosters mirror the enrolments: every roster entry must match an enrolment and appear once. The roster sizes add
+	//up to the enrolment count, so this also means no enrolment is missing from its course's roster, and each one gets
+	//its roster slot here.
+	SmarterArray<int> lastCourseSeen;
+	lastCourseSeen.reserve(studentCount);
+	for (int i = 0; i < studentCount; i++)
+		lastCourseSeen.append(-1);
+	for (int i = 0; i < sms.courseRosterList.getSize(); i++)
+	{
+		const SmarterArray<int>& roster = sms.courseRosterList[i];
+		for (int j = 0; j < roster.getSize(); j++)
+		{
+			int position = sms.enrolmentStore.find(roster[j], i);
+			if (lastCourseSeen[roster[j]] == i || position == -1)
+				return false;
+			lastCourseSeen[roster[j]] = i;
+			sms.enrolmentStore.setRosterSlot(roster[j], position, j);
+		}
+	}
+
+	//A student waits for a course at most once and never while enrolled in it
+	for (uint32_t i = 0; i < header.courseCount; i++)
+	{
+		sms.courseWaitlistList.append(Waitlist{ -1, -1, 0 });
+		for (uint32_t j = waitlistOffsets[i]; j < waitlistOffsets[i + 1]; j++)
+		{
+			StudentId id = sms.studentIds.getId(waitlists[j]);
+			if (sms.enrolmentStore.find(waitlists[j], int(i)) != -1 || sms.findWaitlistEntry(id, int(i)) != -1)
+				return false;
+			sms.addWaitlistEntry(id, int(i));
+		}
+	}
+
+	//The snapshot replaces the data, not the log this system writes to
+	sms.logSequence = header.logSequence;
+	sms.log = log;
+	*this = std::move(sms);
+
+	return true;
+}
+
+void SchoolManagementSystem::reserveStudents(const int& count)
+{
+	int total = studentTable.getSize() + count;
+	studentTable.reserve(total);
+	enrolmentStore.reserve(total, 0); //How many enrolments the new students will have is not known yet
+	studentTotalsList.reserve(total);
+	studentNameIndex.reserve(total);
+}
+
+void SchoolManagementSystem::reserveCourses(const int& count)
+{
+	int total = courseList.getSize() + count;
+	courseList.reserve(total);
+	courseRosterList.reserve(total);
+	courseNameIndex.reserve(total);
+	courseCapacityList.reserve(total);
+	courseWaitlistList.reserve(total);
+}
+
+ImportReport SchoolManagementSystem::importStudentsCsv(const string& path)
+{
+	ImportReport report{ 0, 0, SmarterArray<ImportError>() };
+	MappedFile file;
+	if (!file.open(path))
+	{
+		report.errors.append(ImportError{ 0, "cannot read " + path });
+		return report;
+	}
+
+	CsvReader reader(file.getData(), file.getSize());
+	reserveStudents(reader.countRows());
+
+	string_view fields[5];
+	int fieldCount;
+	string error;
+	bool header = true;
+	while (reader.nextRow(fields, 5, fieldCount, error))
+	{
+		if (header)
+		{
+			header = false;
+			continue;
+		}
+		report.rows++;
+
+		Date dob;
+		if (error.empty() && fieldCount != 5)
+			error = "expected 5 fields";
+		else if (error.empty() && (fields[0].empty() || fields[1].empty()))
+			error = "empty name";
+		else if (error.empty() && (!parseInt(fields[2], dob.d) || !parseInt(fields[3], dob.m) || !parseInt(fields[4], dob.y) ||
+			dob.d < 1 || dob.d > 31 || dob.m < 1 || dob.m > 12))
+			error = "invalid date of birth";
+		else if (error.empty() && findStudent(fields[0], fields[1]) != -1)
+			error = "student already registered";
+
+		if (!error.empty())
+		{
+			report.errors.append(ImportError{ reader.getLine(), error });
+			continue;
+		}
+
+		registerStudent(Student(fields[0], fields[1], dob));
+		report.imported++;
+	}
+
+	return report;
+}
+
+ImportReport SchoolManagementSystem::importCoursesCsv(const string& path)
+{
+	ImportReport report{ 0, 0, SmarterArray<ImportError>() };
+	MappedFile file;
+	if (!file.open(path))
+	{
+		report.errors.append(ImportError{ 0, "cannot read " + path });
+		return report;
+	}
+
+	CsvReader reader(file.getData(), file.getSize());
+	reserveCourses(reader.countRows());
+
+	string_view fields[2];
+	int fieldCount;
+	string error;
+	bool header = true;
+	while (reader.nextRow(fields, 2, fieldCount, error))
+	{
+		if (header)
+		{
+			header = false;
+			continue;
+		}
+		report.rows++;
+
+		int creditHours;
+		if (error.empty() && fieldCount != 2)
+			error = "expected 2 fields";
+		else if (error.empty() && fields[0].empty())
+			error = "empty course name";
+		else if (error.empty() && (!parseInt(fields[1], creditHours) || creditHours < 0))
+			error = "invalid credit hours";
+		else if (error.empty() && findCourse(fields[0]) != -1)
+			error = "course already offered";
+
+		if (!error.empty())
+		{
+			report.errors.append(ImportError{ reader.getLine(), error });
+			continue;
+		}
+
+		offerCourse(Course(fields[0], creditHours));
+		report.imported++;
+	}
+
+	return report;
+}
+
+ImportReport SchoolManagementSystem::importEnrolmentsCsv(const string& path)
+{
+	ImportReport report{ 0, 0, SmarterArray<ImportError>() };
+	MappedFile file;
+	if (!file.open(path))
+	{
+		report.errors.append(ImportError{ 0, "cannot read " + path });
+		return report;
+	}
+
+	CsvReader reader(file.getData(), file.getSize());
+	enrolmentStore.reserveEnrolments(reader.countRows());
+
+	string_view fields[4];
+	int fieldCount;
+	string error;
+	bool header = true;
+	while (reader.nextRow(fields, 4, fieldCount, error))
+	{
+		if (header)
+		{
+			header = false;
+			continue;
+		}
+		report.rows++;
+
+		int studentIndex = -1, courseIndex = -1;
+		if (error.empty() && fieldCount != 3 && fieldCount != 4)
+			error = "expected 3 or 4 fields";
+		else if (error.empty() && fieldCount == 4 && !fields[3].empty() && (fields[3].size() != 1 || gradePoints(fields[3][0]) == -1))
+			error = "invalid letter grade";
+		else if (error.empty() && (studentIndex = findStudent(fields[0], fields[1])) == -1)
+			error = "no such student";
+		else if (error.empty() && (courseIndex = findCourse(fields[2])) == -1)
+			error = "no such course";
+		else if (error.empty() && enrolmentStore.find(studentIndex, courseIndex) != -1)
+			error = "student already enrolled";
+		else if (error.empty() && !enrolStudent(studentIndex, courseIndex))
+			error = enrolmentStore.getCount(studentIndex) == EnrolmentStore::maxEnrolmentsPerStudent ? "too many enrolments" : "course full";
+
+		if (!error.empty())
+		{
+			report.errors.append(ImportError{ reader.getLine(), error });
+			continue;
+		}
+
+		if (fieldCount == 4 && !fields[3].empty())
+			assignLetterGrade(studentIndex, courseIndex, fields[3][0]);
+		report.imported++;
+	}
+
+	return report;
+}
+
+void SchoolManagementSystem::setWriteAheadLog(WriteAheadLog* log)
+{
+	assert(log == nullptr || log->isOpen());
+
+	this->log = log;
+}
+
+void SchoolManagementSystem::setStorageResource(pmr::memory_resource* resource)
+{
+	storageResource = resource != nullptr ? resource : pmr::get_default_resource();
+	enrolmentStore.setResource(storageResource);
+	courseNameSearch.setResource(storageResource);
+	studentLastNameSearch.setResource(storageResource);
+	studentFirstNameSearch.setResource(storageResource);
+}
+
+uint64_t SchoolManagementSystem::getLogSequence() const
+{
+	return logSequence;
+}
+
+bool SchoolManagementSystem::isLogging() const
+{
+	return log != nullptr;
+}
+
+bool SchoolManagementSystem::beginLogRecord(const uint8_t& operation)
+{
+	logSequence++;
+	if (log == nullptr)
+		return false;
+
+	log->beginRecord(logSequence, operation);
+	return true;
+}
+
+bool SchoolManagementSystem::applyLogRecord(const uint8_t& operation, LogPayloadReader& payload)
+{
+	//A record that does not fit the current state means the log does not belong on top of it, so nothing is applied
+	int32_t a, b, c;
+	string first, second;
+	int students = studentTable.getSize(), courses = courseList.getSize();
+	switch (operation)
+	{
+	case logRegisterStudent:
+		if (!payload.getString(first) || !payload.getString(second) || !payload.getInt(a) || !payload.getInt(b) || !payload.getInt(c) || !payload.atEnd())
+			return false;
+		return registerStudent(Student(first, second, Date{ a, b, c }));
+	case logEnrolStudent:
+		if (!payload.getInt(a) || !payload.getInt(b) || !payload.atEnd() || a < 0 || a >= students || b < 0 || b >= courses)
+			return false;
+		return enrolStudent(a, b);
+	case logRemoveStudent:
+		if (!payload.getInt(a) || !payload.atEnd() || a < 0 || a >= students)
+			return false;
+		removeStudent(a);
+		return true;
+	case logWithdrawStudent:
+		if (!payload.getInt(a) || !payload.getInt(b) || !payload.atEnd() || a < 0 || a >= students || b < 0 || b >= courses)
+			return false;
+		return withdrawStudent(a, b);
+	case logAssignLetterGrade:
+		if (!payload.getInt(a) || !payload.getInt(b) || !payload.getInt(c) || !payload.atEnd() || a < 0 || a >= students ||
+			b < 0 || b >= courses || c < 0 || c > 127 || gradePoints(char(c)) == -1)
+			return false;
+		return assignLetterGrade(a, b, char(c));
+	case logOfferCourse:
+		if (!payload.getString(first) || !payload.getInt(a) || !payload.atEnd())
+			return false;
+		return offerCourse(Course(first, a));
+	case logRemoveCourse:
+		if (!payload.getInt(a) || !payload.atEnd() || a < 0 || a >= courses)
+			return false;
+		removeCourse(a);
+		return true;
+	case logSetCourseCreditHours:
+		if (!payload.getInt(a) || !payload.getInt(b) || !payload.atEnd() || a < 0 || a >= courses)
+			return false;
+		setCourseCreditHours(a, b);
+		return true;
+	case logSetCourseCapacity:
+		if (!payload.getInt(a) || !payload.getInt(b) || !payload.atEnd() || a < 0 || a >= courses || b < 0)
+			return false;
+		setCourseCapacity(a, b);
+		return true;
+	case logRequestSeat:
+		if (!payload.getInt(a) || !payload.getInt(b) || !payload.atEnd() || a < 0 || a >= students || b < 0 || b >= courses)
+			return false;
+		return requestSeat(a, b) != seatRejected;
+	case logLeaveWaitlist:
+		if (!payload.getInt(a) || !payload.getInt(b) || !payload.atEnd() || a < 0 || a >= students || b < 0 || b >= courses)
+			return false;
+		return leaveWaitlist(a, b);
+	default:
+		return false;
+	}
+}
+
+int SchoolManagementSystem::replayLog(const string& path)
+{
+	MappedFile file;
+	if (!file.open(path))
+		return 0;
+
+	//Replaying must not log the replayed mutations again
+	WriteAheadLog* attached = log;
+	log = nullptr;
+
+	const char* p = file.getData();
+	const char* end = p + file.getSize();
+	int applied = 0;
+	while (size_t(end - p) >= 4)
+	{
+		uint32_t length;
+		memcpy(&length, p, sizeof length);
+		if (length < sizeof(uint64_t) + 1 || size_t(end - p) - 4 < size_t(length) + 4)
+			break; //A torn record at the end of the log
+
+		uint32_t checksum;
+		memcpy(&checksum, p + 4 + length, sizeof checksum);
+		if (uint32_t(fnv1a(p + 4, length)) != checksum)
+			break;
+
+		uint64_t sequence;
+		memcpy(&sequence, p + 4, sizeof sequence);
+		uint8_t operation = uint8_t(p[4 + sizeof sequence]);
+		const char* payload = p + 4 + sizeof sequence + 1;
+		p += 4 + length + 4;
+
+		if (sequence <= logSequence)
+			continue; //Already part of the snapshot the log is replayed on
+		if (sequence != logSequence + 1)
+			break;
+
+		LogPayloadReader reader(payload, length - sizeof sequence - 1);
+		if (!applyLogRecord(operation, reader))
+			break;
+
+		logSequence = sequence;
+		applied++;
+	}
+
+	log = attached;
+
+	return applied;
+}
+
+bool SchoolManagementSystem::recover(const string& snapshotPath, const string& logPath)
+{
+	ifstream snapshot(snapshotPath, ios::binary);
+	bool exists = snapshot.good();
+	snapshot.close();
+
+	if (exists && !loadSnapshot(snapshotPath))
+		return false;
+
+	replayLog(logPath);
+
+	return true;
+}
+
+bool SchoolManagementSystem::compact(const string& snapshotPath)
+{
+	assert(log != nullptr);
+
+	//saveSnapshot returns only once the new snapshot is on disk, so the log can be emptied after it. A crash in between
+	//is harmless: the snapshot records the sequence number it includes, so replay skips the records it already contains.
+	if (!log->sync() || !saveSnapshot(snapshotPath))
+		return false;
+
+	return log->truncate();
+}
+
+SchoolSnapshot SchoolManagementSystem::takeSnapshot() const
+{
+	return SchoolSnapshot(studentTable, courseList, enrolmentStore, studentTotalsList, logSequence);
+}
+
+ostream& operator << (ostream& out, const SchoolManagementSystem& sms)
+{
+	return out << sms.takeSnapshot();
+}
+
+Student SchoolManagementSystem::generateRandomStudent()
+{
+	string fn, ln;
+	Date dob;
+
+	fn = rand() % 26 + 65;
+	for (int i = 0; i < 9; i++)
+		fn += char(rand() % 26 + 97);
+
+	ln = rand() % 26 + 65;
+	for (int i = 0; i < 9; i++)
+		ln += char(rand() % 26 + 97);
+
+	dob.y = 1998 + rand() % 5;
+	dob.m = 1 + rand() % 12;
+	dob.d = 1 + rand() % 30;
+
+	return Student(fn, ln, dob);
+}
+
+char SchoolManagementSystem::generateRandomLetterGrade()
+{
+	int g = rand() % 11;
+	if (g == 0)
+		return 'A';
+	else if (g <= 2)
+		return 'B';
+	else if (g <= 5)
+		return 'C';
+	else if (g <= 7)
+		return 'D';
+	else
+		return 'F';
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//The formats a ReportRenderer writes. Each lists the students in index order and their courses in enrolment order.
+enum ReportFormat : uint8_t
+{
+	reportText, //Per student: "Student at index i: " and the student, a line per course with its letter grade, the GPA
+				//and a blank line
+	reportCsv, //A header row, then a row per enrolment: studentIndex, firstName, lastName, courseName, creditHours,
+				//letterGrade, gpa. Students with no enrolments have no rows.
+	reportJsonLines //An object per student: {"index", "firstName", "lastName", "dob": {"d", "m", "y"}, "gpa",
+					//"courses": [{"name", "creditHours", "grade"}]}
+};
+
+//Renders the transcripts of every student in a snapshot to a file. The students are formatted a block at a time into
+//one buffer per part of the block, with numbers formatted by to_chars rather than through a stream, and each block is
+//written out with a single call (writev over the buffers in order on POSIX). The buffers are kept from block to block
+//and from report to report, so once they have grown a report allocates nothing. Given a pool, the parts of a block are
+//rendered in parallel; the output is the same whatever the number of threads.
+
+class ReportRenderer
+{
+private:
+	SmarterArray<string> buffers; //One per part of a block
+	uint64_t bytesWritten; //The size of the last report
+
+	static const int studentsPerPart = 4096;
+
+	static void appendInt(string& out, const int& value);
+	static void appendDouble(string& out, const double& value); //As an ostream with default settings writes it
+	static void appendCsvField(string& out, const string_view& value); //Quoted if it contains a comma, quote or line break
+	static void appendJsonString(string& out, const string_view& value);
+
+public:
+	ReportRenderer();
+
+	static void renderStudents(const SchoolSnapshot& snapshot, const ReportFormat& format, const int& begin, const int& end,
+		string& out); //Append the transcripts of the students [begin, end) to out
+	bool render(const SchoolSnapshot& snapshot, const ReportFormat& format, const string& path, ThreadPool* pool = nullptr);
+																	//Write the report to a file, replacing it. Return
+																	//false on an I/O error.
+	uint64_t getBytesWritten() const; //Return the number of bytes the last report wrote
+};
+
+ReportRenderer::ReportRenderer()
+{
+	bytesWritten = 0;
+}
+
+void ReportRenderer::appendInt(string& out, const int& value)
+{
+	char digits[16];
+	out.append(digits, to_chars(digits, digits + sizeof digits, value).ptr);
+}
+
+void ReportRenderer::appendDouble(string& out, const double& value)
+{
+	char digits[32];
+	out.append(digits, to_chars(digits, digits + sizeof digits, value, chars_format::general, 6).ptr);
+}
+
+void ReportRenderer::appendCsvField(string& out, const string_view& value)
+{
+	bool plain = true;
+	for (char c : value)
+		plain &= c != ',' && c != '"' && c != '\r' && c != '\n';
+	if (plain)
+	{
+		out.append(value);
+		return;
+	}
+
+	out.push_back('"');
+	for (char c : value)
+	{
+		if (c == '"')
+			out.push_back('"');
+		out.push_back(c);
+	}
+	out.push_back('"');
+}
+
+void ReportRenderer::appendJsonString(string& out, const string_view& value)
+{
+	out.push_back('"');
+	for (char c : value)
+	{
+		if (c == '"' || c == '\\')
+		{
+			out.push_back('\\');
+			out.push_back(c);
+		}
+		else if (uint8_t(c) < 0x20)
+		{
+			const char hex[] = "0123456789abcdef";
+			out.append("\\u00");
+			out.push_back(hex[uint8_t(c) >> 4]);
+			out.push_back(hex[uint8_t(c) & 0xf]);
+		}
+		else
+			out.push_back(c);
+	}
+	out.push_back('"');
+}
+
+void ReportRenderer::renderStudents(const SchoolSnapshot& snapshot, const ReportFormat& format, const int& begin, const int& end,
+	string& out)
+{
+	assert(begin >= 0 && begin <= end && end <= snapshot.getNumberOfRegisteredStudents());
+
+	for (int i = begin; i < end; i++)
+	{
+		StudentView student = snapshot.viewStudent(i);
+		StudentMapView courses = snapshot.viewStudentMap(i);
+		double gpa = snapshot.getStudentGPA(i);
+
+		if (format == reportText)
+		{
+			Date dob = student.getDob();
+			out.append("Student at index ");
+			appendInt(out, i);
+			out.append(": Full Name = ");
+			out.append(student.getFirstName());
+			out.push_back(' ');
+			out.append(student.getLastName());
+			out.append(": DOB (d-m-y) = ");
+			appendInt(out, dob.d);
+			out.push_back('-');
+			appendInt(out, dob.m);
+			out.push_back('-');
+			appendInt(out, dob.y);
+			out.push_back('\n');
+			for (int j = 0; j < courses.getSize(); j++)
+			{
+				CourseView course = snapshot.viewCourse(courses.keyAtIndex(j));
+				out.append("Course Name = ");
+				out.append(course.getCourseName());
+				out.append(", Credit Hours = ");
+				appendInt(out, course.getCreditHours());
+				out.append(", Letter Grade = ");
+				out.push_back(courses.valueAtIndex(j));
+				out.push_back('\n');
+			}
+			out.append("GPA = ");
+			appendDouble(out, gpa);
+			out.append("\n\n");
+		}
+		else if (format == reportCsv)
+		{
+			//Every row of the student ends in the same GPA, so it is formatted once
+			char gpaDigits[32];
+			string_view gpaField(gpaDigits, size_t(to_chars(gpaDigits, gpaDigits + sizeof gpaDigits, gpa, chars_format::general, 6).ptr -
+				gpaDigits));
+			for (int j = 0; j < courses.getSize(); j++)
+			{
+				CourseView course = snapshot.viewCourse(courses.keyAtIndex(j));
+				appendInt(out, i);
+				out.push_back(',');
+				appendCsvField(out, student.getFirstName());
+				out.push_back(',');
+				appendCsvField(out, student.getLastName());
+				out.push_back(',');
+				appendCsvField(out, course.getCourseName());
+				out.push_back(',');
+				appendInt(out, course.getCreditHours());
+				out.push_back(',');
+				out.push_back(courses.valueAtIndex(j));
+				out.push_back(',');
+				out.append(gpaField);
+				out.push_back('\n');
+			}
+		}
+		else
+		{
+			Date dob = student.getDob();
+			out.append("{\"index\":");
+			appendInt(out, i);
+			out.append(",\"firstName\":");
+			appendJsonString(out, student.getFirstName());
+			out.append(",\"lastName\":");
+			appendJsonString(out, student.getLastName());
+			out.append(",\"dob\":{\"d\":");
+			appendInt(out, dob.d);
+			out.append(",\"m\":");
+			appendInt(out, dob.m);
+			out.append(",\"y\":");
+			appendInt(out, dob.y);
+			out.append("},\"gpa\":");
+			appendDouble(out, gpa);
+			out.append(",\"courses\":[");
+			for (int j = 0; j < courses.getSize(); j++)
+			{
+				CourseView course = snapshot.viewCourse(courses.keyAtIndex(j));
+				out.append(j == 0 ? "{\"name\":" : ",{\"name\":");
+				appendJsonString(out, course.getCourseName());
+				out.append(",\"creditHours\":");
+				appendInt(out, course.getCreditHours());
+				out.append(",\"grade\":\"");
+				out.push_back(courses.valueAtIndex(j));
+				out.append("\"}");
+			}
+			out.append("]}\n");
+		}
+	}
+}
+
+bool ReportRenderer::render(const SchoolSnapshot& snapshot, const ReportFormat& format, const string& path, ThreadPool* pool)
+{
+	bytesWritten = 0;
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+#else
+	int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1)
+		return false;
+#endif
+
+	//Write out the parts [0, parts) of buffers in order, returning false on an I/O error
+	auto writeParts = [&](const int& parts)
+	{
+#ifdef _WIN32
+		for (int p = 0; p < parts; p++)
+		{
+			DWORD written = 0;
+			if (!buffers[p].empty() && (!WriteFile(file, buffers[p].data(), DWORD(buffers[p].size()), &written, nullptr) ||
+				written != buffers[p].size()))
+				return false;
+			bytesWritten += buffers[p].size();
+		}
+#else
+		SmarterArray<iovec> pending;
+		for (int p = 0; p < parts; p++)
+		{
+			if (!buffers[p].empty())
+				pending.append(iovec{ &buffers[p][0], buffers[p].size() });
+		}
+		for (int first = 0; first < pending.getSize();)
+		{
+			ssize_t n = ::writev(fd, &pending[first], min(pending.getSize() - first, 1024));
+			if (n <= 0)
+				return false;
+			bytesWritten += uint64_t(n);
+			//Skip what was written, which may end partway through a buffer
+			for (size_t done = size_t(n); done > 0;)
+			{
+				size_t step = min(done, pending[first].iov_len);
+				pending[first].iov_base = static_cast<char*>(pending[first].iov_base) + step;
+				pending[first].iov_len -= step;
+				done -= step;
+				if (pending[first].iov_len == 0)
+					first++;
+			}
+		}
+#endif
+		return true;
+	};
+
+	int n = snapshot.getNumberOfRegisteredStudents();
+	int parts = pool == nullptr ? 1 : pool->getThreadCount() * 4;
+	while (buffers.getSize() < parts)
+		buffers.emplace_back();
+
+	bool ok = true;
+	if (format == reportCsv)
+	{
+		buffers[0].assign("studentIndex,firstName,lastName,courseName,creditHours,letterGrade,gpa\n");
+		ok = writeParts(1);
+	}
+
+	int block = 0;
+	function<void(const int&, const int&)> body = [&](const int& begin, const int& end)
+	{
+		for (int p = begin; p < end; p++)
+		{
+			buffers[p].clear();
+			renderStudents(snapshot, format, min(n, block + p * studentsPerPart), min(n, block + (p + 1) * studentsPerPart), buffers[p]);
+		}
+	};
+	for (; block < n && ok; block += parts * studentsPerPart)
+	{
+		if (pool == nullptr)
+			body(0, parts);
+		else
+			pool->parallelFor(parts, body);
+		ok = writeParts(parts);
+	}
+
+#ifdef _WIN32
+	ok = CloseHandle(file) && ok;
+#else
+	ok = ::close(fd) == 0 && ok;
+#endif
+	return ok;
+}
+
+uint64_t ReportRenderer::getBytesWritten() const
+{
+	return bytesWritten;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//A SchoolManagementSystem that many threads can share. Writes take the lock exclusively, one at a time, so every write
+//takes effect at a single point between the reads that see the system before it and the reads that see it after. The
+//reads a snapshot can answer (the counts, and students, GPAs and courses by index) use the latest published snapshot
+//(see SchoolSnapshot) and do not wait, not even for a write that is flushing its log record to disk. Every other read
+//takes the lock shared, so it runs in parallel with other reads and waits while a write is applied and logged.
+//
+//A write publishes a snapshot before it lets go of the lock if a read has used the last one. Publishing costs the next
+//write a copy of the chunks it changes, about 7 us for a grade posting on 100k students, so a run of writes that no
+//read looks at publishes nothing, and the first read after it takes the lock shared to publish the snapshot itself.
+//Everything is returned by value, since a reference or view would outlive the lock or the snapshot.
+//
+//An index is only meaningful inside the call it is used in: another thread's removal can move a student or course to
+//a different index between two calls. Use ids across calls, and read or write to run several steps as one. Every
+//query and mutation that takes a student or course also takes its id: the id is resolved under the same lock the
+//operation runs under, and a student or course removed in the meantime gives false, -1 or an empty result.
+//
+//A seat request is decided under the shared lock. One that is refused, or that finds its course full, is answered
+//there: a request for a full course is queued in the lane of its course under the lane's own mutex, so that a rush on
+//a few full courses holds up neither readers nor requests for other courses. The queued requests join their
+//waitlists, in order, at the start of the next write, and before any read that can see a waitlist. Only a request for
+//a free seat, which changes the student's enrolments and rank, takes the lock exclusively. While a log is attached
+//every request does, so that none is answered before its record is written.
+
+class ConcurrentSchoolManagementSystem
+{
+private:
+	struct SeatArrival //A request for a seat in a full course that has not joined the course's waitlist yet
+	{
+		StudentId student;
+		CourseId course;
+	};
+
+	struct ArrivalLane //The queued requests for the courses whose ids map to the lane
+	{
+		mutex lock; //Taken under the shared lock
+		SmarterArray<SeatArrival> arrivals; //First come first
+		HashIndex places; //Positions in arrivals hashed by student and course
+	};
+
+	static const int arrivalLaneCount = 64;
+
+	mutable SchoolManagementSystem sms; //Mutable so that a read can first put the requests queued before it on waitlists
+	mutable shared_mutex lock;
+	mutable ArrivalLane arrivalLanes[arrivalLaneCount]; //By course id
+	mutable atomic<int> arrivalCount; //The requests queued in every lane
+
+	class WriteLock //Holds the lock exclusively
+	{
+	private:
+		const ConcurrentSchoolManagementSystem& system;
+		unique_lock<shared_mutex> guard;
+		bool publishAlways;
+
+	public:
+		explicit WriteLock(const ConcurrentSchoolManagementSystem& system, const bool& publishAlways = false); //Take the
+									//lock and put the queued requests on their waitlists
+		WriteLock(const WriteLock&) = delete;
+		WriteLock& operator = (const WriteLock&) = delete;
+		~WriteLock(); //Publish a snapshot if a read has used the last one (always if publishAlways) and release the lock
+	};
+
+	mutable shared_ptr<const SchoolSnapshot> published; //Read and replaced through atomic_load and atomic_store
+	mutable atomic<uint64_t> committedSequence; //The sequence number of the last write; published is current if it matches
+	mutable atomic<bool> snapshotWanted; //A read has used the published snapshot since the last write published one
+
+	static size_t hashArrival(const StudentId& student, const CourseId& course);
+	shared_lock<shared_mutex> lockForWaitlists() const; //Take the lock shared once the requests queued before the call
+														//are on their waitlists
+	shared_ptr<const SchoolSnapshot> latestSnapshot() const; //Return a snapshot that includes every finished write
+
+public:
+	ConcurrentSchoolManagementSystem();
+	ConcurrentSchoolManagementSystem(const ConcurrentSchoolManagementSystem&) = delete;
+	ConcurrentSchoolManagementSystem& operator = (const ConcurrentSchoolManagementSystem&) = delete;
+
+	int getNumberOfRegisteredStudents() const;
+	int getNumberOfCoursesOffered() const;
+
+	int findStudent(const string_view& firstName, const string_view& lastName) const;
+	Student getStudent(const int& studentIndex) const;
+	StudentId getStudentId(const int& studentIndex) const;
+	int getStudentIndex(const StudentId& id) const;
+	double getStudentGPA(const int& studentIndex) const;
+	int getTopStudentIndex() const;
+	int findCourse(const string_view& courseName) const;
+	Course getCourse(const int& courseIndex) const;
+	CourseId getCourseId(const int& courseIndex) const;
+	int getCourseIndex(const CourseId& id) const;
+	int getCourseCapacity(const int& courseIndex) const;
+	SmarterArray<int> getWaitlist(const int& courseIndex) const;
+	SmarterArray<int> findCoursesByPrefix(const string_view& prefix, const int& maxResults) const;
+	SmarterArray<int> findCoursesLike(const string_view& courseName, const int& maxDistance, const int& maxResults) const;
+	SmarterArray<int> findStudentsByPrefix(const string_view& lastNamePrefix, const string_view& firstNamePrefix, const int& maxResults) const;
+	SmarterArray<int> findStudentsLike(const string_view& lastName, const int& maxDistance, const int& maxResults) const;
+	SchoolSnapshot takeSnapshot() const; //Return the latest published snapshot. O(1).
+
+	bool registerStudent(const Student& s);
+	bool enrolStudent(const int& studentIndex, const int& courseIndex);
+	void removeStudent(const int& studentIndex);
+	bool withdrawStudent(const int& studentIndex, const int& courseIndex);
+	bool assignLetterGrade(const int& studentIndex, const int& courseIndex, const char& letterGrade);
+	bool applyBatch(const SmarterArray<EnrolmentOperation>& operations, int* failedOperation = nullptr); //Readers see all
+																									//of the batch or none
+	bool offerCourse(const Course& course);
+	void removeCourse(const int& courseIndex);
+	void setCourseCreditHours(const int& courseIndex, const int& creditHours);
+	void setCourseCapacity(const int& courseIndex, const int& capacity);
+	SeatStatus requestSeat(const StudentId& student, const CourseId& course); //Rejected if either has been removed
+	bool leaveWaitlist(const int& studentIndex, const int& courseIndex);
+
+	Student getStudent(const StudentId& student) const; //The default student if removed
+	double getStudentGPA(const StudentId& student) const; //-1 if removed
+	Course getCourse(const CourseId& course) const; //The default course if removed
+	int getCourseCapacity(const CourseId& course) const; //-1 if removed
+	SmarterArray<StudentId> getWaitlist(const CourseId& course) const; //Empty if removed
+	bool enrolStudent(const StudentId& student, const CourseId& course);
+	bool removeStudent(const StudentId& student);
+	bool withdrawStudent(const StudentId& student, const CourseId& course);
+	bool assignLetterGrade(const StudentId& student, const CourseId& course, const char& letterGrade);
+	bool removeCourse(const CourseId& course);
+	bool setCourseCreditHours(const CourseId& course, const int& creditHours);
+	bool setCourseCapacity(const CourseId& course, const int& capacity);
+	bool leaveWaitlist(const StudentId& student, const CourseId& course);
+
+	template <class F>
+	auto read(const F& f) const -> decltype(f(sms)); //Call f with the system under the shared lock and return its result
+	template <class F>
+	auto write(const F& f) -> decltype(f(sms)); //Call f with the system under the exclusive lock and return its result
+};
+
+ConcurrentSchoolManagementSystem::ConcurrentSchoolManagementSystem() : arrivalCount(0), committedSequence(0), snapshotWanted(false)
+{
+	published = make_shared<const SchoolSnapshot>(sms.takeSnapshot());
+}
+
+ConcurrentSchoolManagementSystem::WriteLock::WriteLock(const ConcurrentSchoolManagementSystem& system, const bool& publishAlways) :
+	system(system), guard(system.lock), publishAlways(publishAlways)
+{
+	if (system.arrivalCount.load() == 0)
+		return;
+
+	//Every queued request joins its waitlist: its course was full when it was queued and stays full until a write,
+	//and nothing queues while the lock is held exclusively
+	for (int i = 0; i < arrivalLaneCount; i++)
+	{
+		ArrivalLane& lane = system.arrivalLanes[i];
+		for (int j = 0; j < lane.arrivals.getSize(); j++)
+			system.sms.requestSeat(system.sms.getStudentIndex(lane.arrivals[j].student), system.sms.getCourseIndex(lane.arrivals[j].course));
+		lane.arrivals = SmarterArray<SeatArrival>();
+		lane.places.clear();
+	}
+	system.arrivalCount = 0;
+}
+
+ConcurrentSchoolManagementSystem::WriteLock::~WriteLock()
+{
+	//Every mutator moves the sequence number, so a write that did not move it changed nothing and the snapshot stays current
+	if (!publishAlways && system.sms.getLogSequence() == system.committedSequence.load())
+		return;
+
+	//A snapshot makes the next write copy the chunks it changes, so it is only worth publishing while reads use them.
+	//Otherwise the first read after the write publishes one (see latestSnapshot).
+	if (publishAlways || system.snapshotWanted.exchange(false))
+		atomic_store(&system.published, make_shared<const SchoolSnapshot>(system.sms.takeSnapshot()));
+	system.committedSequence = system.sms.getLogSequence();
+}
+
+size_t ConcurrentSchoolManagementSystem::hashArrival(const StudentId& student, const CourseId& course)
+{
+	return size_t((uint64_t(student) << 32 | course) * 0x9e3779b97f4a7c15ull >> 32);
+}
+
+shared_lock<shared_mutex> ConcurrentSchoolManagementSystem::lockForWaitlists() const
+{
+	//A request queued after the check is concurrent with the read, which may be ordered before it
+	if (arrivalCount.load() != 0)
+	{
+		WriteLock guard(*this);
+	}
+	return shared_lock<shared_mutex>(lock);
+}
+
+shared_ptr<const SchoolSnapshot> ConcurrentSchoolManagementSystem::latestSnapshot() const
+{
+	if (!snapshotWanted.load())
+		snapshotWanted = true;
+
+	//A write publishes before it moves committedSequence, so a snapshot that matches includes every finished write
+	shared_ptr<const SchoolSnapshot> snapshot = atomic_load(&published);
+	if (snapshot->getSequence() == committedSequence.load())
+		return snapshot;
+
+	//The last write published nothing. Readers that race here publish equal snapshots, since no write can run.
+	shared_lock<shared_mutex> guard(lock);
+	snapshot = atomic_load(&published);
+	if (snapshot->getSequence() != sms.getLogSequence())
+	{
+		snapshot = make_shared<const SchoolSnapshot>(sms.takeSnapshot());
+		atomic_store(&published, snapshot);
+	}
+	return snapshot;
+}
+
+int ConcurrentSchoolManagementSystem::getNumberOfRegisteredStudents() const
+{
+	return latestSnapshot()->getNumberOfRegisteredStudents();
+}
+
+int ConcurrentSchoolManagementSystem::getNumberOfCoursesOffered() const
+{
+	return latestSnapshot()->getNumberOfCoursesOffered();
+}
+
+int ConcurrentSchoolManagementSystem::findStudent(const string_view& firstName, const string_view& lastName) const
+{
+	shared_lock<shared_mutex> guard(lock);
+	return sms.findStudent(firstName, lastName);
+}
+
+Student ConcurrentSchoolManagementSystem::getStudent(const int& studentIndex) const
+{
+	return latestSnapshot()->getStudent(studentIndex);
+}
+
+StudentId ConcurrentSchoolManagementSystem::getStudentId(const int& studentIndex) const
+{
+	shared_lock<shared_mutex> guard(lock);
+	return sms.getStudentId(studentIndex);
+}
+
+int ConcurrentSchoolManagementSystem::getStudentIndex(const StudentId& id) const
+{
+	shared_lock<shared_mutex> guard(lock);
+	return sms.getStudentIndex(id);
+}
+
+double ConcurrentSchoolManagementSystem::getStudentGPA(const int& studentIndex) const
+{
+	return latestSnapshot()->getStudentGPA(studentIndex);
+}
+
+int ConcurrentSchoolManagementSystem::getTopStudentIndex() const
+{
+	shared_lock<shared_mutex> guard(lock);
+	return sms.getTopStudentIndex();
+}
+
+int ConcurrentSchoolManagementSystem::findCourse(const string_view& courseName) const
+{
+	shared_lock<shared_mutex> guard(lock);
+	return sms.findCourse(courseName);
+}
+
+Course ConcurrentSchoolManagementSystem::getCourse(const int& courseIndex) const
+{
+	return latestSnapshot()->getCourse(courseIndex);
+}
+
+CourseId ConcurrentSchoolManagementSystem::getCourseId(const int& courseIndex) const
+{
+	shared_lock<shared_mutex> guard(lock);
+	return sms.getCourseId(courseIndex);
+}
+
+int ConcurrentSchoolManagementSystem::getCourseIndex(const CourseId& id) const
+{
+	shared_lock<shared_mutex> guard(lock);
+	return sms.getCourseIndex(id);
+}
+
+int ConcurrentSchoolManagementSystem::getCourseCapacity(const int& courseIndex) const
+{
+	shared_lock<shared_mutex> guard(lock);
+	return sms.getCourseCapacity(courseIndex);
+}
+
+SmarterArray<int> ConcurrentSchoolManagementSystem::getWaitlist(const int& courseIndex) const
+{
+	shared_lock<shared_mutex> guard = lockForWaitlists();
+	return sms.getWaitlist(courseIndex);
+}
+
+SmarterArray<int> ConcurrentSchoolManagementSystem::findCoursesByPrefix(const string_view& prefix, const int& maxResults) const
+{
+	shared_lock<shared_mutex> guard(lock);
+	return sms.findCoursesByPrefix(prefix, maxResults);
+}
+
+SmarterArray<int> ConcurrentSchoolManagementSystem::findCoursesLike(const string_view& courseName, const int& maxDistance, const int& maxResults) const
+{
+	shared_lock<shared_mutex> guard(lock);
+	return sms.findCoursesLike(courseName, maxDistance, maxResults);
+}
+
+SmarterArray<int> ConcurrentSchoolManagementSystem::findStudentsByPrefix(const string_view& lastNamePrefix, const string_view& firstNamePrefix,
+																		const int& maxResults) const
+{
+	shared_lock<shared_mutex> guard(lock);
+	return sms.findStudentsByPrefix(lastNamePrefix, firstNamePrefix, maxResults);
+}
+
+SmarterArray<int> ConcurrentSchoolManagementSystem::findStudentsLike(const string_view& lastName, const int& maxDistance, const int& maxResults) const
+{
+	shared_lock<shared_mutex> guard(lock);
+	return sms.findStudentsLike(lastName, maxDistance, maxResults);
+}
+
+SchoolSnapshot ConcurrentSchoolManagementSystem::takeSnapshot() const
+{
+	return *latestSnapshot();
+}
+
+bool ConcurrentSchoolManagementSystem::registerStudent(const Student& s)
+{
+	WriteLock guard(*this);
+	return sms.registerStudent(s);
+}
+
+bool ConcurrentSchoolManagementSystem::enrolStudent(const int& studentIndex, const int& courseIndex)
+{
+	WriteLock guard(*this);
+	return sms.enrolStudent(studentIndex, courseIndex);
+}
+
+void ConcurrentSchoolManagementSystem::removeStudent(const int& studentIndex)
+{
+	WriteLock guard(*this);
+	sms.removeStudent(studentIndex);
+}
+
+bool ConcurrentSchoolManagementSystem::withdrawStudent(const int& studentIndex, const int& courseIndex)
+{
+	WriteLock guard(*this);
+	return sms.withdrawStudent(studentIndex, courseIndex);
+}
+
+bool ConcurrentSchoolManagementSystem::assignLetterGrade(const int& studentIndex, const int& courseIndex, const char& letterGrade)
+{
+	WriteLock guard(*this);
+	return sms.assignLetterGrade(studentIndex, courseIndex, letterGrade);
+}
+
+bool ConcurrentSchoolManagementSystem::applyBatch(const SmarterArray<EnrolmentOperation>& operations, int* failedOperation)
+{
+	WriteLock guard(*this);
+	return sms.applyBatch(operations, failedOperation);
+}
+
+bool ConcurrentSchoolManagementSystem::offerCourse(const Course& course)
+{
+	WriteLock guard(*this);
+	return sms.offerCourse(course);
+}
+
+void ConcurrentSchoolManagementSystem::removeCourse(const int& courseIndex)
+{
+	WriteLock guard(*this);
+	sms.removeCourse(courseIndex);
+}
+
+void ConcurrentSchoolManagementSystem::setCourseCreditHours(const int& courseIndex, const int& creditHours)
+{
+	WriteLock guard(*this);
+	sms.setCourseCreditHours(courseIndex, creditHours);
+}
+
+void ConcurrentSchoolManagementSystem::setCourseCapacity(const int& courseIndex, const int& capacity)
+{
+	WriteLock guard(*this);
+	sms.setCourseCapacity(courseIndex, capacity);
+}
+
+SeatStatus ConcurrentSchoolManagementSystem::requestSeat(const StudentId& student, const CourseId& course)
+{
+	{
+		shared_lock<shared_mutex> guard(lock);
+		int studentIndex = sms.getStudentIndex(student), courseIndex = sms.getCourseIndex(course);
+		if (studentIndex == -1 || courseIndex == -1)
+			return seatRejected;
+
+		SeatStatus status = sms.previewSeatRequest(studentIndex, courseIndex);
+		if (status == seatRejected)
+			return seatRejected;
+		if (status == seatWaitlisted && !sms.isLogging())
+		{
+			//The course stays full until a write, so the request can be answered now and join the waitlist then.
+			//A student's request already in the lane is still refused.
+			ArrivalLane& lane = arrivalLanes[course % arrivalLaneCount];
+			size_t hash = hashArrival(student, course);
+			lock_guard<mutex> laneGuard(lane.lock);
+			auto isPlace = [&](const int& i) { return lane.arrivals[i].student == student && lane.arrivals[i].course == course; };
+			if (lane.places.find(hash, isPlace) != -1)
+				return seatRejected;
+
+			lane.places.insert(hash, lane.arrivals.getSize());
+			lane.arrivals.append(SeatArrival{ student, course });
+			arrivalCount++;
+			return seatWaitlisted;
+		}
+	}
+
+	//A free seat, or a log to write: decide again under the exclusive lock, since another request may have taken the seat
+	WriteLock guard(*this);
+	int studentIndex = sms.getStudentIndex(student), courseIndex = sms.getCourseIndex(course);
+	return studentIndex == -1 || courseIndex == -1 ? seatRejected : sms.requestSeat(studentIndex, courseIndex);
+}
+
+bool ConcurrentSchoolManagementSystem::leaveWaitlist(const int& studentIndex, const int& courseIndex)
+{
+	WriteLock guard(*this);
+	return sms.leaveWaitlist(studentIndex, courseIndex);
+}
+
+Student ConcurrentSchoolManagementSystem::getStudent(const StudentId& student) const
+{
+	shared_lock<shared_mutex> guard(lock);
+	int studentIndex = sms.getStudentIndex(student);
+	return studentIndex == -1 ? Student() : sms.getStudent(studentIndex);
+}
+
+double ConcurrentSchoolManagementSystem::getStudentGPA(const StudentId& student) const
+{
+	shared_lock<shared_mutex> guard(lock);
+	int studentIndex = sms.getStudentIndex(student);
+	return studentIndex == -1 ? -1.0 : sms.getStudentGPA(studentIndex);
+}
+
+Course ConcurrentSchoolManagementSystem::getCourse(const CourseId& course) const
+{
+	shared_lock<shared_mutex> guard(lock);
+	int courseIndex = sms.getCourseIndex(course);
+	return courseIndex == -1 ? Course() : sms.getCourse(courseIndex);
+}
+
+int ConcurrentSchoolManagementSystem::getCourseCapacity(const CourseId& course) const
+{
+	shared_lock<shared_mutex> guard(lock);
+	int courseIndex = sms.getCourseIndex(course);
+	return courseIndex == -1 ? -1 : sms.getCourseCapacity(courseIndex);
+}
+
+SmarterArray<StudentId> ConcurrentSchoolManagementSystem::getWaitlist(const CourseId& course) const
+{
+	shared_lock<shared_mutex> guard = lockForWaitlists();
+	SmarterArray<StudentId> waitlist;
+	int courseIndex = sms.getCourseIndex(course);
+	if (courseIndex == -1)
+		return waitlist;
+
+	SmarterArray<int> students = sms.getWaitlist(courseIndex);
+	waitlist.reserve(students.getSize());
+	for (int i = 0; i < students.getSize(); i++)
+		waitlist.append(sms.getStudentId(students[i]));
+	return waitlist;
+}
+
+bool ConcurrentSchoolManagementSystem::enrolStudent(const StudentId& student, const CourseId& course)
+{
+	WriteLock guard(*this);
+	int studentIndex = sms.getStudentIndex(student), courseIndex = sms.getCourseIndex(course);
+	return studentIndex != -1 && courseIndex != -1 && sms.enrolStudent(studentIndex, courseIndex);
+}
+
+bool ConcurrentSchoolManagementSystem::removeStudent(const StudentId& student)
+{
+	WriteLock guard(*this);
+	int studentIndex = sms.getStudentIndex(student);
+	if (studentIndex == -1)
+		return false;
+
+	sms.removeStudent(studentIndex);
+	return true;
+}
+
+bool ConcurrentSchoolManagementSystem::withdrawStudent(const StudentId& student, const CourseId& course)
+{
+	WriteLock guard(*this);
+	int studentIndex = sms.getStudentIndex(student), courseIndex = sms.getCourseIndex(course);
+	return studentIndex != -1 && courseIndex != -1 && sms.withdrawStudent(studentIndex, courseIndex);
+}
+
+bool ConcurrentSchoolManagementSystem::assignLetterGrade(const StudentId& student, const CourseId& course, const char& letterGrade)
+{
+	WriteLock guard(*this);
+	int studentIndex = sms.getStudentIndex(student), courseIndex = sms.getCourseIndex(course);
+	return studentIndex != -1 && courseIndex != -1 && sms.assignLetterGrade(studentIndex, courseIndex, letterGrade);
+}
+
+bool ConcurrentSchoolManagementSystem::removeCourse(const CourseId& course)
+{
+	WriteLock guard(*this);
+	int courseIndex = sms.getCourseIndex(course);
+	if (courseIndex == -1)
+		return false;
+
+	sms.removeCourse(courseIndex);
+	return true;
+}
+
+bool ConcurrentSchoolManagementSystem::setCourseCreditHours(const CourseId& course, const int& creditHours)
+{
+	WriteLock guard(*this);
+	int courseIndex = sms.getCourseIndex(course);
+	if (courseIndex == -1)
+		return false;
+
+	sms.setCourseCreditHours(courseIndex, creditHours);
+	return true;
+}
+
+bool ConcurrentSchoolManagementSystem::setCourseCapacity(const CourseId& course, const int& capacity)
+{
+	WriteLock guard(*this);
+	int courseIndex = sms.getCourseIndex(course);
+	if (courseIndex == -1)
+		return false;
+
+	sms.setCourseCapacity(courseIndex, capacity);
+	return true;
+}
+
+bool ConcurrentSchoolManagementSystem::leaveWaitlist(const StudentId& student, const CourseId& course)
+{
+	WriteLock guard(*this);
+	int studentIndex = sms.getStudentIndex(student), courseIndex = sms.getCourseIndex(course);
+	return studentIndex != -1 && courseIndex != -1 && sms.leaveWaitlist(studentIndex, courseIndex);
+}
+
+template <class F>
+auto ConcurrentSchoolManagementSystem::read(const F& f) const -> decltype(f(sms))
+{
+	shared_lock<shared_mutex> guard = lockForWaitlists();
+	return f(sms);
+}
+
+template <class F>
+auto ConcurrentSchoolManagementSystem::write(const F& f) -> decltype(f(sms))
+{
+	WriteLock guard(*this, true); //f may load a snapshot, which can change the system without moving the sequence number
+	return f(sms);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//Students partitioned by a hash of their name across a fixed number of independent shards, so that mutations of
+//students on different shards do not wait for each other. Every shard holds a replica of the same course list, kept
+//at the same indices. A course change holds the exclusive lock of every shard while it is applied, so an operation on
+//any shard sees it on all shards or on none. Queries over all students visit every shard and merge the results.
+//
+//Seat limits and waitlists span the shards, so they are kept here and the replicas have no seat limit. Each course
+//has a count of the seats taken on every shard and a waitlist, under a mutex of its own. A request that is refused or
+//joins the waitlist holds only the shared lock of the student's shard; one for a free seat takes it exclusively. A
+//seat freed on one shard goes to the front of the waitlist, which may be on another shard, so the student there is
+//seated once the first shard's lock has been released. Until then no one else can take the seat.
+
+struct StudentLocation
+{
+	int shard; //The shard the student lives on
+	int studentIndex; //The index of the student within its shard, or -1 if there is no such student
+};
+
+class ShardedSchoolManagementSystem
+{
+private:
+	struct WaitingStudent
+	{
+		int shard; //-1 once the student has left the line
+		StudentId student; //The id of the student on its shard
+	};
+
+	struct CourseSeats //The seat limit and waitlist of one course
+	{
+		mutex lock; //Taken under the lock of a shard, never the other way round
+		int capacity; //unlimitedSeats if the course has no seat limit
+		int taken; //The students enrolled on every shard. Kept up to date only while the course has a seat limit.
+		SmarterArray<WaitingStudent> waitlist; //The places from waitlistStart on, first in line first
+		int waitlistStart; //The first place not left, or the size of waitlist if no one is waiting
+		HashIndex waitlistIndex; //Positions in waitlist of the places not left, hashed by shard and id
+	};
+
+	SmarterArray<ConcurrentSchoolManagementSystem*> shards; //Owned
+	SmarterArray<CourseSeats*> courseSeats; //Owned, at the index of their course. Changed only under the lock of every
+											//shard, as are the capacities, so the lock of any one keeps them still.
+
+	static size_t hashWaitingStudent(const int& shard, const StudentId& student);
+	static int findWaitingStudent(const CourseSeats& seats, const int& shard, const StudentId& student); //Return the
+																					//position of the place, or -1
+	static void joinWaitlist(CourseSeats& seats, const int& shard, const StudentId& student);
+	static void leaveWaitlistAt(CourseSeats& seats, const int& position); //Mark the place left and drop the places left
+																		//at the front. Amortized O(1).
+	void promoteWaitlisted(const CourseId& course); //Give the free seats of a course to the front of its waitlist,
+													//each under the lock of the shard of the student seated
+	template <class F>
+	void writeEveryShard(const F& f, SmarterArray<SchoolManagementSystem*>& held); //Take the exclusive locks of the
+										//shards after those in held, in shard order, then call f(shard, system) for each
+	template <class F>
+	void readEveryShard(const F& f, SmarterArray<const SchoolManagementSystem*>& held) const; //The same with shared locks
+	static bool isStudentIn(const SchoolManagementSystem& sms, const StudentLocation& student); //Return false if the
+										//location is -1 or has fallen past the end of its shard, under the shard's lock
+
+public:
+	explicit ShardedSchoolManagementSystem(const int& shardCount);
+	ShardedSchoolManagementSystem(const ShardedSchoolManagementSystem&) = delete;
+	ShardedSchoolManagementSystem& operator = (const ShardedSchoolManagementSystem&) = delete;
+	~ShardedSchoolManagementSystem();
+
+	int getShardCount() const;
+	int getShardOf(const string_view& firstName, const string_view& lastName) const; //Return the shard a student's name maps to
+	const ConcurrentSchoolManagementSystem& getShard(const int& shard) const; //Read only: a course changed on one shard
+																			//would no longer match the other replicas.
+																			//Its courses have no seat limit.
+
+	int getNumberOfRegisteredStudents() const; //Summed over every shard
+	int getNumberOfCoursesOffered() const;
+
+	StudentLocation findStudent(const string_view& firstName, const string_view& lastName) const;
+	Student getStudent(const StudentLocation& student) const; //Return the default student if there is no such student
+	double getStudentGPA(const StudentLocation& student) const; //Return -1 if there is no such student
+	StudentLocation getTopStudent() const; //Return the student with the highest GPA, the lowest (shard, index) among ties,
+										//or studentIndex -1 if there are no students
+	SmarterArray<StudentLocation> getCourseRoster(const int& courseIndex) const; //Shard by shard, each in roster order
+	bool registerStudent(const Student& s);
+	//The mutations of a student return false if the location no longer holds a student or the course index is out of
+	//range. A location is only as current as the findStudent that returned it.
+	bool enrolStudent(const StudentLocation& student, const int& courseIndex); //Fails if the course has no free seat
+	bool removeStudent(const StudentLocation& student);
+	bool withdrawStudent(const StudentLocation& student, const int& courseIndex); //The seat freed goes to the front of
+																				//the course's waitlist
+	bool assignLetterGrade(const StudentLocation& student, const int& courseIndex, const char& letterGrade);
+	SeatStatus requestSeat(const StudentLocation& student, const int& courseIndex); //Rejected in the same cases
+	bool leaveWaitlist(const StudentLocation& student, const int& courseIndex);
+
+	int findCourse(const string_view& courseName) const;
+	Course getCourse(const int& courseIndex) const;
+	int getCourseCapacity(const int& courseIndex) const; //Return the seat limit of a course, unlimitedSeats, or -1 if
+														//there is no such course
+	SmarterArray<StudentLocation> getWaitlist(const int& courseIndex) const; //First in line first
+	bool offerCourse(const Course& course);
+	void removeCourse(const int& courseIndex);
+	void setCourseCreditHours(const int& courseIndex, const int& creditHours);
+	void setCourseCapacity(const int& courseIndex, const int& capacity); //As SchoolManagementSystem::setCourseCapacity
+};
+
+ShardedSchoolManagementSystem::ShardedSchoolManagementSystem(const int& shardCount)
+{
+	assert(shardCount >= 1);
+
+	shards.reserve(shardCount);
+	for (int i = 0; i < shardCount; i++)
+		shards.append(new ConcurrentSchoolManagementSystem);
+}
+
+ShardedSchoolManagementSystem::~ShardedSchoolManagementSystem()
+{
+	for (int i = 0; i < shards.getSize(); i++)
+		delete shards[i];
+	for (int i = 0; i < courseSeats.getSize(); i++)
+		delete courseSeats[i];
+}
+
+int ShardedSchoolManagementSystem::getShardCount() const
+{
+	return shards.getSize();
+}
+
+int ShardedSchoolManagementSystem::getShardOf(const string_view& firstName, const string_view& lastName) const
+{
+	//Scale the hash into the shard range by its high bits. The shards' own name indices use the low bits of a similar
+	//hash, which a modulo here would leave the same for every student of a shard.
+	uint32_t h = NamePool::hashName(firstName) ^ (NamePool::hashName(lastName) * 0x9e3779b1u);
+	return int((uint64_t(h) * uint64_t(shards.getSize())) >> 32);
+}
+
+const ConcurrentSchoolManagementSystem& ShardedSchoolManagementSystem::getShard(const int& shard) const
+{
+	assert(shard >= 0 && shard < shards.getSize());
+
+	return *shards[shard];
+}
+
+int ShardedSchoolManagementSystem::getNumberOfRegisteredStudents() const
+{
+	int count = 0;
+	for (int i = 0; i < shards.getSize(); i++)
+		count += shards[i]->getNumberOfRegisteredStudents();
+	return count;
+}
+
+int ShardedSchoolManagementSystem::getNumberOfCoursesOffered() const
+{
+	return shards[0]->getNumberOfCoursesOffered();
+}
+
+StudentLocation ShardedSchoolManagementSystem::findStudent(const string_view& firstName, const string_view& lastName) const
+{
+	int shard = getShardOf(firstName, lastName);
+	return StudentLocation{ shard, shards[shard]->findStudent(firstName, lastName) };
+}
+
+Student ShardedSchoolManagementSystem::getStudent(const StudentLocation& student) const
+{
+	return getShard(student.shard).read([&](const SchoolManagementSystem& sms)
+	{
+		return isStudentIn(sms, student) ? sms.getStudent(student.studentIndex) : Student();
+	});
+}
+
+double ShardedSchoolManagementSystem::getStudentGPA(const StudentLocation& student) const
+{
+	return getShard(student.shard).read([&](const SchoolManagementSystem& sms)
+	{
+		return isStudentIn(sms, student) ? sms.getStudentGPA(student.studentIndex) : -1.0;
+	});
+}
+
+StudentLocation ShardedSchoolManagementSystem::getTopStudent() const
+{
+	StudentLocation top{ 0, -1 };
+	double topGPA = 0.0;
+	for (int i = 0; i < shards.getSize(); i++)
+	{
+		//The index and its GPA must come from the same moment of the shard
+		pair<int, double> best = shards[i]->read([](const SchoolManagementSystem& sms)
+		{
+			int index = sms.getTopStudentIndex();
+			return make_pair(index, index == -1 ? 0.0 : sms.getStudentGPA(index));
+		});
+		if (best.first != -1 && (top.studentIndex == -1 || best.second > topGPA))
+		{
+			top = StudentLocation{ i, best.first };
+			topGPA = best.second;
+		}
+	}
+	return top;
+}
+
+SmarterArray<StudentLocation> ShardedSchoolManagementSystem::getCourseRoster(const int& courseIndex) const
+{
+	//Every shard stays locked while the roster is gathered, so that a course change cannot renumber the course
+	//between one shard and the next
+	SmarterArray<StudentLocation> roster;
+	SmarterArray<const SchoolManagementSystem*> held;
+	readEveryShard([&](const int& shard, const SchoolManagementSystem& sms)
+	{
+		const SmarterArray<int>& shardRoster = sms.getCourseRoster(courseIndex);
+		for (int i = 0; i < shardRoster.getSize(); i++)
+			roster.append(StudentLocation{ shard, shardRoster[i] });
+	}, held);
+	return roster;
+}
+
+bool ShardedSchoolManagementSystem::registerStudent(const Student& s)
+{
+	return shards[getShardOf(s.getFirstName(), s.getLastName())]->registerStudent(s);
+}
+
+bool ShardedSchoolManagementSystem::enrolStudent(const StudentLocation& student, const int& courseIndex)
+{
+	return shards[student.shard]->write([&](SchoolManagementSystem& sms)
+	{
+		if (!isStudentIn(sms, student) || courseIndex < 0 || courseIndex >= sms.getNumberOfCoursesOffered())
+			return false;
+
+		CourseSeats& seats = *courseSeats[courseIndex];
+		if (seats.capacity == unlimitedSeats)
+			return sms.enrolStudent(student.studentIndex, courseIndex);
+
+		//A free seat with students waiting is already theirs
+		lock_guard<mutex> guard(seats.lock);
+		if (seats.taken >= seats.capacity || seats.waitlistStart < seats.waitlist.getSize() ||
+			!sms.enrolStudent(student.studentIndex, courseIndex))
+			return false;
+
+		seats.taken++;
+		return true;
+	});
+}
+
+bool ShardedSchoolManagementSystem::removeStudent(const StudentLocation& student)
+{
+	SmarterArray<CourseId> freed;
+	bool removed = shards[student.shard]->write([&](SchoolManagementSystem& sms)
+	{
+		if (!isStudentIn(sms, student))
+			return false;
+
+		StudentId id = sms.getStudentId(student.studentIndex);
+		StudentMapView enrolments = sms.viewStudentMap(student.studentIndex);
+		for (int courseIndex = 0; courseIndex < sms.getNumberOfCoursesOffered(); courseIndex++)
+		{
+			CourseSeats& seats = *courseSeats[courseIndex];
+			lock_guard<mutex> guard(seats.lock);
+			int position = findWaitingStudent(seats, student.shard, id);
+			if (position != -1)
+				leaveWaitlistAt(seats, position);
+			if (seats.capacity != unlimitedSeats && enrolments.find(courseIndex) != -1)
+			{
+				seats.taken--;
+				if (seats.waitlistStart < seats.waitlist.getSize())
+					freed.append(sms.getCourseId(courseIndex));
+			}
+		}
+		sms.removeStudent(student.studentIndex);
+		return true;
+	});
+
+	for (int i = 0; i < freed.getSize(); i++)
+		promoteWaitlisted(freed[i]);
+	return removed;
+}
+
+bool ShardedSchoolManagementSystem::withdrawStudent(const StudentLocation& student, const int& courseIndex)
+{
+	CourseId freed = 0;
+	bool promote = false;
+	bool withdrawn = shards[student.shard]->write([&](SchoolManagementSystem& sms)
+	{
+		if (!isStudentIn(sms, student) || courseIndex < 0 || courseIndex >= sms.getNumberOfCoursesOffered() ||
+			!sms.withdrawStudent(student.studentIndex, courseIndex))
+			return false;
+
+		CourseSeats& seats = *courseSeats[courseIndex];
+		if (seats.capacity != unlimitedSeats)
+		{
+			lock_guard<mutex> guard(seats.lock);
+			seats.taken--;
+			promote = seats.waitlistStart < seats.waitlist.getSize();
+			freed = sms.getCourseId(courseIndex);
+		}
+		return true;
+	});
+
+	if (promote)
+		promoteWaitlisted(freed);
+	return withdrawn;
+}
+
+bool ShardedSchoolManagementSystem::assignLetterGrade(const StudentLocation& student, const int& courseIndex, const char& letterGrade)
+{
+	return shards[student.shard]->write([&](SchoolManagementSystem& sms)
+	{
+		return isStudentIn(sms, student) && courseIndex >= 0 && courseIndex < sms.getNumberOfCoursesOffered() &&
+			sms.assignLetterGrade(student.studentIndex, courseIndex, letterGrade);
+	});
+}
+
+SeatStatus ShardedSchoolManagementSystem::requestSeat(const StudentLocation& student, const int& courseIndex)
+{
+	//Called under the shared lock of the student's shard with enrol null, where it stops short of taking a free seat
+	//and returns seatTaken, and then again under the exclusive lock, since another request may take the seat first
+	auto request = [&](const SchoolManagementSystem& sms, SchoolManagementSystem* enrol)
+	{
+		if (!isStudentIn(sms, student) || courseIndex < 0 || courseIndex >= sms.getNumberOfCoursesOffered())
+			return seatRejected;
+
+		StudentId id = sms.getStudentId(student.studentIndex);
+		CourseSeats& seats = *courseSeats[courseIndex];
+		lock_guard<mutex> guard(seats.lock);
+		if (sms.previewSeatRequest(student.studentIndex, courseIndex) == seatRejected ||
+			findWaitingStudent(seats, student.shard, id) != -1)
+			return seatRejected;
+
+		if (seats.taken >= seats.capacity || seats.waitlistStart < seats.waitlist.getSize())
+		{
+			joinWaitlist(seats, student.shard, id);
+			return seatWaitlisted;
+		}
+		if (enrol != nullptr)
+		{
+			enrol->enrolStudent(student.studentIndex, courseIndex);
+			if (seats.capacity != unlimitedSeats)
+				seats.taken++;
+		}
+		return seatTaken;
+	};
+
+	SeatStatus status = getShard(student.shard).read([&](const SchoolManagementSystem& sms) { return request(sms, nullptr); });
+	if (status != seatTaken)
+		return status;
+	return shards[student.shard]->write([&](SchoolManagementSystem& sms) { return request(sms, &sms); });
+}
+
+bool ShardedSchoolManagementSystem::leaveWaitlist(const StudentLocation& student, const int& courseIndex)
+{
+	return getShard(student.shard).read([&](const SchoolManagementSystem& sms)
+	{
+		if (!isStudentIn(sms, student) || courseIndex < 0 || courseIndex >= sms.getNumberOfCoursesOffered())
+			return false;
+
+		CourseSeats& seats = *courseSeats[courseIndex];
+		lock_guard<mutex> guard(seats.lock);
+		int position = findWaitingStudent(seats, student.shard, sms.getStudentId(student.studentIndex));
+		if (position == -1)
+			return false;
+
+		leaveWaitlistAt(seats, position);
+		return true;
+	});
+}
+
+int ShardedSchoolManagementSystem::findCourse(const string_view& courseName) const
+{
+	return shards[0]->findCourse(courseName);
+}
+
+Course ShardedSchoolManagementSystem::getCourse(const int& courseIndex) const
+{
+	return shards[0]->getCourse(courseIndex);
+}
+
+int ShardedSchoolManagementSystem::getCourseCapacity(const int& courseIndex) const
+{
+	return getShard(0).read([&](const SchoolManagementSystem& sms)
+	{
+		return courseIndex >= 0 && courseIndex < sms.getNumberOfCoursesOffered() ? courseSeats[courseIndex]->capacity : -1;
+	});
+}
+
+SmarterArray<StudentLocation> ShardedSchoolManagementSystem::getWaitlist(const int& courseIndex) const
+{
+	//Every shard stays locked, so that the students keep their indices while the places are looked up
+	SmarterArray<StudentLocation> waitlist;
+	SmarterArray<const SchoolManagementSystem*> held;
+	readEveryShard([&](const int& shard, const SchoolManagementSystem&)
+	{
+		if (shard < shards.getSize() - 1)
+			return;
+
+		CourseSeats& seats = *courseSeats[courseIndex];
+		lock_guard<mutex> guard(seats.lock);
+		waitlist.reserve(seats.waitlistIndex.getSize());
+		for (int i = seats.waitlistStart; i < seats.waitlist.getSize(); i++)
+		{
+			const WaitingStudent& place = seats.waitlist[i];
+			if (place.shard != -1)
+				waitlist.append(StudentLocation{ place.shard, held[place.shard]->getStudentIndex(place.student) });
+		}
+	}, held);
+	return waitlist;
+}
+
+bool ShardedSchoolManagementSystem::offerCourse(const Course& course)
+{
+	bool offered = true;
+	SmarterArray<SchoolManagementSystem*> held;
+	writeEveryShard([&](const int& shard, SchoolManagementSystem& sms)
+	{
+		offered = sms.offerCourse(course) && offered;
+		if (shard == shards.getSize() - 1 && offered)
+		{
+			CourseSeats* seats = new CourseSeats();
+			seats->capacity = unlimitedSeats;
+			courseSeats.append(seats);
+		}
+	}, held);
+	return offered;
+}
+
+void ShardedSchoolManagementSystem::removeCourse(const int& courseIndex)
+{
+	SmarterArray<SchoolManagementSystem*> held;
+	writeEveryShard([&](const int& shard, SchoolManagementSystem& sms)
+	{
+		sms.removeCourse(courseIndex);
+		if (shard == 0)
+		{
+			//The last course moves into the index, as in every replica
+			delete courseSeats[courseIndex];
+			courseSeats.swapRemove(courseIndex);
+		}
+	}, held);
+}
+
+void ShardedSchoolManagementSystem::setCourseCreditHours(const int& courseIndex, const int& creditHours)
+{
+	SmarterArray<SchoolManagementSystem*> held;
+	writeEveryShard([&](const int&, SchoolManagementSystem& sms) { sms.setCourseCreditHours(courseIndex, creditHours); }, held);
+}
+
+void ShardedSchoolManagementSystem::setCourseCapacity(const int& courseIndex, const int& capacity)
+{
+	assert(capacity >= 0);
+
+	//With every shard locked no one else can hold the course's mutex, and the seats taken can be counted afresh
+	int taken = 0;
+	CourseId course = 0;
+	SmarterArray<SchoolManagementSystem*> held;
+	writeEveryShard([&](const int& shard, SchoolManagementSystem& sms)
+	{
+		taken += sms.getCourseRoster(courseIndex).getSize();
+		if (shard == shards.getSize() - 1)
+		{
+			courseSeats[courseIndex]->capacity = capacity;
+			courseSeats[courseIndex]->taken = taken;
+			course = sms.getCourseId(courseIndex);
+		}
+	}, held);
+	promoteWaitlisted(course);
+}
+
+size_t ShardedSchoolManagementSystem::hashWaitingStudent(const int& shard, const StudentId& student)
+{
+	return size_t((uint64_t(uint32_t(shard)) << 32 | student) * 0x9e3779b97f4a7c15ull >> 32);
+}
+
+int ShardedSchoolManagementSystem::findWaitingStudent(const CourseSeats& seats, const int& shard, const StudentId& student)
+{
+	return seats.waitlistIndex.find(hashWaitingStudent(shard, student), [&](const int& i)
+	{
+		return seats.waitlist[i].shard == shard && seats.waitlist[i].student == student;
+	});
+}
+
+void ShardedSchoolManagementSystem::joinWaitlist(CourseSeats& seats, const int& shard, const StudentId& student)
+{
+	seats.waitlistIndex.insert(hashWaitingStudent(shard, student), seats.waitlist.getSize());
+	seats.waitlist.append(WaitingStudent{ shard, student });
+}
+
+void ShardedSchoolManagementSystem::leaveWaitlistAt(CourseSeats& seats, const int& position)
+{
+	WaitingStudent& place = seats.waitlist[position];
+	seats.waitlistIndex.erase(hashWaitingStudent(place.shard, place.student), position);
+	place.shard = -1;
+	while (seats.waitlistStart < seats.waitlist.getSize() && seats.waitlist[seats.waitlistStart].shard == -1)
+		seats.waitlistStart++;
+
+	//Pack the line once most of its places have been left, so that it stays in proportion to the students waiting
+	if (seats.waitlistIndex.getSize() * 2 >= seats.waitlist.getSize())
+		return;
+
+	SmarterArray<WaitingStudent> line;
+	line.reserve(seats.waitlistIndex.getSize());
+	seats.waitlistIndex.clear();
+	for (int i = seats.waitlistStart; i < seats.waitlist.getSize(); i++)
+	{
+		if (seats.waitlist[i].shard == -1)
+			continue;
+		seats.waitlistIndex.insert(hashWaitingStudent(seats.waitlist[i].shard, seats.waitlist[i].student), line.getSize());
+		line.append(seats.waitlist[i]);
+	}
+	seats.waitlist = std::move(line);
+	seats.waitlistStart = 0;
+}
+
+void ShardedSchoolManagementSystem::promoteWaitlisted(const CourseId& course)
+{
+	//Replicas change in step, so the course has the same id on every shard. The student at the front is looked up
+	//under any shard's lock and seated under its own shard's; if the front has changed in between, look again.
+	for (;;)
+	{
+		int shard = getShard(0).read([&](const SchoolManagementSystem& sms)
+		{
+			int courseIndex = sms.getCourseIndex(course);
+			if (courseIndex == -1)
+				return -1;
+
+			CourseSeats& seats = *courseSeats[courseIndex];
+			lock_guard<mutex> guard(seats.lock);
+			return seats.taken < seats.capacity && seats.waitlistStart < seats.waitlist.getSize() ?
+				seats.waitlist[seats.waitlistStart].shard : -1;
+		});
+		if (shard == -1)
+			return;
+
+		shards[shard]->write([&](SchoolManagementSystem& sms)
+		{
+			int courseIndex = sms.getCourseIndex(course);
+			if (courseIndex == -1)
+				return 0;
+
+			CourseSeats& seats = *courseSeats[courseIndex];
+			lock_guard<mutex> guard(seats.lock);
+			if (seats.taken >= seats.capacity || seats.waitlistStart == seats.waitlist.getSize() ||
+				seats.waitlist[seats.waitlistStart].shard != shard)
+				return 0;
+
+			//A student who has reached the enrolment limit since joining loses its place
+			int studentIndex = sms.getStudentIndex(seats.waitlist[seats.waitlistStart].student);
+			leaveWaitlistAt(seats, seats.waitlistStart);
+			if (studentIndex != -1 && sms.enrolStudent(studentIndex, courseIndex) && seats.capacity != unlimitedSeats)
+				seats.taken++;
+			return 0;
+		});
+	}
+}
+
+bool ShardedSchoolManagementSystem::isStudentIn(const SchoolManagementSystem& sms, const StudentLocation& student)
+{
+	return student.studentIndex >= 0 && student.studentIndex < sms.getNumberOfRegisteredStudents();
+}
+
+template <class F>
+void ShardedSchoolManagementSystem::writeEveryShard(const F& f, SmarterArray<SchoolManagementSystem*>& held)
+{
+	//Each shard's lock is held by the write call that recursed to the next one, so that all are held at the innermost
+	//call. Taking them in shard order keeps two course changes, or a change and readEveryShard, from deadlocking.
+	shards[held.getSize()]->write([&](SchoolManagementSystem& sms)
+	{
+		held.append(&sms);
+		if (held.getSize() < shards.getSize())
+			writeEveryShard(f, held);
+		else
+			for (int i = 0; i < held.getSize(); i++)
+				f(i, *held[i]);
+		return 0;
+	});
+}
+
+template <class F>
+void ShardedSchoolManagementSystem::readEveryShard(const F& f, SmarterArray<const SchoolManagementSystem*>& held) const
+{
+	shards[held.getSize()]->read([&](const SchoolManagementSystem& sms)
+	{
+		held.append(&sms);
+		if (held.getSize() < shards.getSize())
+			readEveryShard(f, held);
+		else
+			for (int i = 0; i < held.getSize(); i++)
+				f(i, *held[i]);
+		return 0;
+	});
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//The few socket calls the request server and its load generator need, over Winsock or BSD sockets. Only localhost TCP
+//is supported. Sockets are blocking unless setNonBlocking is called on them.
+
+#ifdef _WIN32
+typedef SOCKET SocketHandle;
+const SocketHandle invalidSocket = INVALID_SOCKET;
+#else
+typedef int SocketHandle;
+const SocketHandle invalidSocket = -1;
+#endif
+
+bool initSockets()
+{
+#ifdef _WIN32
+	static const bool started = []()
+	{
+		WSADATA data;
+		return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+	}();
+	return started;
+#else
+	return true;
+#endif
+}
+
+void closeSocket(const SocketHandle& socket)
+{
+#ifdef _WIN32
+	closesocket(socket);
+#else
+	::close(socket);
+#endif
+}
+
+void setNoDelay(const SocketHandle& socket) //Send small frames right away instead of waiting to fill a packet
+{
+	int on = 1;
+	setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&on), sizeof on);
+}
+
+bool setNonBlocking(const SocketHandle& socket)
+{
+#ifdef _WIN32
+	u_long on = 1;
+	return ioctlsocket(socket, FIONBIO, &on) == 0;
+#else
+	int flags = fcntl(socket, F_GETFL, 0);
+	return flags != -1 && fcntl(socket, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+bool wouldBlock()
+{
+#ifdef _WIN32
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+	return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+SocketHandle listenLocal(const int& port, int& boundPort) //Listen on 127.0.0.1 at the given port, or at any free port if 0.
+														//Return invalidSocket on an error.
+{
+	if (!initSockets())
+		return invalidSocket;
+
+	SocketHandle listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (listener == invalidSocket)
+		return invalidSocket;
+
+	int on = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&on), sizeof on);
+
+	sockaddr_in address{};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = htons(uint16_t(port));
+	socklen_t length = sizeof address;
+	if (::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof address) != 0 || ::listen(listener, SOMAXCONN) != 0 ||
+		getsockname(listener, reinterpret_cast<sockaddr*>(&address), &length) != 0)
+	{
+		closeSocket(listener);
+		return invalidSocket;
+	}
+
+	boundPort = ntohs(address.sin_port);
+	return listener;
+}
+
+SocketHandle connectLocal(const int& port) //Return invalidSocket on an error
+{
+	if (!initSockets())
+		return invalidSocket;
+
+	SocketHandle s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (s == invalidSocket)
+		return invalidSocket;
+
+	sockaddr_in address{};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = htons(uint16_t(port));
+	if (::connect(s, reinterpret_cast<sockaddr*>(&address), sizeof address) != 0)
+	{
+		closeSocket(s);
+		return invalidSocket;
+	}
+
+	setNoDelay(s);
+	return s;
+}
+
+long long sendSome(const SocketHandle& socket, const char* data, const size_t& size) //Return the number of bytes sent,
+																				//0 if none could be, or -1 on an error
+{
+#ifdef _WIN32
+	int n = ::send(socket, data, int(min(size, size_t(INT32_MAX))), 0);
+	if (n == SOCKET_ERROR)
+		return wouldBlock() ? 0 : -1;
+#else
+	ssize_t n = ::send(socket, data, size, MSG_NOSIGNAL); //A closed peer is an error to report, not a reason to die
+	if (n < 0)
+		return wouldBlock() || errno == EINTR ? 0 : -1;
+#endif
+	return n;
+}
+
+long long receiveSome(const SocketHandle& socket, char* data, const size_t& size) //Return the number of bytes received,
+																				//0 if none are ready, or -1 on an error
+																				//or once the peer has closed
+{
+#ifdef _WIN32
+	int n = ::recv(socket, data, int(min(size, size_t(INT32_MAX))), 0);
+	if (n == SOCKET_ERROR)
+		return wouldBlock() ? 0 : -1;
+#else
+	ssize_t n = ::recv(socket, data, size, 0);
+	if (n < 0)
+		return wouldBlock() || errno == EINTR ? 0 : -1;
+#endif
+	return n == 0 ? -1 : n;
+}
+
+bool sendAll(const SocketHandle& socket, const char* data, const size_t& size) //For blocking sockets
+{
+	for (size_t done = 0; done < size; )
+	{
+		long long n = sendSome(socket, data + done, size - done);
+		if (n < 0)
+			return false;
+		done += size_t(n);
+	}
+	return true;
+}
+
+bool receiveAll(const SocketHandle& socket, char* data, const size_t& size) //For blocking sockets
+{
+	for (size_t done = 0; done < size; )
+	{
+		long long n = receiveSome(socket, data + done, size - done);
+		if (n < 0)
+			return false;
+		done += size_t(n);
+	}
+	return true;
+}
+
+int pollSockets(pollfd* sockets, const size_t& count, const int& timeoutMilliseconds)
+{
+#ifdef _WIN32
+	return WSAPoll(sockets, ULONG(count), timeoutMilliseconds);
+#else
+	return ::poll(sockets, nfds_t(count), timeoutMilliseconds);
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//The request protocol. A request frame is
+//	uint32 length, uint32 tag, uint8 operation, arguments
+//and a response frame is
+//	uint32 length, uint32 tag, uint8 status, results
+//where length counts the bytes after itself and the tag of a response is that of its request. Arguments and results
+//are encoded like log payloads: int32s, and strings as a uint32 length followed by the characters. A client may send
+//any number of requests without waiting for responses; they are served concurrently, so responses can arrive in a
+//different order and are matched to requests by tag.
+
+enum RequestOperation : uint8_t
+{
+	requestGetCounts = 1, //-> int32 students, int32 courses
+	requestFindStudent, //string firstName, string lastName -> int32 studentIndex, or -1
+	requestGetStudentGPA, //int32 studentIndex -> 8 byte double GPA
+	requestEnrolStudent, //int32 studentIndex, int32 courseIndex -> int32 1 if enrolled, 0 if already enrolled
+	requestAssignLetterGrade, //int32 studentIndex, int32 courseIndex, int32 letterGrade -> int32 1 if assigned, 0 if not enrolled
+	requestGetTopStudentIndex, //-> int32 studentIndex, or -1
+	requestFindCourse, //string courseName -> int32 courseIndex, or -1
+	requestGetCourse, //int32 courseIndex -> string courseName, int32 creditHours
+	requestOfferCourse, //string courseName, int32 creditHours from 1 to maxRequestCreditHours -> int32 1 if offered, 0 if already offered
+};
+
+enum ResponseStatus : uint8_t
+{
+	responseOk,
+	responseBadRequest, //Unknown operation, malformed arguments, or an index, grade or credit hours out of range. No results follow.
+};
+
+const uint32_t maxFrameLength = 1 << 20; //A longer frame closes the connection
+const int maxRequestCreditHours = 30; //Offering a course with more credit hours over the wire is a bad request
+const int maxRequestsInFlight = 256; //Per connection. Later frames wait unread until responses come back.
+const size_t maxBufferedOutput = 1 << 20; //Per connection. Past this many unsent response bytes no more requests are
+										//read from the connection until the client reads its responses.
+
+void putFrameInt(string& frame, const int32_t& value)
+{
+	frame.append(reinterpret_cast<const char*>(&value), sizeof value);
+}
+
+void putFrameString(string& frame, const string_view& value)
+{
+	uint32_t length = uint32_t(value.size());
+	frame.append(reinterpret_cast<const char*>(&length), sizeof length);
+	frame.append(value);
+}
+
+void beginFrame(string& frame, const uint32_t& tag, const uint8_t& operationOrStatus) //Start a frame at the end of the
+																					//string; endFrame fills in its length
+{
+	uint32_t length = 0;
+	frame.append(reinterpret_cast<const char*>(&length), sizeof length);
+	frame.append(reinterpret_cast<const char*>(&tag), sizeof tag);
+	frame.push_back(char(operationOrStatus));
+}
+
+void endFrame(string& frame, const size_t& frameStart)
+{
+	uint32_t length = uint32_t(frame.size() - frameStart - 4);
+	memcpy(&frame[frameStart], &length, sizeof length);
+}
+
+void executeRequest(ConcurrentSchoolManagementSystem& sms, const char* request, const size_t& size, string& response) //Serve
+								//a request frame without its length and append the response frame to the string
+{
+	uint32_t tag = 0;
+	if (size >= sizeof tag)
+		memcpy(&tag, request, sizeof tag);
+	size_t frameStart = response.size();
+	beginFrame(response, tag, responseOk);
+
+	//Each request validates its indices and uses them under one lock, so a concurrent removal cannot invalidate them
+	//in between
+	bool ok = false;
+	int32_t a, b, c;
+	string first, second;
+	LogPayloadReader payload(request + 5, size >= 5 ? size - 5 : 0);
+	switch (size >= 5 ? uint8_t(request[4]) : 0)
+	{
+	case requestGetCounts:
+		ok = payload.atEnd() && sms.read([&](const SchoolManagementSystem& s)
+		{
+			putFrameInt(response, s.getNumberOfRegisteredStudents());
+			putFrameInt(response, s.getNumberOfCoursesOffered());
+			return true;
+		});
+		break;
+	case requestFindStudent:
+		ok = payload.getString(first) && payload.getString(second) && payload.atEnd();
+		if (ok)
+			putFrameInt(response, sms.findStudent(first, second));
+		break;
+	case requestGetStudentGPA:
+		ok = payload.getInt(a) && payload.atEnd() && sms.read([&](const SchoolManagementSystem& s)
+		{
+			if (a < 0 || a >= s.getNumberOfRegisteredStudents())
+				return false;
+			double gpa = s.getStudentGPA(a);
+			response.append(reinterpret_cast<const char*>(&gpa), sizeof gpa);
+			return true;
+		});
+		break;
+	case requestEnrolStudent:
+		ok = payload.getInt(a) && payload.getInt(b) && payload.atEnd() && sms.write([&](SchoolManagementSystem& s)
+		{
+			if (a < 0 || a >= s.getNumberOfRegisteredStudents() || b < 0 || b >= s.getNumberOfCoursesOffered())
+				return false;
+			putFrameInt(response, s.enrolStudent(a, b));
+			return true;
+		});
+		break;
+	case requestAssignLetterGrade:
+		ok = payload.getInt(a) && payload.getInt(b) && payload.getInt(c) && payload.atEnd() && c >= 0 && c <= 127 &&
+			gradePoints(char(c)) != -1 && sms.write([&](SchoolManagementSystem& s)
+		{
+			if (a < 0 || a >= s.getNumberOfRegisteredStudents() || b < 0 || b >= s.getNumberOfCoursesOffered())
+				return false;
+			putFrameInt(response, s.assignLetterGrade(a, b, char(c)));
+			return true;
+		});
+		break;
+	case requestGetTopStudentIndex:
+		ok = payload.atEnd();
+		if (ok)
+			putFrameInt(response, sms.getTopStudentIndex());
+		break;
+	case requestFindCourse:
+		ok = payload.getString(first) && payload.atEnd();
+		if (ok)
+			putFrameInt(response, sms.findCourse(first));
+		break;
+	case requestGetCourse:
+		ok = payload.getInt(a) && payload.atEnd() && sms.read([&](const SchoolManagementSystem& s)
+		{
+			if (a < 0 || a >= s.getNumberOfCoursesOffered())
+				return false;
+			putFrameString(response, s.getCourse(a).getCourseName());
+			putFrameInt(response, s.getCourse(a).getCreditHours());
+			return true;
+		});
+		break;
+	case requestOfferCourse:
+		//The name is looked up before a Course is made from it, because making one interns the name for good
+		ok = payload.getString(first) && payload.getInt(a) && payload.atEnd() && !first.empty() && a >= 1 &&
+			a <= maxRequestCreditHours && sms.write([&](SchoolManagementSystem& s)
+		{
+			putFrameInt(response, s.findCourse(first) == -1 && s.offerCourse(Course(first, a)));
+			return true;
+		});
+		break;
 	}
-	return out;
+
+	if (!ok)
+	{
+		response.resize(frameStart);
+		beginFrame(response, tag, responseBadRequest);
+	}
+	endFrame(response, frameStart);
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-class Course
+//Serves the request protocol on localhost TCP. One thread runs an event loop over every connection with poll: it
+//accepts connections, reads whatever requests have arrived and queues each complete frame for a pool of worker
+//threads, and writes back the responses the workers hand over. Workers wake the loop through a socket pair, so it
+//never waits on a timeout while responses are ready.
+//
+//A connection at maxRequestsInFlight or maxBufferedOutput is not read until its responses come back or are sent, so a
+//client that pipelines without end or never reads holds a bounded amount of server memory.
+
+class RequestServer
 {
 private:
-	string name;
-	int creditHours;
+	struct Connection
+	{
+		SocketHandle socket; //invalidSocket once the slot is free
+		uint32_t generation; //Counts the connections that have used this slot, so late responses for a closed one are dropped
+		string input; //Bytes received but not yet cut into frames
+		string output; //Response frames not yet sent
+		size_t outputSent; //How much of output has been sent
+		int inFlight; //Requests queued for or being served by the workers
+	};
+
+	struct Job
+	{
+		int connection;
+		uint32_t generation;
+		string request; //The request frame without its length
+	};
+
+	ConcurrentSchoolManagementSystem& sms;
+	SocketHandle listener;
+	SocketHandle wakeReader, wakeWriter; //The two ends of a socket pair (a loopback connection on Windows)
+	SmarterArray<Connection> connections;
+	SmarterArray<thread> workers;
+
+	mutex jobLock;
+	condition_variable jobReady;
+	deque<Job> jobs;
+	bool stoppingWorkers;
+
+	mutex responseLock;
+	SmarterArray<Job> responses; //Job.request holds the response frames
+	atomic<bool> wakePending; //Set while a wake byte is on its way, so that workers do not flood the loop with them
+	atomic<bool> stopping;
+
+	void work(); //The loop each worker runs
+	void wake();
+	void closeConnection(const int& connection);
+	bool readRequests(const int& connection); //Return false if the connection should be closed
+	bool queueRequests(const int& connection); //Queue the complete frames of the input, as many as the limits allow.
+											//Return false if the connection should be closed.
+	bool isThrottled(const int& connection) const; //Return true if the connection is at a limit and should not be read
+	bool writeResponses(const int& connection); //Return false if the connection should be closed
+
 public:
-	Course();
-	Course(const string&, const int&);
-	string getCourseName() const;
-	int getCreditHours() const;
-	void setCourseName(const string&);
-	void setCreditHours(const int&);
-	bool operator == (const Course&) const; //Return true if course names are equal and credit hours are also equal.
-	friend istream& operator >> (istream&, Course&);
-	friend ostream& operator << (ostream&, const Course&);
+	explicit RequestServer(ConcurrentSchoolManagementSystem& sms);
+	RequestServer(const RequestServer&) = delete;
+	RequestServer& operator = (const RequestServer&) = delete;
+	~RequestServer();
+
+	bool start(const int& port, const int& workerCount); //Listen on the port (any free port if 0) and start the workers.
+														//Return false if the port cannot be used.
+	int getPort() const;
+	void run(); //Run the event loop until stop is called
+	void stop(); //Make run return. May be called from any thread.
 };
 
-Course::Course()
+RequestServer::RequestServer(ConcurrentSchoolManagementSystem& sms) : sms(sms)
 {
-	name = "None";
-	creditHours = 0;
+	listener = wakeReader = wakeWriter = invalidSocket;
+	stoppingWorkers = false;
+	wakePending = false;
+	stopping = false;
 }
 
-Course::Course(const string& name, const int& hours)
+RequestServer::~RequestServer()
 {
-	this->name = name;
-	creditHours = hours;
+	{
+		lock_guard<mutex> guard(jobLock);
+		stoppingWorkers = true;
+	}
+	jobReady.notify_all();
+	for (int i = 0; i < workers.getSize(); i++)
+		workers[i].join();
+
+	for (int i = 0; i < connections.getSize(); i++)
+		closeConnection(i);
+	for (SocketHandle s : { listener, wakeReader, wakeWriter })
+	{
+		if (s != invalidSocket)
+			closeSocket(s);
+	}
 }
 
-string Course::getCourseName() const
+bool RequestServer::start(const int& port, const int& workerCount)
 {
-	return name;
+	assert(workerCount >= 1 && listener == invalidSocket);
+
+	int boundPort;
+	listener = listenLocal(port, boundPort);
+	if (listener == invalidSocket)
+		return false;
+
+#ifdef _WIN32
+	//Winsock has no socketpair, so the wake connection goes through the listener. On a fixed port another local client
+	//may connect first, so connections are accepted until the one from wakeWriter's own address arrives.
+	wakeWriter = connectLocal(boundPort);
+	sockaddr_in writerAddress{};
+	socklen_t length = sizeof writerAddress;
+	if (wakeWriter == invalidSocket || getsockname(wakeWriter, reinterpret_cast<sockaddr*>(&writerAddress), &length) != 0)
+		return false;
+	while (wakeReader == invalidSocket)
+	{
+		sockaddr_in address{};
+		length = sizeof address;
+		SocketHandle s = accept(listener, reinterpret_cast<sockaddr*>(&address), &length);
+		if (s == invalidSocket)
+			return false;
+		if (address.sin_addr.s_addr == writerAddress.sin_addr.s_addr && address.sin_port == writerAddress.sin_port)
+			wakeReader = s;
+		else
+			closeSocket(s);
+	}
+#else
+	int pair[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0)
+		return false;
+	wakeReader = pair[0];
+	wakeWriter = pair[1];
+#endif
+	if (!setNonBlocking(wakeReader) || !setNonBlocking(listener))
+		return false;
+
+	for (int i = 0; i < workerCount; i++)
+		workers.append(thread(&RequestServer::work, this));
+	return true;
 }
 
-int Course::getCreditHours() const
+int RequestServer::getPort() const
 {
-	return creditHours;
+	sockaddr_in address{};
+	socklen_t length = sizeof address;
+	if (getsockname(listener, reinterpret_cast<sockaddr*>(&address), &length) != 0)
+		return -1;
+	return ntohs(address.sin_port);
 }
 
-void Course::setCourseName(const string& name)
+void RequestServer::wake()
 {
-	this->name = name;
+	if (!wakePending.exchange(true))
+	{
+		char byte = 0;
+		sendAll(wakeWriter, &byte, 1);
+	}
 }
 
-void Course::setCreditHours(const int& hours)
+void RequestServer::stop()
 {
-	creditHours = hours;
+	stopping = true;
+	wakePending = false;
+	wake();
 }
 
-bool Course::operator == (const Course& c) const
+void RequestServer::work()
 {
-	if (name == c.name && creditHours == c.creditHours)
-		return true;
+	while (true)
+	{
+		Job job;
+		{
+			unique_lock<mutex> guard(jobLock);
+			jobReady.wait(guard, [&]() { return stoppingWorkers || !jobs.empty(); });
+			if (stoppingWorkers)
+				return;
+			job = std::move(jobs.front());
+			jobs.pop_front();
+		}
 
-	return false;
+		string response;
+		executeRequest(sms, job.request.data(), job.request.size(), response);
+		job.request = std::move(response);
+		{
+			lock_guard<mutex> guard(responseLock);
+			responses.append(std::move(job));
+		}
+		wake();
+	}
 }
 
-istream& operator >> (istream& in, Course& c)
+void RequestServer::closeConnection(const int& connection)
 {
-	cout << "Please input the name of the course: ";
-	in >> c.name;
+	Connection& c = connections[connection];
+	if (c.socket == invalidSocket)
+		return;
+
+	closeSocket(c.socket);
+	c.socket = invalidSocket;
+	c.generation++;
+	c.input = string();
+	c.output = string();
+	c.outputSent = 0;
+	c.inFlight = 0;
+}
 
-	cout << "Please input the credit hours of the course: ";
-	in >> c.creditHours;
+bool RequestServer::isThrottled(const int& connection) const
+{
+	const Connection& c = connections[connection];
+	return c.inFlight >= maxRequestsInFlight || c.output.size() - c.outputSent >= maxBufferedOutput;
+}
 
-	return in;
+bool RequestServer::readRequests(const int& connection)
+{
+	//Read no more than one frame of the largest size can need; the rest waits in the socket
+	Connection& c = connections[connection];
+	char buffer[65536];
+	while (c.input.size() < 4 + size_t(maxFrameLength))
+	{
+		long long n = receiveSome(c.socket, buffer, sizeof buffer);
+		if (n < 0)
+			return false;
+		if (n == 0)
+			break;
+		c.input.append(buffer, size_t(n));
+	}
+	return true;
 }
 
-ostream& operator << (ostream& out, const Course& c)
+bool RequestServer::queueRequests(const int& connection)
 {
-	out << "Course Name = " << c.name << ", Credit Hours = " << c.creditHours;
-	return out;
+	//Queue the complete frames together, so the workers can serve a pipelined burst in parallel
+	Connection& c = connections[connection];
+	size_t p = 0;
+	int queued = 0;
+	{
+		lock_guard<mutex> guard(jobLock);
+		while (c.input.size() - p >= 4 && !isThrottled(connection))
+		{
+			uint32_t length;
+			memcpy(&length, c.input.data() + p, sizeof length);
+			if (length > maxFrameLength)
+				return false;
+			if (c.input.size() - p - 4 < length)
+				break;
+			jobs.push_back(Job{ connection, c.generation, c.input.substr(p + 4, length) });
+			p += 4 + length;
+			c.inFlight++;
+			queued++;
+		}
+	}
+	c.input.erase(0, p);
+
+	if (queued == 1)
+		jobReady.notify_one();
+	else if (queued > 1)
+		jobReady.notify_all();
+	return true;
 }
 
-///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool RequestServer::writeResponses(const int& connection)
+{
+	Connection& c = connections[connection];
+	while (c.outputSent < c.output.size())
+	{
+		long long n = sendSome(c.socket, c.output.data() + c.outputSent, c.output.size() - c.outputSent);
+		if (n < 0)
+			return false;
+		if (n == 0)
+			break;
+		c.outputSent += size_t(n);
+	}
 
-struct Date
+	if (c.outputSent == c.output.size())
+	{
+		c.output.clear();
+		c.outputSent = 0;
+	}
+	return true;
+}
+
+void RequestServer::run()
 {
-	int d, m, y;
-};
+	assert(listener != invalidSocket);
+
+	SmarterArray<pollfd> sockets;
+	SmarterArray<int> socketConnections; //The connection each entry of sockets after the first two belongs to
+	while (!stopping)
+	{
+		sockets = SmarterArray<pollfd>();
+		socketConnections = SmarterArray<int>();
+		sockets.append(pollfd{ listener, POLLIN, 0 });
+		sockets.append(pollfd{ wakeReader, POLLIN, 0 });
+		for (int i = 0; i < connections.getSize(); i++)
+		{
+			if (connections[i].socket == invalidSocket)
+				continue;
+			short events = isThrottled(i) ? 0 : POLLIN;
+			if (connections[i].outputSent < connections[i].output.size())
+				events |= POLLOUT;
+			sockets.append(pollfd{ connections[i].socket, events, 0 });
+			socketConnections.append(i);
+		}
+
+		if (pollSockets(&sockets[0], size_t(sockets.getSize()), -1) < 0)
+			continue;
+
+		if (sockets[1].revents != 0)
+		{
+			char buffer[256];
+			while (receiveSome(wakeReader, buffer, sizeof buffer) > 0);
+		}
+
+		//Clear the flag before taking the responses, so a response added after this still sends a wake byte
+		wakePending = false;
+		SmarterArray<Job> ready;
+		{
+			lock_guard<mutex> guard(responseLock);
+			ready = std::move(responses);
+			responses = SmarterArray<Job>();
+		}
+		for (int i = 0; i < ready.getSize(); i++)
+		{
+			Connection& c = connections[ready[i].connection];
+			if (c.socket != invalidSocket && c.generation == ready[i].generation)
+			{
+				c.output += ready[i].request;
+				c.inFlight--;
+			}
+		}
+
+		for (int i = 0; i < socketConnections.getSize(); i++)
+		{
+			int connection = socketConnections[i];
+			short events = sockets[i + 2].revents;
+			if ((events & (POLLIN | POLLERR | POLLHUP)) != 0 && !readRequests(connection))
+				closeConnection(connection);
+		}
+
+		//Queue after writing, since both the responses taken above and the bytes written may have lifted a limit. A
+		//connection left throttled is woken by its next response or by POLLOUT.
+		for (int i = 0; i < connections.getSize(); i++)
+		{
+			if (connections[i].socket != invalidSocket && (!writeResponses(i) || !queueRequests(i)))
+				closeConnection(i);
+		}
+
+		if (sockets[0].revents != 0)
+		{
+			while (true)
+			{
+				SocketHandle s = accept(listener, nullptr, nullptr);
+				if (s == invalidSocket)
+					break;
+				if (!setNonBlocking(s))
+				{
+					closeSocket(s);
+					continue;
+				}
+				setNoDelay(s);
+
+				int slot = 0;
+				while (slot < connections.getSize() && connections[slot].socket != invalidSocket)
+					slot++;
+				if (slot == connections.getSize())
+					connections.append(Connection{ invalidSocket, 0, string(), string(), 0, 0 });
+				connections[slot].socket = s;
+			}
+		}
+	}
+}
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-class Student
+//A load generator for the request server. Each connection runs on its own thread and keeps pipelineDepth requests in
+//flight: a mix of GPA, course and top student reads with 1 grade posting in 10, against random students and courses.
+
+struct LoadReport
 {
-private:
-	string fn, ln; //first name and last name
-	Date dob;
-public:
-	Student();
-	Student(const string& firstName, const string& lastName, const Date&);
-	string getFirstName() const;
-	string getLastName() const;
-	Date getDob() const;
-	void setFirstName(const string&);
-	void setLastName(const string&);
-	void setDob(const Date&);
-	bool operator == (const Student&) const; //Return true if all the first names, last names, and date of births are equal
-	friend istream& operator >> (istream&, Student&);
-	friend ostream& operator << (ostream&, const Student&);
+	long long requests; //The number of responses received
+	long long badResponses; //Responses that were not responseOk, or that arrived on a connection that failed
+	double seconds;
+	double p50Microseconds; //Latency from sending a request to receiving its response
+	double p99Microseconds;
 };
 
-Student::Student()
+LoadReport runLoadGenerator(const int& port, const int& connectionCount, const int& requestsPerConnection, const int& pipelineDepth)
 {
-	fn = "None";
-	ln = "None";
-	dob.y = 0;
-	dob.m = 0;
-	dob.d = 0;
-}
+	assert(connectionCount >= 1 && requestsPerConnection >= 0 && pipelineDepth >= 1);
+
+	LoadReport report{ 0, 0, 0.0, 0.0, 0.0 };
+
+	//Size the random choices to the system being served
+	int32_t students = 0, courses = 0;
+	SocketHandle probe = connectLocal(port);
+	if (probe == invalidSocket)
+		return report;
+	string frame;
+	beginFrame(frame, 0, requestGetCounts);
+	endFrame(frame, 0);
+	char header[9];
+	uint32_t length = 0;
+	bool counted = sendAll(probe, frame.data(), frame.size()) && receiveAll(probe, header, sizeof header);
+	memcpy(&length, header, sizeof length);
+	counted = counted && header[8] == responseOk && length == 13 && receiveAll(probe, reinterpret_cast<char*>(&students), 4) &&
+		receiveAll(probe, reinterpret_cast<char*>(&courses), 4);
+	closeSocket(probe);
+	if (!counted)
+		return report;
+
+	SmarterArray<SmarterArray<double>> latencies; //In microseconds, by connection
+	SmarterArray<long long> badResponses;
+	for (int i = 0; i < connectionCount; i++)
+	{
+		latencies.emplace_back().reserve(requestsPerConnection);
+		badResponses.append(0);
+	}
 
-Student::Student(const string& firstName, const string& lastName, const Date& birthDate) : fn(firstName), ln(lastName), dob(birthDate) {}
+	auto client = [&](const int& connection)
+	{
+		SocketHandle s = connectLocal(port);
+		if (s == invalidSocket)
+		{
+			badResponses[connection] = requestsPerConnection;
+			return;
+		}
 
-string Student::getFirstName() const
-{
-	return fn;
+		uint32_t seed = 2654435761u * uint32_t(connection + 1); //xorshift32, so the threads do not share rand's state
+		auto next = [&]() { seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5; return seed; };
+		SmarterArray<chrono::steady_clock::time_point> sentAt;
+		sentAt.reserve(requestsPerConnection);
+		string requests, response;
+		int sent = 0, received = 0;
+		while (received < requestsPerConnection)
+		{
+			//Top the pipeline up with one send
+			requests.clear();
+			for (; sent < requestsPerConnection && sent - received < pipelineDepth; sent++)
+			{
+				size_t frameStart = requests.size();
+				uint32_t kind = next() % 10;
+				if (kind == 0 && students > 0 && courses > 0)
+				{
+					beginFrame(requests, uint32_t(sent), requestAssignLetterGrade);
+					putFrameInt(requests, int32_t(next() % uint32_t(students)));
+					putFrameInt(requests, int32_t(next() % uint32_t(courses)));
+					putFrameInt(requests, "ABCDF"[next() % 5]);
+				}
+				else if (kind < 6 && students > 0)
+				{
+					beginFrame(requests, uint32_t(sent), requestGetStudentGPA);
+					putFrameInt(requests, int32_t(next() % uint32_t(students)));
+				}
+				else if (kind < 9 && courses > 0)
+				{
+					beginFrame(requests, uint32_t(sent), requestGetCourse);
+					putFrameInt(requests, int32_t(next() % uint32_t(courses)));
+				}
+				else
+					beginFrame(requests, uint32_t(sent), requestGetTopStudentIndex);
+				endFrame(requests, frameStart);
+				sentAt.append(chrono::steady_clock::now());
+			}
+			if (!requests.empty() && !sendAll(s, requests.data(), requests.size()))
+				break;
+
+			char responseHeader[9];
+			uint32_t length, tag;
+			if (!receiveAll(s, responseHeader, sizeof responseHeader))
+				break;
+			memcpy(&length, responseHeader, sizeof length);
+			memcpy(&tag, responseHeader + 4, sizeof tag);
+			if (length < 5 || length > maxFrameLength || tag >= uint32_t(sent))
+				break;
+			response.resize(length - 5);
+			if (!response.empty() && !receiveAll(s, &response[0], response.size()))
+				break;
+
+			latencies[connection].append(chrono::duration<double, micro>(chrono::steady_clock::now() - sentAt[int(tag)]).count());
+			if (responseHeader[8] != responseOk)
+				badResponses[connection]++;
+			received++;
+		}
+
+		badResponses[connection] += requestsPerConnection - received;
+		closeSocket(s);
+	};
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	SmarterArray<thread> threads;
+	for (int i = 0; i < connectionCount; i++)
+		threads.append(thread(client, i));
+	for (int i = 0; i < connectionCount; i++)
+		threads[i].join();
+	report.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	SmarterArray<double> all;
+	for (int i = 0; i < connectionCount; i++)
+	{
+		for (int j = 0; j < latencies[i].getSize(); j++)
+			all.append(latencies[i][j]);
+		report.badResponses += badResponses[i];
+	}
+	report.requests = all.getSize();
+	if (all.getSize() > 0)
+	{
+		double* first = &all[0];
+		double* last = first + all.getSize();
+		nth_element(first, first + all.getSize() / 2, last);
+		report.p50Microseconds = first[all.getSize() / 2];
+		nth_element(first, first + all.getSize() * 99 / 100, last);
+		report.p99Microseconds = first[all.getSize() * 99 / 100];
+	}
+	return report;
 }
 
-string Student::getLastName() const
+ostream& operator << (ostream& out, const LoadReport& r)
 {
-	return ln;
+	out << r.requests << " requests in " << r.seconds * 1000 << " ms: " << (r.seconds > 0 ? r.requests / r.seconds : 0.0)
+		<< " requests/s, p50 " << r.p50Microseconds << " us, p99 " << r.p99Microseconds << " us, " << r.badResponses << " bad";
+	return out;
 }
 
-Date Student::getDob() const
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//Benchmarks. Run the program with the argument "benchmark" to run all of them instead of the demo, or with
+//"benchmark <name>" to run a single one.
+
+//Builds that define SMS_COUNT_ALLOCATIONS route every heap allocation through these, so the benchmarks can count
+//allocations. Other builds, including the server, keep the standard allocator.
+#ifdef SMS_COUNT_ALLOCATIONS
+atomic<long long> allocationCount(0);
+
+//The replacements stay out of line. Inlined, their malloc and free read to g++ as a mismatch with the new and delete
+//expressions around them.
+#ifdef _MSC_VER
+#define NO_INLINE __declspec(noinline)
+#else
+#define NO_INLINE __attribute__((noinline))
+#endif
+
+NO_INLINE void* operator new(size_t size)
 {
-	return dob;
+	allocationCount.fetch_add(1, memory_order_relaxed);
+	void* p = malloc(size ? size : 1);
+	if (p == nullptr)
+		throw bad_alloc();
+	return p;
 }
 
-void Student::setFirstName(const string& firstName)
+NO_INLINE void operator delete(void* p) noexcept
 {
-	fn = firstName;
+	free(p);
 }
 
-void Student::setLastName(const string& lastName)
+NO_INLINE void operator delete(void* p, size_t) noexcept
 {
-	ln = lastName;
+	operator delete(p);
 }
 
-void Student::setDob(const Date& birthDate)
+//The aligned forms, which memory resources may use even for ordinary alignments
+NO_INLINE void* operator new(size_t size, align_val_t alignment)
 {
-	dob = birthDate;
+	allocationCount.fetch_add(1, memory_order_relaxed);
+#ifdef _WIN32
+	void* p = _aligned_malloc(size ? size : 1, size_t(alignment));
+#else
+	void* p = nullptr;
+	if (posix_memalign(&p, size_t(alignment) < sizeof(void*) ? sizeof(void*) : size_t(alignment), size ? size : 1) != 0)
+		p = nullptr;
+#endif
+	if (p == nullptr)
+		throw bad_alloc();
+	return p;
 }
 
-bool Student::operator == (const Student& s) const
+void operator delete(void* p, align_val_t) noexcept
 {
-	if ((fn == s.fn) && (ln == s.ln) && (dob.m == s.dob.m) && (dob.d == s.dob.d) && (dob.y == s.dob.y))
-		return true;
-
-	return false;
+#ifdef _WIN32
+	_aligned_free(p);
+#else
+	free(p);
+#endif
 }
 
-istream& operator >> (istream& in, Student& s)
+void operator delete(void* p, size_t, align_val_t alignment) noexcept
 {
-	cout << "Please enter your first name: ";
-	in >> s.fn;
-
-	cout << "Please enter your last name: ";
-	in >> s.ln;
-
-	cout << "Please enter your date of birth: " << endl;
-	cout << "\tMonth: ";
-	in >> s.dob.m;
-	cout << "\tDay: ";
-	in >> s.dob.d;
-	cout << "\tYear: ";
-	in >> s.dob.y;
-
-	return in;
+	operator delete(p, alignment);
 }
+#endif
 
-ostream& operator << (ostream& out, const Student& s)
+long long countAllocations() //Return the number of heap allocations so far, or -1 if this build does not count them
 {
-	out << "Full Name = " << s.fn << " " << s.ln << ": ";
-	out << "DOB (d-m-y) = " << s.dob.d << "-" << s.dob.m << "-" << s.dob.y;
-	return out;
+#ifdef SMS_COUNT_ALLOCATIONS
+	return allocationCount.load();
+#else
+	return -1;
+#endif
 }
 
-///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-
-typedef Map<int, char> StudentMap;
-
-///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-
-class SchoolManagementSystem
+string describeAllocationsSince(const long long& before) //before is what countAllocations returned
 {
-private:
-	SmarterArray<Student> studentList; //A SmarterArray to store the students in the school
-	SmarterArray<Course> courseList; //A SmarterArray to store the courses in the school
-	SmarterArray<StudentMap> studentMapList; //A SmarterArray to store the students' maps
+	if (before < 0)
+		return "uncounted allocations";
+	return to_string(countAllocations() - before) + " allocations";
+}
 
-public:
-	SchoolManagementSystem();
+double secondsSince(const chrono::steady_clock::time_point& start)
+{
+	return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
 
-	int getNumberOfRegisteredStudents() const;
-	int getNumberOfCoursesOffered() const;
+void buildBenchmarkSystem(SchoolManagementSystem& sms, const int& students, const int& courses, const int& coursesPerStudent)
+{
+	//Fill a system with random students, each enrolled in and graded for coursesPerStudent random courses
+	for (int i = 0; i < courses; i++)
+		sms.offerCourse(Course("COURSE" + to_string(i), 1 + i % 4));
 
-	int findStudent(const string& firstName, const string& lastName) const;
-	Student getStudent(const int& studentIndex) const;
-	StudentMap getStudentMap(const int& studentIndex) const;
-	bool registerStudent(const Student& s);
-	bool enrolStudent(const int& studentIndex, const int& courseIndex);
-	void removeStudent(const int& studentIndex);
-	bool withdrawStudent(const int& studentIndex, const int& courseIndex);
-	bool assignLetterGrade(const int& studentIndex, const int& courseIndex, const char& letterGrade);
-	double getStudentGPA(const int& studentIndex) const;
-	int getTopStudentIndex() const;
+	while (sms.getNumberOfRegisteredStudents() < students)
+		sms.registerStudent(SchoolManagementSystem::generateRandomStudent());
 
-	int findCourse(const string& courseName) const;
-	Course getCourse(const int& courseIndex) const;
-	bool offerCourse(const Course& course);
-	void removeCourse(const int& courseIndex);
+	for (int i = 0; i < students; i++)
+	{
+		for (int j = 0; j < coursesPerStudent; j++)
+		{
+			int courseIndex = rand() % courses;
+			sms.enrolStudent(i, courseIndex);
+			sms.assignLetterGrade(i, courseIndex, SchoolManagementSystem::generateRandomLetterGrade());
+		}
+	}
+}
 
-	friend ostream& operator << (ostream&, const SchoolManagementSystem&);
-	static Student generateRandomStudent();
-	static char generateRandomLetterGrade();
-};
+void benchmarkStudentStorage()
+{
+	//Appends students and their enrolment records exactly the way registerStudent stores them. With geometric growth the
+	//time per registration stays flat as the roster doubles, where it used to grow linearly with the roster.
+	cout << "Student storage (registerStudent append path)" << endl;
+	srand(1);
+	for (int n = 25000; n <= 200000; n *= 2)
+	{
+		StudentTable students;
+		EnrolmentStore enrolments;
 
-SchoolManagementSystem::SchoolManagementSystem()
-{}
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		for (int i = 0; i < n; i++)
+		{
+			Student s = SchoolManagementSystem::generateRandomStudent();
+			students.append(s.getFirstNameSymbol(), s.getLastNameSymbol(), s.getDob());
+			enrolments.addStudent(0);
+		}
+		double seconds = secondsSince(start);
 
-int SchoolManagementSystem::getNumberOfRegisteredStudents() const
-{
-	return studentList.getSize();
+		cout << "\tn = " << n << ": " << seconds * 1000 << " ms, " << seconds * 1e9 / n << " ns per registration" << endl;
+	}
 }
 
-int SchoolManagementSystem::getNumberOfCoursesOffered() const
+void benchmarkStudentLookup()
 {
-	return courseList.getSize();
-}
+	//Registers 500k students through registerStudent (every registration checks for a duplicate name) and then
+	//runs a million findStudent calls, half of them for registered names and half for names that do not exist.
+	const int n = 500000, lookups = 1000000;
+	cout << "Student lookup by name" << endl;
+	srand(2);
 
-int SchoolManagementSystem::findStudent(const string& firstName, const string& lastName) const
-{
-	for (int i = 0; i < studentList.getSize(); i++)
+	SmarterArray<Student> students;
+	students.reserve(n);
+	for (int i = 0; i < n; i++)
+		students.append(SchoolManagementSystem::generateRandomStudent());
+
+	SchoolManagementSystem sms;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (int i = 0; i < n; i++)
+		sms.registerStudent(students[i]);
+	double seconds = secondsSince(start);
+	cout << "\tregisterStudent x " << n << ": " << seconds * 1000 << " ms, " << seconds * 1e9 / n << " ns each" << endl;
+
+	int found = 0;
+	start = chrono::steady_clock::now();
+	for (int i = 0; i < lookups; i++)
 	{
-		if ((studentList[i].getFirstName() == firstName) && (studentList[i].getLastName() == lastName))
-			return i;
+		const Student& s = students[(i / 2) % n];
+		if (i % 2 == 0)
+			found += sms.findStudent(s.getFirstName(), s.getLastName()) != -1;
+		else
+			found += sms.findStudent(s.getLastName(), s.getFirstName()) != -1;
 	}
-
-	return -1;
+	seconds = secondsSince(start);
+	cout << "\tfindStudent x " << lookups << ": " << seconds * 1000 << " ms, " << seconds * 1e9 / lookups << " ns each ("
+		<< found << " found)" << endl;
+
+	//Remove and re-register the last student over and over. The freed id slot is reused straight away until its
+	//generation runs out, so every id handed out along the way must stay dead once its student is gone.
+	const int churn = 1000;
+	SmarterArray<StudentId> staleIds;
+	staleIds.reserve(churn);
+	start = chrono::steady_clock::now();
+	for (int i = 0; i < churn; i++)
+	{
+		int last = sms.getNumberOfRegisteredStudents() - 1;
+		Student s = sms.getStudent(last);
+		staleIds.append(sms.getStudentId(last));
+		sms.removeStudent(last);
+		sms.registerStudent(s);
+	}
+	seconds = secondsSince(start);
+	int resurrected = 0;
+	for (int i = 0; i < churn; i++)
+		resurrected += sms.getStudentIndex(staleIds[i]) != -1;
+	cout << "\tremoveStudent + registerStudent x " << churn << ": " << seconds * 1e9 / churn << " ns each ("
+		<< resurrected << " stale ids still resolving)" << endl;
 }
 
-Student SchoolManagementSystem::getStudent(const int& studentIndex) const
+void benchmarkRanking()
 {
-	assert(studentIndex >= 0 && studentIndex < studentList.getSize());
+	//Dean's list style queries against 200k graded students, plus the cost grade changes pay to keep the ranking current
+	const int n = 200000, queries = 100000;
+	cout << "GPA ranking" << endl;
+	srand(3);
 
-	return studentList[studentIndex];
+	SchoolManagementSystem sms;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	buildBenchmarkSystem(sms, n, 50, 6);
+	cout << "\tbuilding " << n << " students with 6 graded courses each: " << secondsSince(start) * 1000 << " ms" << endl;
+
+	start = chrono::steady_clock::now();
+	uint64_t checksum = 0;
+	for (int i = 0; i < queries; i++)
+		checksum += sms.getTopStudentIndex();
+	double seconds = secondsSince(start);
+	cout << "\tgetTopStudentIndex x " << queries << ": " << seconds * 1e9 / queries << " ns each" << endl;
+
+	start = chrono::steady_clock::now();
+	for (int i = 0; i < queries; i++)
+		checksum += sms.getTopStudentIndices(10)[0];
+	seconds = secondsSince(start);
+	cout << "\tgetTopStudentIndices(10) x " << queries << ": " << seconds * 1e9 / queries << " ns each" << endl;
+
+	start = chrono::steady_clock::now();
+	for (int i = 0; i < queries; i++)
+		checksum += sms.getStudentRank(i % n);
+	seconds = secondsSince(start);
+	cout << "\tgetStudentRank x " << queries << ": " << seconds * 1e9 / queries << " ns each" << endl;
+
+	start = chrono::steady_clock::now();
+	int found = 0;
+	for (int i = 0; i < 1000; i++)
+		found += sms.getStudentsInGPARange(3.5, 4.0).getSize();
+	seconds = secondsSince(start);
+	cout << "\tgetStudentsInGPARange(3.5, 4.0) x 1000: " << seconds * 1e6 / 1000 << " us each (" << found / 1000 << " students)" << endl;
+
+	start = chrono::steady_clock::now();
+	int updated = 0;
+	for (int i = 0; i < queries; i++)
+		updated += sms.assignLetterGrade(rand() % n, rand() % 50, SchoolManagementSystem::generateRandomLetterGrade());
+	seconds = secondsSince(start);
+	cout << "\tassignLetterGrade x " << queries << " (" << updated << " enrolled) with re-ranking: " << seconds * 1e9 / queries
+		<< " ns each (checksum " << checksum << ")" << endl;
 }
 
-StudentMap SchoolManagementSystem::getStudentMap(const int& studentIndex) const
+void benchmarkSnapshot()
 {
-	assert(studentIndex >= 0 && studentIndex < studentMapList.getSize());
+	//Save and restore a 1M student, 5k course system through a binary snapshot
+	const int n = 1000000, courses = 5000;
+	const string path = "benchmark.snapshot";
+	cout << "Binary snapshot" << endl;
+	srand(4);
 
-	return studentMapList[studentIndex];
+	SchoolManagementSystem sms;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	buildBenchmarkSystem(sms, n, courses, 6);
+	cout << "\tbuilding " << n << " students and " << courses << " courses: " << secondsSince(start) * 1000 << " ms" << endl;
+
+	start = chrono::steady_clock::now();
+	bool saved = sms.saveSnapshot(path);
+	double seconds = secondsSince(start);
+
+	ifstream in(path, ios::binary | ios::ate);
+	double megabytes = double(in.tellg()) / (1024 * 1024);
+	in.close();
+	cout << "\tsave: " << (saved ? "" : "FAILED, ") << megabytes << " MB in " << seconds * 1000 << " ms, " << megabytes / seconds << " MB/s" << endl;
+
+	SchoolManagementSystem loaded;
+	start = chrono::steady_clock::now();
+	bool ok = loaded.loadSnapshot(path);
+	seconds = secondsSince(start);
+	cout << "\tload: " << (ok ? "" : "FAILED, ") << megabytes << " MB in " << seconds * 1000 << " ms, " << megabytes / seconds << " MB/s ("
+		<< loaded.getNumberOfRegisteredStudents() << " students, top student " << loaded.getTopStudentIndex() << " vs "
+		<< sms.getTopStudentIndex() << ")" << endl;
+
+	remove(path.c_str());
 }
 
-bool SchoolManagementSystem::registerStudent(const Student& s)
+void benchmarkWriteAheadLog()
 {
-	for (int i = 0; i < studentList.getSize(); i++)
+	//Grade postings with the log attached at several group commit sizes. Every group costs one flush to disk.
+	const int n = 50000, courses = 100;
+	const string path = "benchmark.wal", basePath = "benchmark_base.snap";
+	cout << "Write-ahead log group commit" << endl;
+	srand(5);
+
+	SchoolManagementSystem sms;
+	buildBenchmarkSystem(sms, n, courses, 6);
+
+	int groupSizes[] = { 0, 1, 8, 64, 512 };
+	for (int g = 0; g < 5; g++)
 	{
-		if ((studentList[i].getFirstName() == s.getFirstName()) && (studentList[i].getLastName() == s.getLastName()))
-			return false;
-	}
+		sms.saveSnapshot(basePath); //The state the last log starts from, for the replay below
+
+		int operations = groupSizes[g] == 0 ? 200000 : (groupSizes[g] < 64 ? 500 * groupSizes[g] : 200000);
+
+		remove(path.c_str());
+		WriteAheadLog log;
+		if (groupSizes[g] > 0)
+		{
+			log.open(path, groupSizes[g]);
+			sms.setWriteAheadLog(&log);
+		}
+
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		for (int i = 0; i < operations; i++)
+		{
+			int studentIndex = rand() % n;
+			sms.enrolStudent(studentIndex, rand() % courses);
+			sms.withdrawStudent(studentIndex, rand() % courses);
+		}
+		log.sync();
+		double seconds = secondsSince(start);
 
-	studentList.append(s);
+		sms.setWriteAheadLog(nullptr);
+		if (groupSizes[g] == 0)
+			cout << "\tno log: ";
+		else
+			cout << "\tgroup commit size " << groupSizes[g] << ": ";
+		cout << 2 * operations / seconds << " mutations/s" << endl;
+	}
 
-	StudentMap s1;
-	studentMapList.append(s1);
+	SchoolManagementSystem base;
+	base.loadSnapshot(basePath);
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	int applied = base.replayLog(path);
+	cout << "\treplaying " << applied << " records: " << applied / secondsSince(start) << " records/s" << endl;
 
-	return true;
+	remove(path.c_str());
+	remove(basePath.c_str());
 }
 
-bool SchoolManagementSystem::enrolStudent(const int& studentIndex, const int& courseIndex)
+void benchmarkCsvImport()
 {
-	assert(studentIndex >= 0 && studentIndex < studentList.getSize());
-	assert(courseIndex >= 0 && courseIndex < courseList.getSize());
-
-	for (int i = 0; i < studentMapList[studentIndex].getSize(); i++)
+	//Nightly extract sized import: 300k students, 5k courses and 900k graded enrolments
+	const int n = 300000, courses = 5000, enrolments = 900000;
+	const string studentsPath = "benchmark_students.csv", coursesPath = "benchmark_courses.csv", enrolmentsPath = "benchmark_enrolments.csv";
+	cout << "CSV bulk import" << endl;
+	srand(6);
+
+	SmarterArray<Student> students;
+	students.reserve(n);
+	ofstream out(studentsPath);
+	out << "firstName,lastName,day,month,year\n";
+	for (int i = 0; i < n; i++)
 	{
-		if (studentMapList[studentIndex].keyAtIndex(i) == courseIndex)
-			return false;
+		students.append(SchoolManagementSystem::generateRandomStudent());
+		Date dob = students[i].getDob();
+		out << students[i].getFirstName() << ',' << students[i].getLastName() << ',' << dob.d << ',' << dob.m << ',' << dob.y << '\n';
 	}
+	out.close();
 
-	studentMapList[studentIndex].append(courseIndex, 'N');
+	out.open(coursesPath);
+	out << "name,creditHours\n";
+	for (int i = 0; i < courses; i++)
+		out << "COURSE" << i << ',' << 1 + i % 4 << '\n';
+	out.close();
 
-	return true;
-}
+	out.open(enrolmentsPath);
+	out << "firstName,lastName,courseName,letterGrade\n";
+	for (int i = 0; i < enrolments; i++)
+	{
+		const Student& s = students[i % n];
+		out << s.getFirstName() << ',' << s.getLastName() << ",COURSE" << rand() % courses << ',' << SchoolManagementSystem::generateRandomLetterGrade() << '\n';
+	}
+	out.close();
 
-void SchoolManagementSystem::removeStudent(const int& studentIndex)
-{
-	assert(studentIndex >= 0 && studentIndex < studentList.getSize());
+	SchoolManagementSystem sms;
+	const string* paths[] = { &studentsPath, &coursesPath, &enrolmentsPath };
+	const char* names[] = { "students", "courses", "enrolments" };
+	for (int i = 0; i < 3; i++)
+	{
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		ImportReport report = i == 0 ? sms.importStudentsCsv(*paths[i]) : (i == 1 ? sms.importCoursesCsv(*paths[i]) : sms.importEnrolmentsCsv(*paths[i]));
+		double seconds = secondsSince(start);
 
-	studentList.remove(studentIndex);
-	studentMapList.remove(studentIndex);
+		cout << "\t" << names[i] << ": " << report.rows << " rows (" << report.errors.getSize() << " rejected) in " << seconds * 1000
+			<< " ms, " << report.rows / seconds << " rows/s" << endl;
+		remove(paths[i]->c_str());
+	}
 }
 
-bool SchoolManagementSystem::withdrawStudent(const int& studentIndex, const int& courseIndex)
+void benchmarkReportAllocations()
 {
-	assert(studentIndex >= 0 && studentIndex < studentList.getSize());
-	assert(courseIndex >= 0 && courseIndex < courseList.getSize());
+	//A transcript style report over 100k students: every student, their courses and grades. The copying pass is
+	//what the by-value getters used to do; the view pass reads the same data in place.
+	const int n = 100000;
+	cout << "Report allocations (copies vs views)" << endl;
+	srand(7);
+
+	SchoolManagementSystem sms;
+	buildBenchmarkSystem(sms, n, 500, 6);
 
-	for (int i = 0; i < studentMapList[studentIndex].getSize(); i++)
+	long long before = countAllocations();
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	size_t checksum = 0;
+	for (int i = 0; i < sms.getNumberOfRegisteredStudents(); i++)
 	{
-		if (studentMapList[studentIndex].keyAtIndex(i) == courseIndex)
+		Student s = sms.getStudent(i);
+		StudentMap m = sms.getStudentMap(i);
+		checksum += s.getFirstName().size() + s.getLastName().size();
+		for (int j = 0; j < m.getSize(); j++)
 		{
-			studentMapList[studentIndex].remove(i);
-			return true;
+			Course c = sms.getCourse(m.keyAtIndex(j));
+			string name(c.getCourseName());
+			checksum += name.size() + c.getCreditHours() + m.valueAtIndex(j);
 		}
 	}
+	double seconds = secondsSince(start);
+	cout << "\tcopies: " << describeAllocationsSince(before) << ", " << seconds * 1000 << " ms (checksum " << checksum << ")" << endl;
 
-	return false;
+	before = countAllocations();
+	start = chrono::steady_clock::now();
+	checksum = 0;
+	for (int i = 0; i < sms.getNumberOfRegisteredStudents(); i++)
+	{
+		StudentView s = sms.viewStudent(i);
+		StudentMapView m = sms.viewStudentMap(i);
+		checksum += s.getFirstName().size() + s.getLastName().size();
+		for (int j = 0; j < m.getSize(); j++)
+		{
+			CourseView c = sms.viewCourse(m.keyAtIndex(j));
+			checksum += c.getCourseName().size() + c.getCreditHours() + m.valueAtIndex(j);
+		}
+	}
+	seconds = secondsSince(start);
+	cout << "\tviews: " << describeAllocationsSince(before) << ", " << seconds * 1000 << " ms (checksum " << checksum << ")" << endl;
 }
 
-bool SchoolManagementSystem::assignLetterGrade(const int& studentIndex, const int& courseIndex, const char& letterGrade)
+void benchmarkColumnarScans()
 {
-	assert(studentIndex >= 0 && studentIndex < studentList.getSize());
-	assert(courseIndex >= 0 && courseIndex < courseList.getSize());
-	assert(letterGrade == 'A' || letterGrade == 'B' || letterGrade == 'C' || letterGrade == 'D' || letterGrade == 'F');
+	//Full scans over 1M students stored as Student records and as a StudentTable: an age cohort filter on the birth
+	//year and a last name prefix count. Each scan runs 20 times.
+	const int n = 1000000, runs = 20;
+	cout << "Columnar student scans (records vs table)" << endl;
+	srand(8);
+
+	SmarterArray<Student> records;
+	StudentTable table;
+	records.reserve(n);
+	table.reserve(n);
+	for (int i = 0; i < n; i++)
+	{
+		Student s = SchoolManagementSystem::generateRandomStudent();
+		table.append(s.getFirstNameSymbol(), s.getLastNameSymbol(), s.getDob());
+		records.append(move(s));
+	}
 
-	for (int i = 0; i < studentMapList[studentIndex].getSize(); i++)
+	long long matches = 0;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (int r = 0; r < runs; r++)
 	{
-		if (studentMapList[studentIndex].keyAtIndex(i) == courseIndex)
+		SmarterArray<int> indices;
+		for (int i = 0; i < n; i++)
 		{
-			studentMapList[studentIndex].valueAtIndex(i) = letterGrade;
-			return true;
+			int y = records[i].getDob().y;
+			if (y >= 1999 && y <= 2000)
+				indices.append(i);
 		}
+		matches += indices.getSize();
+	}
+	double seconds = secondsSince(start);
+	cout << "\tcohort, records: " << seconds * 1000 / runs << " ms per scan (" << matches / runs << " matches)" << endl;
+
+	matches = 0;
+	start = chrono::steady_clock::now();
+	for (int r = 0; r < runs; r++)
+		matches += table.findBornBetween(1999, 2000).getSize();
+	seconds = secondsSince(start);
+	cout << "\tcohort, table: " << seconds * 1000 / runs << " ms per scan (" << matches / runs << " matches)" << endl;
+
+	const string_view prefix = "Q";
+	matches = 0;
+	start = chrono::steady_clock::now();
+	for (int r = 0; r < runs; r++)
+	{
+		for (int i = 0; i < n; i++)
+			matches += string_view(records[i].getLastName()).substr(0, prefix.size()) == prefix;
 	}
+	seconds = secondsSince(start);
+	cout << "\tlast name prefix, records: " << seconds * 1000 / runs << " ms per scan (" << matches / runs << " matches)" << endl;
 
-	return false;
+	matches = 0;
+	start = chrono::steady_clock::now();
+	for (int r = 0; r < runs; r++)
+	{
+		for (int i = 0; i < n; i++)
+			matches += table.getLastName(i).substr(0, prefix.size()) == prefix;
+	}
+	seconds = secondsSince(start);
+	cout << "\tlast name prefix, table: " << seconds * 1000 / runs << " ms per scan (" << matches / runs << " matches)" << endl;
 }
 
-double SchoolManagementSystem::getStudentGPA(const int& studentIndex) const
+void benchmarkInterning()
 {
-	assert(studentIndex >= 0 && studentIndex < studentList.getSize());
+	//Memory held by 1M students as interned symbols, against what the same names cost as two std::strings per student.
+	//Random names are nearly all distinct, which is the worst case for interning; the second dataset draws names
+	//from 2000 first names and 50000 last names, closer to a real school.
+	const int n = 1000000;
+	cout << "Name interning memory (1M students)" << endl;
+	srand(9);
+
+	SmarterArray<string> firstNames, lastNames;
+	for (int i = 0; i < 50000; i++)
+	{
+		Student s = SchoolManagementSystem::generateRandomStudent();
+		if (i < 2000)
+			firstNames.append(string(s.getFirstName()));
+		lastNames.append(string(s.getLastName()) + "son");
+	}
 
-	double totalScore = 0;
-	int totalUnits = 0;
-	for (int i = 0; i < studentMapList[studentIndex].getSize(); i++)
+	for (int dataset = 0; dataset < 2; dataset++)
 	{
-		if (studentMapList[studentIndex].valueAtIndex(i) == 'A')
-		{
-			totalScore += 4.00 * courseList[studentMapList[studentIndex].keyAtIndex(i)].getCreditHours();
-			totalUnits += courseList[studentMapList[studentIndex].keyAtIndex(i)].getCreditHours();
-		}
-		else if (studentMapList[studentIndex].valueAtIndex(i) == 'B')
+		size_t poolBefore = namePool().getMemoryUsage();
+		size_t stringBytes = 0;
+		SmarterArray<Student> students;
+		students.reserve(n);
+		for (int i = 0; i < n; i++)
 		{
-			totalScore += 3.00 * courseList[studentMapList[studentIndex].keyAtIndex(i)].getCreditHours();
-			totalUnits += courseList[studentMapList[studentIndex].keyAtIndex(i)].getCreditHours();
+			Student s = dataset == 0 ? SchoolManagementSystem::generateRandomStudent() :
+				Student(firstNames[rand() % firstNames.getSize()], lastNames[rand() % lastNames.getSize()], Date{ 1, 1, 2000 });
+
+			//Two strings inline plus whatever did not fit the small string buffer
+			string first(s.getFirstName()), last(s.getLastName());
+			stringBytes += 2 * sizeof(string) + sizeof(Date);
+			if (first.capacity() > string().capacity())
+				stringBytes += first.capacity() + 1;
+			if (last.capacity() > string().capacity())
+				stringBytes += last.capacity() + 1;
+			students.append(s);
 		}
-		else if (studentMapList[studentIndex].valueAtIndex(i) == 'C')
+		size_t symbolBytes = size_t(n) * sizeof(Student) + (namePool().getMemoryUsage() - poolBefore);
+
+		cout << "\t" << (dataset == 0 ? "random names" : "common names") << ": strings " << stringBytes / 1e6 << " MB, symbols "
+			<< symbolBytes / 1e6 << " MB (" << (double(stringBytes) - double(symbolBytes)) / 1e6 << " MB saved), "
+			<< namePool().getSize() << " names interned so far" << endl;
+	}
+}
+
+void benchmarkMapResources()
+{
+	//Builds a 500k student system (6 graded courses each) with its storage resource set to the default heap, a
+	//size-class pool and a monotonic arena, then loads it back from a snapshot, the bulk-load path the arena is meant
+	//for. Destroying the system is timed too, since that is where one free per name list adds up.
+	const int n = 500000;
+	const string path = "benchmark_resources.snapshot";
+	cout << "Storage resource (default heap vs pool vs arena)" << endl;
+
+	const char* names[] = { "default heap", "size-class pool", "monotonic arena" };
+	for (int variant = 0; variant < 3; variant++)
+	{
+		pmr::unsynchronized_pool_resource pool;
+		pmr::monotonic_buffer_resource arena;
+		pmr::memory_resource* resources[] = { nullptr, &pool, &arena };
+
+		srand(10);
+		long long before = countAllocations();
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		SchoolManagementSystem* sms = new SchoolManagementSystem;
+		sms->setStorageResource(resources[variant]);
+		buildBenchmarkSystem(*sms, n, 2000, 6);
+		double buildSeconds = secondsSince(start);
+		string buildAllocations = describeAllocationsSince(before);
+		if (variant == 0)
+			sms->saveSnapshot(path);
+
+		start = chrono::steady_clock::now();
+		delete sms;
+		double destroySeconds = secondsSince(start);
+
+		before = countAllocations();
+		start = chrono::steady_clock::now();
+		sms = new SchoolManagementSystem;
+		sms->setStorageResource(resources[variant]);
+		sms->loadSnapshot(path);
+		double loadSeconds = secondsSince(start);
+		string loadAllocations = describeAllocationsSince(before);
+		delete sms;
+
+		cout << "\t" << names[variant] << ": build " << buildSeconds * 1000 << " ms (" << buildAllocations << "), destroy "
+			<< destroySeconds * 1000 << " ms, load " << loadSeconds * 1000 << " ms (" << loadAllocations << ")" << endl;
+	}
+	remove(path.c_str());
+}
+
+void benchmarkEnrolmentStore()
+{
+	//1M students with 6 graded courses each, stored as one StudentMap per student and as an EnrolmentStore: the memory
+	//each takes and the time of a GPA totals pass over every student
+	const int n = 1000000, courses = 2000, coursesPerStudent = 6, runs = 10;
+	cout << "Enrolment storage (maps vs packed store)" << endl;
+	srand(11);
+
+	SmarterArray<int> creditHours;
+	for (int i = 0; i < courses; i++)
+		creditHours.append(1 + i % 4);
+
+	long long before = countAllocations();
+	SmarterArray<StudentMap> maps;
+	maps.reserve(n);
+	EnrolmentStore store;
+	for (int i = 0; i < n; i++)
+	{
+		StudentMap& m = maps.emplace_back();
+		store.addStudent(0);
+		for (int j = 0; j < coursesPerStudent; j++)
 		{
-			totalScore += 2.00 * courseList[studentMapList[studentIndex].keyAtIndex(i)].getCreditHours();
-			totalUnits += courseList[studentMapList[studentIndex].keyAtIndex(i)].getCreditHours();
+			int courseIndex = rand() % courses;
+			char letterGrade = SchoolManagementSystem::generateRandomLetterGrade();
+			if (m.find(courseIndex) != -1)
+				continue;
+			m.append(courseIndex, letterGrade);
+			store.append(i, courseIndex, letterGrade, 0); //No rosters to keep slots for
 		}
-		else if (studentMapList[studentIndex].valueAtIndex(i) == 'D')
+	}
+	cout << "\tbuilding both: " << describeAllocationsSince(before) << endl;
+
+	size_t mapBytes = size_t(maps.getCapacity() - maps.getSize()) * sizeof(StudentMap);
+	for (int i = 0; i < n; i++)
+		mapBytes += maps[i].getMemoryUsage();
+	cout << "\tmaps: " << mapBytes / 1e6 << " MB plus " << 2 * n << " heap blocks; store: " << store.getMemoryUsage() / 1e6 << " MB" << endl;
+
+	long long check = 0;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (int r = 0; r < runs; r++)
+	{
+		for (int i = 0; i < n; i++)
 		{
-			totalScore += 1.00 * courseList[studentMapList[studentIndex].keyAtIndex(i)].getCreditHours();
-			totalUnits += courseList[studentMapList[studentIndex].keyAtIndex(i)].getCreditHours();
+			GradeTotals totals{ 0, 0 };
+			const StudentMap& m = maps[i];
+			for (int j = 0; j < m.getSize(); j++)
+				totals.add(m.valueAtIndex(j), creditHours[m.keyAtIndex(j)]);
+			check += totals.qualityPoints;
 		}
-		else if (studentMapList[studentIndex].valueAtIndex(i) == 'F')
+	}
+	double seconds = secondsSince(start);
+	cout << "\tGPA pass, maps: " << seconds * 1000 / runs << " ms (check " << check / runs << ")" << endl;
+
+	check = 0;
+	start = chrono::steady_clock::now();
+	for (int r = 0; r < runs; r++)
+	{
+		for (int i = 0; i < n; i++)
 		{
-			totalScore += 0.0 * courseList[studentMapList[studentIndex].keyAtIndex(i)].getCreditHours();
-			totalUnits += courseList[studentMapList[studentIndex].keyAtIndex(i)].getCreditHours();
+			GradeTotals totals{ 0, 0 };
+			const uint32_t* e = store.getEnrolments(i);
+			for (int j = 0; j < store.getCount(i); j++)
+				totals.add(EnrolmentStore::getGrade(e[j]), creditHours[EnrolmentStore::getCourse(e[j])]);
+			check += totals.qualityPoints;
 		}
 	}
+	seconds = secondsSince(start);
+	cout << "\tGPA pass, store: " << seconds * 1000 / runs << " ms (check " << check / runs << ")" << endl;
+}
 
-	if (totalUnits == 0)
-		return 0.0;
+void benchmarkParallelGPA()
+{
+	//End of term batch over 1M graded students: recompute every GPA and the top 10 on 1 to N threads, where N is the
+	//number of hardware threads, and check each run against the serial results
+	const int n = 1000000, runs = 5;
+	cout << "Parallel GPA batch" << endl;
+	srand(12);
 
-	double gpa = totalScore / totalUnits;
+	SchoolManagementSystem sms;
+	buildBenchmarkSystem(sms, n, 2000, 6);
 
-	return gpa;
+	SmarterArray<double> serial, gpas;
+	for (int i = 0; i < n; i++)
+	{
+		serial.append(0.0);
+		gpas.append(0.0);
+	}
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (int r = 0; r < runs; r++)
+		sms.computeAllGPAs(&serial[0], n);
+	double serialSeconds = secondsSince(start) / runs;
+	SmarterArray<int> serialTop = sms.computeTopStudentIndices(10);
+	cout << "\tserial: computeAllGPAs " << serialSeconds * 1000 << " ms" << endl;
+
+	int maxThreads = max(1, int(thread::hardware_concurrency()));
+	for (int threads = 1; ; threads = min(threads * 2, maxThreads))
+	{
+		ThreadPool pool(threads);
+		start = chrono::steady_clock::now();
+		for (int r = 0; r < runs; r++)
+			sms.computeAllGPAs(&gpas[0], n, &pool);
+		double seconds = secondsSince(start) / runs;
+
+		start = chrono::steady_clock::now();
+		SmarterArray<int> top;
+		for (int r = 0; r < runs; r++)
+			top = sms.computeTopStudentIndices(10, &pool);
+		double topSeconds = secondsSince(start) / runs;
+
+		bool same = top.getSize() == serialTop.getSize() && top[0] == sms.getTopStudentIndex();
+		for (int i = 0; i < top.getSize() && same; i++)
+			same = top[i] == serialTop[i];
+		for (int i = 0; i < n && same; i++)
+			same = gpas[i] == serial[i];
+		cout << "\t" << threads << " threads: computeAllGPAs " << seconds * 1000 << " ms (" << serialSeconds / seconds
+			<< "x), top 10 " << topSeconds * 1000 << " ms, " << (same ? "matches serial" : "DIFFERS FROM SERIAL") << endl;
+
+		if (threads == maxThreads)
+			break;
+	}
 }
 
-int SchoolManagementSystem::getTopStudentIndex() const
+void benchmarkGradeKernels()
 {
-	double gpa;
-	int topIndex;
-	bool status = true;
+	//The GradeTotals of 1M students with 1 to 12 enrolments each, a few of them ungraded, summed by GradeTotals::add with
+	//credit hours read through the course list, and by each grade point kernel the CPU supports
+	const int n = 1000000, courses = 2000, runs = 10;
+	const char grades[] = { 'A', 'B', 'C', 'D', 'F', 'A', 'B', 'C', 'D', 'F', 'N' };
+	cout << "Grade point kernels" << endl;
+	srand(13);
+
+	SmarterArray<Course> courseList;
+	SmarterArray<int> creditHours;
+	for (int i = 0; i < courses; i++)
+	{
+		courseList.append(Course("COURSE" + to_string(i), 1 + i % 4));
+		creditHours.append(courseList[i].getCreditHours());
+	}
 
-	for (int i = 0; i < studentList.getSize(); i++)
+	EnrolmentStore store;
+	for (int i = 0; i < n; i++)
 	{
-		if (status)
+		store.addStudent(0);
+		int count = 1 + rand() % 12;
+		for (int j = 0; j < count; j++)
+			store.append(i, rand() % courses, grades[rand() % sizeof(grades)], 0);
+	}
+
+	SmarterArray<GradeTotals> expected;
+	for (int i = 0; i < n; i++)
+		expected.append(GradeTotals{ 0, 0 });
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (int r = 0; r < runs; r++)
+	{
+		for (int i = 0; i < n; i++)
 		{
-			gpa = getStudentGPA(i);
-			topIndex = i;
-			status = false;
+			GradeTotals totals{ 0, 0 };
+			const uint32_t* e = store.getEnrolments(i);
+			for (int j = 0; j < store.getCount(i); j++)
+				totals.add(EnrolmentStore::getGrade(e[j]), courseList[EnrolmentStore::getCourse(e[j])].getCreditHours());
+			expected[i] = totals;
 		}
-		else if (getStudentGPA(i) > gpa)
+	}
+	cout << "\tGradeTotals::add: " << secondsSince(start) * 1000 / runs << " ms" << endl;
+
+	SmarterArray<GradeTotalsKernel> kernels;
+	SmarterArray<string> names;
+	kernels.append(sumGradeTotalsScalar);
+	names.append("scalar table");
+#ifdef SMS_X86_SIMD
+	if (cpuSupportsAvx2())
+	{
+		kernels.append(sumGradeTotalsAvx2);
+		names.append("AVX2");
+	}
+#endif
+
+	for (int k = 0; k < kernels.getSize(); k++)
+	{
+		bool same = true;
+		start = chrono::steady_clock::now();
+		for (int r = 0; r < runs; r++)
 		{
-			gpa = getStudentGPA(i);
-			topIndex = i;
+			for (int i = 0; i < n; i++)
+				same &= kernels[k](store.getEnrolments(i), store.getCount(i), &creditHours[0]) == expected[i];
 		}
+		cout << "\t" << names[k] << " kernel: " << secondsSince(start) * 1000 / runs << " ms, "
+			<< (same ? "matches GradeTotals::add" : "DIFFERS FROM GradeTotals::add") << endl;
 	}
-
-	return topIndex;
 }
 
-int SchoolManagementSystem::findCourse(const string& courseName) const
+void benchmarkConcurrentAccess()
 {
-	for (int i = 0; i < courseList.getSize(); i++)
+	//Many threads sharing one system of 200k graded students: each thread mixes name lookups, GPA reads and course reads
+	//with 1 grade posting in 20. Reports the throughput on 1 to max(4, hardware threads) threads and checks afterwards
+	//that the cached GPAs still match a full recompute.
+	const int n = 200000, courses = 500, opsPerThread = 200000, names = 10000;
+	cout << "Concurrent access (95% reads, 5% writes)" << endl;
+	srand(14);
+
+	ConcurrentSchoolManagementSystem sms;
+	sms.write([&](SchoolManagementSystem& s) { buildBenchmarkSystem(s, n, courses, 6); return 0; });
+
+	SmarterArray<string> firstNames, lastNames;
+	for (int i = 0; i < names; i++)
 	{
-		if (courseList[i].getCourseName() == courseName)
-			return i;
+		Student s = sms.getStudent(rand() % n);
+		firstNames.append(string(s.getFirstName()));
+		lastNames.append(string(s.getLastName()));
 	}
 
-	return -1;
+	int maxThreads = max(4, int(thread::hardware_concurrency()));
+	for (int threads = 1; ; threads = min(threads * 2, maxThreads))
+	{
+		atomic<long long> checksum(0);
+		auto work = [&](const int& t)
+		{
+			uint32_t seed = 2463534242u + uint32_t(t); //xorshift32, so the threads do not share rand's state
+			auto next = [&]() { seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5; return seed; };
+			long long sum = 0;
+			for (int i = 0; i < opsPerThread; i++)
+			{
+				uint32_t op = next() % 20;
+				if (op == 0)
+					sum += sms.assignLetterGrade(int(next() % n), int(next() % courses), "ABCDF"[next() % 5]);
+				else if (op < 8)
+				{
+					int k = next() % names;
+					sum += sms.findStudent(firstNames[k], lastNames[k]);
+				}
+				else if (op < 16)
+					sum += int(sms.getStudentGPA(int(next() % n)) * 100);
+				else
+					sum += sms.getCourse(int(next() % courses)).getCreditHours();
+			}
+			checksum += sum;
+		};
+
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		SmarterArray<thread> pool;
+		for (int t = 0; t < threads; t++)
+			pool.append(thread(work, t));
+		for (int t = 0; t < threads; t++)
+			pool[t].join();
+		double seconds = secondsSince(start);
+
+		bool consistent = sms.read([](const SchoolManagementSystem& s) { return s.checkGPACache(); });
+		cout << "\t" << threads << " threads: " << threads * double(opsPerThread) / seconds / 1e6 << " M ops/s, GPA cache "
+			<< (consistent ? "consistent" : "INCONSISTENT") << " (checksum " << checksum.load() << ")" << endl;
+
+		if (threads == maxThreads)
+			break;
+	}
+
+	//Read latency while another thread enrols and withdraws students through a log flushed to disk after every record.
+	//GPA reads come from the published snapshot; name lookups take the shared lock and wait out the flushes.
+	const string path = "benchmark_concurrent.wal";
+	const int samples = 20000;
+	remove(path.c_str());
+	WriteAheadLog log;
+	log.open(path, 1);
+	sms.write([&](SchoolManagementSystem& s) { s.setWriteAheadLog(&log); return 0; });
+
+	atomic<bool> done(false);
+	atomic<int> writes(0);
+	thread writer([&]()
+	{
+		uint32_t seed = 521288629u;
+		while (!done.load(memory_order_relaxed))
+		{
+			seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5;
+			int studentIndex = int(seed % uint32_t(n)), courseIndex = int((seed >> 8) % uint32_t(courses));
+			if (sms.enrolStudent(studentIndex, courseIndex))
+				sms.withdrawStudent(studentIndex, courseIndex);
+			writes++;
+		}
+	});
+
+	SmarterArray<double> gpaLatencies, findLatencies; //In microseconds
+	gpaLatencies.reserve(samples);
+	findLatencies.reserve(samples);
+	long long sum = 0;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (int i = 0; i < samples; i++)
+	{
+		chrono::steady_clock::time_point before = chrono::steady_clock::now();
+		sum += int(sms.getStudentGPA(rand() % n) * 100);
+		chrono::steady_clock::time_point between = chrono::steady_clock::now();
+		int k = rand() % names;
+		sum += sms.findStudent(firstNames[k], lastNames[k]);
+		chrono::steady_clock::time_point after = chrono::steady_clock::now();
+		gpaLatencies.append(chrono::duration<double, micro>(between - before).count());
+		findLatencies.append(chrono::duration<double, micro>(after - between).count());
+	}
+	double seconds = secondsSince(start);
+	done = true;
+	writer.join();
+	sms.write([](SchoolManagementSystem& s) { s.setWriteAheadLog(nullptr); return 0; });
+	log.close();
+	remove(path.c_str());
+
+	auto percentiles = [](SmarterArray<double>& latencies)
+	{
+		double* first = &latencies[0];
+		double* last = first + latencies.getSize();
+		stringstream out;
+		nth_element(first, first + latencies.getSize() / 2, last);
+		out << "p50 " << first[latencies.getSize() / 2];
+		nth_element(first, first + latencies.getSize() * 99 / 100, last);
+		out << " us, p99 " << first[latencies.getSize() * 99 / 100] << " us, max " << *max_element(first, last) << " us";
+		return out.str();
+	};
+	cout << "\treads beside " << writes.load() / seconds << " logged writes/s flushed one by one (checksum " << sum << "):" << endl;
+	cout << "\t\tGPA from the snapshot: " << percentiles(gpaLatencies) << endl;
+	cout << "\t\tname lookup under the lock: " << percentiles(findLatencies) << endl;
 }
 
-Course SchoolManagementSystem::getCourse(const int& courseIndex) const
+void benchmarkShardedAccess()
 {
-	assert(courseIndex >= 0 && courseIndex < courseList.getSize());
+	//100k graded students split across 1 to 8 shards, shared by max(4, hardware threads) threads that each mix name
+	//lookups and GPA reads with grade postings half and half, so that writes dominate the time spent holding locks
+	const int n = 100000, courses = 500, opsPerThread = 100000, names = 10000;
+	int threads = max(4, int(thread::hardware_concurrency()));
+	cout << "Sharded access (" << threads << " threads, 50% writes)" << endl;
 
-	return courseList[courseIndex];
+	for (int shardCount = 1; shardCount <= 8; shardCount *= 2)
+	{
+		srand(15);
+		ShardedSchoolManagementSystem sms(shardCount);
+		for (int i = 0; i < courses; i++)
+			sms.offerCourse(Course("COURSE" + to_string(i), 1 + i % 4));
+
+		SmarterArray<string> firstNames, lastNames;
+		while (sms.getNumberOfRegisteredStudents() < n)
+		{
+			Student s = SchoolManagementSystem::generateRandomStudent();
+			if (!sms.registerStudent(s))
+				continue;
+			StudentLocation student = sms.findStudent(s.getFirstName(), s.getLastName());
+			for (int j = 0; j < 6; j++)
+			{
+				int courseIndex = rand() % courses;
+				sms.enrolStudent(student, courseIndex);
+				sms.assignLetterGrade(student, courseIndex, SchoolManagementSystem::generateRandomLetterGrade());
+			}
+			if (firstNames.getSize() < names)
+			{
+				firstNames.append(string(s.getFirstName()));
+				lastNames.append(string(s.getLastName()));
+			}
+		}
+
+		atomic<long long> checksum(0);
+		auto work = [&](const int& t)
+		{
+			uint32_t seed = 88675123u + uint32_t(t); //xorshift32, so the threads do not share rand's state
+			auto next = [&]() { seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5; return seed; };
+			long long sum = 0;
+			for (int i = 0; i < opsPerThread; i++)
+			{
+				int k = next() % names;
+				StudentLocation student = sms.findStudent(firstNames[k], lastNames[k]);
+				if (next() % 2 == 0)
+					sum += sms.assignLetterGrade(student, next() % courses, "ABCDF"[next() % 5]);
+				else
+					sum += int(sms.getStudentGPA(student) * 100);
+			}
+			checksum += sum;
+		};
+
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		SmarterArray<thread> pool;
+		for (int t = 0; t < threads; t++)
+			pool.append(thread(work, t));
+		for (int t = 0; t < threads; t++)
+			pool[t].join();
+		double seconds = secondsSince(start);
+
+		StudentLocation top = sms.getTopStudent();
+		cout << "\t" << shardCount << " shards: " << threads * double(opsPerThread) / seconds / 1e6 << " M ops/s, top student "
+			<< sms.getStudentGPA(top) << " GPA, " << sms.getCourseRoster(0).getSize() << " in course 0 (checksum "
+			<< checksum.load() << ")" << endl;
+	}
 }
 
-bool SchoolManagementSystem::offerCourse(const Course& course)
+void benchmarkBatchMutations()
 {
-	for (int i = 0; i < courseList.getSize(); i++)
+	//Term end on 100k students with 6 courses each: 200k grade postings, 20k enrolments in new courses and 20k
+	//withdrawals, applied call by call to one system and as a single batch to an identical one
+	const int n = 100000, courses = 200, newCourses = 10, grades = 200000, enrolments = 20000, withdrawals = 20000;
+	cout << "Batched mutations" << endl;
+
+	SchoolManagementSystem perCall, batched;
+	srand(16);
+	buildBenchmarkSystem(perCall, n, courses, 6);
+	srand(16);
+	buildBenchmarkSystem(batched, n, courses, 6);
+	for (int i = 0; i < newCourses; i++)
 	{
-		if (courseList[i].getCourseName() == course.getCourseName())
-			return false;
+		perCall.offerCourse(Course("NEW" + to_string(i), 3));
+		batched.offerCourse(Course("NEW" + to_string(i), 3));
 	}
 
-	courseList.append(course);
-
-	return true;
+	//Grades first, then enrolments of the first students, then withdrawals of the last, so that every operation is
+	//valid in batch order
+	SmarterArray<EnrolmentOperation> operations;
+	operations.reserve(grades + enrolments + withdrawals);
+	for (int i = 0; i < grades; i++)
+	{
+		int studentIndex = rand() % n;
+		StudentMapView map = perCall.viewStudentMap(studentIndex);
+		operations.append(EnrolmentOperation{ EnrolmentOperation::grade, studentIndex, map.keyAtIndex(rand() % map.getSize()),
+			SchoolManagementSystem::generateRandomLetterGrade() });
+	}
+	for (int i = 0; i < enrolments; i++)
+		operations.append(EnrolmentOperation{ EnrolmentOperation::enrol, i, courses + i % newCourses, 0 });
+	for (int i = n - withdrawals; i < n; i++)
+		operations.append(EnrolmentOperation{ EnrolmentOperation::withdraw, i, perCall.viewStudentMap(i).keyAtIndex(0), 0 });
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	int applied = 0;
+	for (int i = 0; i < operations.getSize(); i++)
+	{
+		const EnrolmentOperation& op = operations[i];
+		if (op.kind == EnrolmentOperation::enrol)
+			applied += perCall.enrolStudent(op.studentIndex, op.courseIndex);
+		else if (op.kind == EnrolmentOperation::withdraw)
+			applied += perCall.withdrawStudent(op.studentIndex, op.courseIndex);
+		else
+			applied += perCall.assignLetterGrade(op.studentIndex, op.courseIndex, op.letterGrade);
+	}
+	double seconds = secondsSince(start);
+	cout << "\tper call: " << seconds * 1000 << " ms (" << applied << " of " << operations.getSize() << " applied)" << endl;
+
+	//A batch whose last operation fails (student 0 only ever enrols in the first new course) must change nothing
+	double gpaSum = 0.0;
+	for (int i = 0; i < n; i++)
+		gpaSum += batched.getStudentGPA(i);
+	SmarterArray<EnrolmentOperation> rejected = operations;
+	rejected.append(EnrolmentOperation{ EnrolmentOperation::withdraw, 0, courses + newCourses - 1, 0 });
+	int failed = -1;
+	bool accepted = batched.applyBatch(rejected, &failed);
+	double gpaSumAfter = 0.0;
+	for (int i = 0; i < n; i++)
+		gpaSumAfter += batched.getStudentGPA(i);
+	bool unchanged = failed == operations.getSize() && gpaSum == gpaSumAfter && batched.getCourseRoster(courses).getSize() == 0;
+
+	start = chrono::steady_clock::now();
+	accepted = batched.applyBatch(operations) && !accepted;
+	seconds = secondsSince(start);
+
+	bool same = accepted && unchanged && batched.checkGPACache();
+	for (int i = 0; i < n && same; i++)
+	{
+		StudentMapView a = perCall.viewStudentMap(i), b = batched.viewStudentMap(i);
+		same = a.getSize() == b.getSize() && perCall.getStudentGPA(i) == batched.getStudentGPA(i);
+		for (int j = 0; j < a.getSize() && same; j++)
+			same = a.keyAtIndex(j) == b.keyAtIndex(j) && a.valueAtIndex(j) == b.valueAtIndex(j);
+	}
+	for (int i = 0; i < courses + newCourses && same; i++)
+		same = perCall.getCourseRoster(i) == batched.getCourseRoster(i);
+	cout << "\tbatch: " << seconds * 1000 << " ms, " << (same ? "same result as per call" : "DIFFERS FROM PER CALL")
+		<< " (rejected batch failed at operation " << failed << ")" << endl;
 }
 
-void SchoolManagementSystem::removeCourse(const int& courseIndex)
+void benchmarkRequestServer()
 {
-	assert(courseIndex >= 0 && courseIndex < courseList.getSize());
+	//The request server on a loopback port with one worker per hardware thread, serving 100k graded students to
+	//4 connections of 20k requests each, first one request at a time and then 32 in flight per connection
+	const int n = 100000, courses = 500, connections = 4, requestsPerConnection = 20000;
+	cout << "Request server (localhost TCP)" << endl;
+	srand(17);
 
-	for (int i = 0; i < studentMapList.getSize(); i++)
+	ConcurrentSchoolManagementSystem sms;
+	sms.write([&](SchoolManagementSystem& s) { buildBenchmarkSystem(s, n, courses, 6); return 0; });
+
+	RequestServer server(sms);
+	if (!server.start(0, max(1, int(thread::hardware_concurrency()))))
 	{
-		for (int j = 0; j < studentMapList[i].getSize(); j++)
-		{
-			if (studentMapList[i].keyAtIndex(j) == courseIndex)
-				studentMapList[i].remove(j);
-		}
+		cout << "\tcould not listen on a loopback port" << endl;
+		return;
 	}
+	thread loop(&RequestServer::run, &server);
+
+	for (int depth : { 1, 32 })
+		cout << "\tpipeline depth " << depth << ": " << runLoadGenerator(server.getPort(), connections, requestsPerConnection, depth) << endl;
+
+	server.stop();
+	loop.join();
+}
 
-	courseList.remove(courseIndex);
+void benchmarkSnapshotReports()
+{
+	//A report over 200k graded students (every student's name, grades and GPA rendered to a string) while another thread
+	//posts grades as fast as it can, first holding the shared lock for the whole report and then over a snapshot. Reports
+	//how long the report and the snapshot took, how many grades were posted meanwhile and the longest any one of them
+	//waited, and whether the snapshot still renders the same once the posting is over.
+	const int n = 200000, courses = 500;
+	cout << "Snapshot reports (one writer posting grades during the report)" << endl;
+	srand(18);
+
+	ConcurrentSchoolManagementSystem sms;
+	sms.write([&](SchoolManagementSystem& s) { buildBenchmarkSystem(s, n, courses, 6); return 0; });
+
+	auto render = [](const auto& s)
+	{
+		ostringstream out;
+		for (int i = 0; i < s.getNumberOfRegisteredStudents(); i++)
+			out << s.viewStudent(i) << endl << s.viewStudentMap(i) << "GPA = " << s.getStudentGPA(i) << endl;
+		return out.str();
+	};
 
-	for (int i = 0; i < studentMapList.getSize(); i++)
+	for (bool useSnapshot : { false, true })
 	{
-		for (int j = 0; j < studentMapList[i].getSize(); j++)
+		atomic<bool> done(false);
+		long long posted = 0;
+		double longestWait = 0;
+		thread writer([&]()
 		{
-			if (studentMapList[i].keyAtIndex(j) > courseIndex)
+			uint32_t seed = 2463534242u; //xorshift32, so the writer does not share rand's state with the report
+			auto next = [&]() { seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5; return seed; };
+			while (!done)
 			{
-				studentMapList[i].keyAtIndex(j)--;
+				chrono::steady_clock::time_point start = chrono::steady_clock::now();
+				sms.assignLetterGrade(int(next() % n), int(next() % courses), "ABCDF"[next() % 5]);
+				longestWait = max(longestWait, secondsSince(start));
+				posted++;
 			}
+		});
+
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		string report;
+		if (useSnapshot)
+		{
+			SchoolSnapshot snapshot = sms.takeSnapshot();
+			double snapshotSeconds = secondsSince(start);
+			report = render(snapshot);
+			double seconds = secondsSince(start);
+			done = true;
+			writer.join();
+
+			bool unchanged = render(snapshot) == report;
+			cout << "\tover a snapshot: " << seconds * 1000 << " ms (snapshot " << snapshotSeconds * 1e6 << " us), " << posted
+				<< " grades posted meanwhile, longest wait " << longestWait * 1000 << " ms, snapshot "
+				<< (unchanged ? "unchanged" : "CHANGED") << " afterwards (" << report.size() / (1024 * 1024) << " MB)" << endl;
+		}
+		else
+		{
+			report = sms.read(render);
+			double seconds = secondsSince(start);
+			done = true;
+			writer.join();
+			cout << "\tholding the shared lock: " << seconds * 1000 << " ms, " << posted << " grades posted meanwhile, longest wait "
+				<< longestWait * 1000 << " ms (" << report.size() / (1024 * 1024) << " MB)" << endl;
 		}
 	}
 }
 
-ostream& operator << (ostream& out, const SchoolManagementSystem& sms)
+bool filesEqual(const string& path1, const string& path2)
 {
-	out << endl << "Students List" << endl;
-	if (sms.studentList.getSize() == 0)
-		out << "No student has been registered yet." << endl;
-	for (int studentIndex = 0; studentIndex < sms.studentList.getSize(); studentIndex++)
-		out << "Student at index " << studentIndex << ": " << sms.studentList[studentIndex] << endl;
+	ifstream in1(path1, ios::binary), in2(path2, ios::binary);
+	string block1(1 << 20, '\0'), block2(1 << 20, '\0');
+	while (in1 && in2)
+	{
+		in1.read(&block1[0], streamsize(block1.size()));
+		in2.read(&block2[0], streamsize(block2.size()));
+		if (in1.gcount() != in2.gcount() || memcmp(block1.data(), block2.data(), size_t(in1.gcount())) != 0)
+			return false;
+	}
+	return in1.eof() && in2.eof();
+}
 
-	out << endl << "Courses List" << endl;
-	if (sms.courseList.getSize() == 0)
-		out << "No course has been offered yet." << endl;
-	for (int courseIndex = 0; courseIndex < sms.courseList.getSize(); courseIndex++)
-		out << "Course at index " << courseIndex << ": " << sms.courseList[courseIndex] << endl;
+void benchmarkReportRendering()
+{
+	//Transcripts of 1M graded students written to a file: through an ofstream with endl on every line, as the operator <<
+	//overloads did, and by a ReportRenderer in each format, on the calling thread and on a pool of one thread per
+	//hardware thread. The text report must match the ofstream one byte for byte.
+	const int n = 1000000, courses = 5000;
+	const string streamPath = "benchmark-stream.txt", reportPath = "benchmark-report.txt";
+	cout << "Report rendering" << endl;
+	srand(19);
+
+	SchoolManagementSystem sms;
+	buildBenchmarkSystem(sms, n, courses, 6);
+	SchoolSnapshot snapshot = sms.takeSnapshot();
 
-	cout << endl << "Students Map" << endl;
-	if (sms.studentMapList.getSize() == 0)
-		out << "No student is enrolled in any course yet." << endl;
-	for (int studentIndex = 0; studentIndex < sms.studentMapList.getSize(); studentIndex++)
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	{
+		ofstream out(streamPath);
+		for (int i = 0; i < n; i++)
+		{
+			StudentMapView m = snapshot.viewStudentMap(i);
+			out << "Student at index " << i << ": " << snapshot.viewStudent(i) << endl;
+			for (int j = 0; j < m.getSize(); j++)
+				out << snapshot.viewCourse(m.keyAtIndex(j)) << ", Letter Grade = " << m.valueAtIndex(j) << endl;
+			out << "GPA = " << snapshot.getStudentGPA(i) << endl << endl;
+		}
+	}
+	double seconds = secondsSince(start);
+	ifstream in(streamPath, ios::binary | ios::ate);
+	double megabytes = double(in.tellg()) / (1024 * 1024);
+	in.close();
+	cout << "\tofstream with endl, text: " << megabytes << " MB in " << seconds * 1000 << " ms, " << megabytes / seconds << " MB/s" << endl;
+
+	ReportRenderer renderer;
+	ThreadPool pool(max(1, int(thread::hardware_concurrency())));
+	const char* formatNames[] = { "text", "CSV", "JSON Lines" };
+	for (ReportFormat format : { reportText, reportCsv, reportJsonLines })
 	{
-		out << "Student at index " << studentIndex << endl;
-		out << sms.studentMapList[studentIndex];
-		out << "GPA = " << sms.getStudentGPA(studentIndex) << endl << endl;
+		for (ThreadPool* p : { (ThreadPool*)nullptr, &pool })
+		{
+			start = chrono::steady_clock::now();
+			bool ok = renderer.render(snapshot, format, reportPath, p);
+			seconds = secondsSince(start);
+			megabytes = double(renderer.getBytesWritten()) / (1024 * 1024);
+			cout << "\trenderer, " << formatNames[format] << ", " << (p == nullptr ? 1 : p->getThreadCount()) << " threads: "
+				<< (ok ? "" : "FAILED, ") << megabytes << " MB in " << seconds * 1000 << " ms, " << megabytes / seconds << " MB/s";
+			if (format == reportText)
+				cout << (filesEqual(streamPath, reportPath) ? ", matches ofstream" : ", DIFFERS FROM OFSTREAM");
+			cout << endl;
+		}
 	}
-	return out;
+
+	remove(streamPath.c_str());
+	remove(reportPath.c_str());
 }
 
-Student SchoolManagementSystem::generateRandomStudent()
+void benchmarkNameSearch()
 {
-	string fn, ln;
-	Date dob;
+	//Typeahead and fuzzy lookups over the last names of 1M registered students: the first ten students whose last name
+	//starts with a three letter prefix, and every student whose last name is within one or two edits of a mistyped
+	//one, against a scan of every student. The fuzzy results must match the scan's.
+	const int n = 1000000, queries = 10000, scans = 20;
+	cout << "Name search" << endl;
+	srand(23);
 
-	fn = rand() % 26 + 65;
-	for (int i = 0; i < 9; i++)
-		fn += char(rand() % 26 + 97);
+	SchoolManagementSystem sms;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	buildBenchmarkSystem(sms, n, 100, 0);
+	cout << "\tregister " << n << " students: " << secondsSince(start) * 1000 << " ms" << endl;
 
-	ln = rand() % 26 + 65;
-	for (int i = 0; i < 9; i++)
-		ln += char(rand() % 26 + 97);
+	auto mistype = [](string name)
+	{
+		int i = rand() % int(name.size());
+		switch (rand() % 3)
+		{
+		case 0: name[i] = char('a' + rand() % 26); break;
+		case 1: name.erase(i, 1); break;
+		default: name.insert(size_t(i), 1, char('a' + rand() % 26)); break;
+		}
+		return name;
+	};
+	auto distance = [](const string_view& a, const string_view& b)
+	{
+		SmarterArray<int> row;
+		for (size_t j = 0; j <= b.size(); j++)
+			row.append(int(j));
+		for (size_t i = 1; i <= a.size(); i++)
+		{
+			int diagonal = row[0];
+			row[0] = int(i);
+			for (size_t j = 1; j <= b.size(); j++)
+			{
+				int above = row[int(j)];
+				row[int(j)] = min(diagonal + (tolower(a[i - 1]) == tolower(b[j - 1]) ? 0 : 1), min(above, row[int(j) - 1]) + 1);
+				diagonal = above;
+			}
+		}
+		return row[int(b.size())];
+	};
 
-	dob.y = 1998 + rand() % 5;
-	dob.m = 1 + rand() % 12;
-	dob.d = 1 + rand() % 30;
+	size_t found = 0;
+	start = chrono::steady_clock::now();
+	for (int q = 0; q < queries; q++)
+	{
+		string prefix(sms.viewStudent(rand() % n).getLastName().substr(0, 3));
+		found += size_t(sms.findStudentsByPrefix(prefix, "", 10).getSize());
+	}
+	double seconds = secondsSince(start);
+	cout << "\tprefix, first 10: " << seconds * 1e6 / queries << " us per query (" << found << " found)" << endl;
 
-	return Student(fn, ln, dob);
+	start = chrono::steady_clock::now();
+	found = 0;
+	for (int q = 0; q < scans; q++)
+	{
+		string prefix(sms.viewStudent(rand() % n).getLastName().substr(0, 3));
+		int count = 0;
+		for (int i = 0; i < n && count < 10; i++)
+			count += NameSearchIndex::startsWith(sms.viewStudent(i).getLastName(), prefix);
+		found += size_t(count);
+	}
+	seconds = secondsSince(start);
+	cout << "\tprefix, first 10 by scan: " << seconds * 1e6 / scans << " us per query" << endl;
+
+	for (int maxDistance = 1; maxDistance <= 2; maxDistance++)
+	{
+		SmarterArray<string> mistyped;
+		for (int q = 0; q < queries; q++)
+			mistyped.append(mistype(string(sms.viewStudent(rand() % n).getLastName())));
+
+		found = 0;
+		start = chrono::steady_clock::now();
+		for (int q = 0; q < queries; q++)
+			found += size_t(sms.findStudentsLike(mistyped[q], maxDistance, n).getSize());
+		seconds = secondsSince(start);
+		cout << "\twithin " << maxDistance << " edit(s): " << seconds * 1e6 / queries << " us per query (" << found << " found)" << endl;
+
+		bool same = true;
+		start = chrono::steady_clock::now();
+		for (int q = 0; q < scans; q++)
+		{
+			int count = 0;
+			for (int i = 0; i < n; i++)
+				count += distance(mistyped[q], sms.viewStudent(i).getLastName()) <= maxDistance;
+			same = same && count == sms.findStudentsLike(mistyped[q], maxDistance, n).getSize();
+		}
+		seconds = secondsSince(start);
+		cout << "\twithin " << maxDistance << " edit(s) by scan: " << seconds * 1e6 / scans << " us per query ("
+			<< (same ? "same" : "DIFFERENT") << " results)" << endl;
+	}
 }
 
-char SchoolManagementSystem::generateRandomLetterGrade()
+void benchmarkSeatContention()
 {
-	int g = rand() % 11;
-	if (g == 0)
-		return 'A';
-	else if (g <= 2)
-		return 'B';
-	else if (g <= 5)
-		return 'C';
-	else if (g <= 7)
-		return 'D';
-	else
-		return 'F';
+	//An enrolment rush: max(16, 4 x hardware threads) threads each request seats for their own 2000 students in the same
+	//4 courses, which have room for 5000 students each, while one more thread keeps reading GPAs. Every seat must be
+	//filled and everyone else waitlisted. The rush runs on a concurrent system, where requests for full courses queue
+	//under its shared lock, and then on a sharded one, where seat limits span 8 shards.
+	const int threads = max(16, 4 * int(thread::hardware_concurrency())), studentsPerThread = 2000, courses = 4, capacity = 5000;
+	const int n = threads * studentsPerThread, shardCount = 8;
+	cout << "Seat contention (" << threads << " threads, " << courses << " courses of " << capacity << " seats)" << endl;
+
+	//request(i, k) asks for the k-th course of student i and read(i) reads the GPA of student i
+	auto rush = [&](const char* label, const auto& request, const auto& read, const auto& getWaitlistSize)
+	{
+		atomic<int> taken(0), waitlisted(0);
+		atomic<bool> done(false);
+		atomic<long long> reads(0);
+		thread reader([&]()
+		{
+			long long count = 0;
+			uint32_t seed = 88172645u;
+			while (!done.load(memory_order_relaxed))
+			{
+				seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5;
+				read(int(seed % uint32_t(n)));
+				count++;
+			}
+			reads = count;
+		});
+
+		auto work = [&](const int& t)
+		{
+			int seated = 0, waiting = 0;
+			for (int i = t * studentsPerThread; i < (t + 1) * studentsPerThread; i++)
+			{
+				for (int k = 0; k < courses; k++)
+				{
+					SeatStatus status = request(i, (i + k) % courses);
+					seated += status == seatTaken;
+					waiting += status == seatWaitlisted;
+				}
+			}
+			taken += seated;
+			waitlisted += waiting;
+		};
+
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		SmarterArray<thread> pool;
+		for (int t = 0; t < threads; t++)
+			pool.append(thread(work, t));
+		for (int t = 0; t < threads; t++)
+			pool[t].join();
+		getWaitlistSize(0); //Requests still queued to join their waitlists count toward the time
+		double seconds = secondsSince(start);
+		done = true;
+		reader.join();
+
+		bool filled = taken == courses * capacity && waitlisted == courses * (n - capacity);
+		for (int c = 0; c < courses; c++)
+			filled = filled && getWaitlistSize(c) == n - capacity;
+		cout << "\t" << label << ": " << courses * double(n) / seconds / 1e6 << " M requests/s, " << double(reads.load()) / seconds / 1e6
+			<< " M reads/s alongside, " << taken.load() << " seated, " << waitlisted.load() << " waitlisted ("
+			<< (filled ? "as expected" : "WRONG") << ")" << endl;
+	};
+
+	srand(29);
+	ConcurrentSchoolManagementSystem sms;
+	SmarterArray<StudentId> students;
+	SmarterArray<CourseId> courseIds;
+	sms.write([&](SchoolManagementSystem& s)
+	{
+		buildBenchmarkSystem(s, n, courses, 0);
+		for (int i = 0; i < n; i++)
+			students.append(s.getStudentId(i));
+		for (int c = 0; c < courses; c++)
+		{
+			s.setCourseCapacity(c, capacity);
+			courseIds.append(s.getCourseId(c));
+		}
+		return 0;
+	});
+	rush("concurrent", [&](const int& i, const int& k) { return sms.requestSeat(students[i], courseIds[k]); },
+		[&](const int& i) { return sms.getStudentGPA(i); }, [&](const int& c) { return sms.getWaitlist(c).getSize(); });
+
+	srand(29);
+	ShardedSchoolManagementSystem sharded(shardCount);
+	SmarterArray<StudentLocation> locations;
+	for (int c = 0; c < courses; c++)
+	{
+		sharded.offerCourse(Course("COURSE" + to_string(c), 1 + c % 4));
+		sharded.setCourseCapacity(c, capacity);
+	}
+	while (locations.getSize() < n)
+	{
+		Student s = SchoolManagementSystem::generateRandomStudent();
+		if (sharded.registerStudent(s))
+			locations.append(sharded.findStudent(s.getFirstName(), s.getLastName()));
+	}
+	rush("8 shards", [&](const int& i, const int& k) { return sharded.requestSeat(locations[i], k); },
+		[&](const int& i) { return sharded.getStudentGPA(locations[i]); }, [&](const int& c) { return sharded.getWaitlist(c).getSize(); });
+}
+
+void runBenchmarks(const string& name)
+{
+	if (name == "" || name == "storage")
+		benchmarkStudentStorage();
+	if (name == "" || name == "lookup")
+		benchmarkStudentLookup();
+	if (name == "" || name == "ranking")
+		benchmarkRanking();
+	if (name == "" || name == "snapshot")
+		benchmarkSnapshot();
+	if (name == "" || name == "wal")
+		benchmarkWriteAheadLog();
+	if (name == "" || name == "import")
+		benchmarkCsvImport();
+	if (name == "" || name == "allocations")
+		benchmarkReportAllocations();
+	if (name == "" || name == "columnar")
+		benchmarkColumnarScans();
+	if (name == "" || name == "interning")
+		benchmarkInterning();
+	if (name == "" || name == "resources")
+		benchmarkMapResources();
+	if (name == "" || name == "enrolments")
+		benchmarkEnrolmentStore();
+	if (name == "" || name == "parallel")
+		benchmarkParallelGPA();
+	if (name == "" || name == "gradekernel")
+		benchmarkGradeKernels();
+	if (name == "" || name == "concurrent")
+		benchmarkConcurrentAccess();
+	if (name == "" || name == "sharded")
+		benchmarkShardedAccess();
+	if (name == "" || name == "batch")
+		benchmarkBatchMutations();
+	if (name == "" || name == "server")
+		benchmarkRequestServer();
+	if (name == "" || name == "reports")
+		benchmarkSnapshotReports();
+	if (name == "" || name == "render")
+		benchmarkReportRendering();
+	if (name == "" || name == "search")
+		benchmarkNameSearch();
+	if (name == "" || name == "contention")
+		benchmarkSeatContention();
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-int main()
+int main(int argc, char* argv[])
 {
+	if (argc > 1 && string(argv[1]) == "benchmark")
+	{
+		runBenchmarks(argc > 2 ? argv[2] : "");
+		return 0;
+	}
+
+	//serve [port] [students]: serve a system of random graded students until a line is read from the standard input
+	if (argc > 1 && string(argv[1]) == "serve")
+	{
+		int port = argc > 2 ? atoi(argv[2]) : 5555, students = argc > 3 ? atoi(argv[3]) : 100000;
+		ConcurrentSchoolManagementSystem sms;
+		sms.write([&](SchoolManagementSystem& s) { buildBenchmarkSystem(s, students, 500, 6); return 0; });
+
+		RequestServer server(sms);
+		if (!server.start(port, max(1, int(thread::hardware_concurrency()))))
+		{
+			cout << "Could not listen on port " << port << endl;
+			return 1;
+		}
+		thread loop(&RequestServer::run, &server);
+		cout << "Serving " << students << " students on 127.0.0.1:" << server.getPort() << ". Press Enter to stop." << endl;
+		string line;
+		getline(cin, line);
+		server.stop();
+		loop.join();
+		return 0;
+	}
+
+	//loadgen [port] [connections] [requests per connection] [pipeline depth]: load a running server and report latency
+	if (argc > 1 && string(argv[1]) == "loadgen")
+	{
+		int port = argc > 2 ? atoi(argv[2]) : 5555, connections = argc > 3 ? atoi(argv[3]) : 4;
+		int requests = argc > 4 ? atoi(argv[4]) : 20000, depth = argc > 5 ? atoi(argv[5]) : 32;
+		LoadReport report = runLoadGenerator(port, max(1, connections), max(0, requests), max(1, depth));
+		cout << report << endl;
+		return report.requests > 0 && report.badResponses == 0 ? 0 : 1;
+	}
+
 	cout << "Welcome to Gusty School Management System" << endl;
 	cout << "===================================================" << endl;
 
@@ -1003,7 +10191,7 @@ int main()
 	{
 		cout << "Farhan Rahmoon is a student in the school. Details below..." << endl;
 		cout << sms.getStudent(studentIndex) << endl;
-		cout << sms.getStudentMap(studentIndex) << endl;
+		cout << sms.viewStudentMap(studentIndex) << endl;
 	}
 
 	//See if a randomly chosen student among those existing students is a student in the school
@@ -1016,7 +10204,7 @@ int main()
 	{
 		cout << s.getFirstName() << " " << s.getLastName() << " is a student in the school. Details below..." << endl;
 		cout << sms.getStudent(studentIndex) << endl;
-		cout << sms.getStudentMap(studentIndex);
+		cout << sms.viewStudentMap(studentIndex);
 		cout << "GPA = " << sms.getStudentGPA(studentIndex) << endl;
 	}
 
@@ -1079,10 +10267,10 @@ int main()
 	//Assign letter grades to the students
 	for (int studentIndex = 0; studentIndex < sms.getNumberOfRegisteredStudents(); studentIndex++)
 	{
-		int n = sms.getStudentMap(studentIndex).getSize(); //Assign letter grades to each course the student is enrolled in
+		int n = sms.viewStudentMap(studentIndex).getSize(); //Assign letter grades to each course the student is enrolled in
 		for (int j = 0; j < n; j++)
 		{
-			int courseIndex = sms.getStudentMap(studentIndex).keyAtIndex(j);
+			int courseIndex = sms.viewStudentMap(studentIndex).keyAtIndex(j);
 			sms.assignLetterGrade(studentIndex, courseIndex, sms.generateRandomLetterGrade());
 		}
 	}
@@ -1100,9 +10288,9 @@ int main()
 	{
 		cout << s.getFirstName() << " " << s.getLastName() << " is a student in the school. Details below..." << endl;
 		cout << sms.getStudent(studentIndex) << endl;
-		cout << sms.getStudentMap(studentIndex) << endl;
-		int randomCourseMapIndex = rand() % sms.getStudentMap(studentIndex).getSize();
-		int courseIndex = sms.getStudentMap(studentIndex).keyAtIndex(randomCourseMapIndex);
+		cout << sms.viewStudentMap(studentIndex) << endl;
+		int randomCourseMapIndex = rand() % sms.viewStudentMap(studentIndex).getSize();
+		int courseIndex = sms.viewStudentMap(studentIndex).keyAtIndex(randomCourseMapIndex);
 		bool flag = sms.withdrawStudent(studentIndex, courseIndex);
 		if (!flag)
 			cout << "Withdrawing the student at index " << studentIndex << " from the course at index " << courseIndex << " failed." << endl << endl;
@@ -1111,7 +10299,7 @@ int main()
 			cout << "Student at index " << studentIndex << " withdrawn from the course at index " << courseIndex << endl;
 			cout << "The updated information for the student is now..." << endl;
 			cout << sms.getStudent(studentIndex) << endl;
-			cout << sms.getStudentMap(studentIndex) << endl;
+			cout << sms.viewStudentMap(studentIndex) << endl;
 		}
 	}
 